@@ -78,7 +78,8 @@ int readNFiles(int N, const char* dirname);
  * @param pathname must be != NULL with length < 108 (UNIX standard).
  * @param dirname == NULL will not store evicted files inside the cache.
  * @exception errno is set to EINVAL for invalid params,to ENOTCONN if client is not connected to the socket, to
- * EBADMSG if the socket responds with an invalid message. errno is also set if the previous operation performed by
+ * EBADMSG if the socket responds with an invalid message, to ECANCELED if the admission filter of the server
+ * rejected the file (the file is removed from the server). errno is also set if the previous operation performed by
  * the client is an openFile with O_CREATE and O_LOCK set.
  * @note  will exit on fatal errors.
  * verbose_mode toggled will print the operation details to stdout.
@@ -99,17 +100,30 @@ int writeFile(const char* pathname, const char* dirname);
 int appendToFile(const char* pathname, void* buf, size_t size, const char* dirname);
 
 /**
- * @brief sets the O_LOCK flag for the requested file.
+ * @brief sets the O_LOCK flag for the requested file. If another client owns the lock over the file,
+ * the call blocks until the server hands the lock over to the client.
  * @returns 0 on success, -1 on failure.
  * @param pathname must be != NULL with length < 108 (UNIX standard).
  * @exception errno is set to EINVAL for invalid params,to ENOTCONN if client is not connected to the socket, to
  * EBADMSG if the socket responds with an invalid message. errno is also set if the file is not opened by the
- * client and if another client owns a lock over the file.
+ * client and if the file is removed while waiting for its lock.
  * @note  will exit on fatal errors.
  * verbose_mode toggled will print the operation details to stdout.
 */
 int lockFile(const char* pathname);
 
+/**
+ * @brief sets the O_LOCK flag for the requested file as lockFile, waiting for the lock at most msec
+ * milliseconds if another client owns it.
+ * @returns 0 on success, -1 on failure.
+ * @param pathname must be != NULL with length < 108 (UNIX standard).
+ * @param msec 0 to wait until the lock is handed over, < 0 not to wait at all.
+ * @exception errno is set as for lockFile, to ETIMEDOUT if the wait has lasted msec milliseconds and to EPERM
+ * if msec < 0 and another client owns the lock.
+ * @note the server checks the waits every 100 milliseconds, a wait may last that much longer than msec.
+*/
+int lockFileTimed(const char* pathname, long msec);
+
 /**
  * @brief resets the O_LOCK flag for the requested file.
  * @returns 0 on success, -1 on failure.
@@ -0,0 +1,96 @@
+/**
+ * @brief header file for the reference counted immutable buffers holding the contents of files.
+ *
+*/
+
+#ifndef _BLOB_H_
+#define _BLOB_H_
+
+#include <stdlib.h>
+#include <sys/uio.h>
+
+typedef struct _blob blob_t;
+
+/**
+ * @brief creates a new blob holding a copy of the data, with one reference owned by the caller.
+ * @returns a blob on success, NULL on failure.
+ * @param data must be != NULL if size != 0.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM if malloc fails.
+*/
+blob_t* blob_create(const void* data, size_t size);
+
+/**
+ * @brief creates a new blob of the given size, to be filled by the caller before any other
+ * reference is taken, with one reference owned by the caller.
+ * @returns a blob on success, NULL on failure.
+ * @param size must be != 0.
+ * @param data must be != NULL, it is set to the contents of the blob.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM if malloc fails.
+*/
+blob_t* blob_reserve(size_t size, void** data);
+
+/**
+ * @brief creates a new blob over memory owned by someone else, without copying it, with one
+ * reference owned by the caller. The memory must stay valid and unchanged until release is
+ * called, once the last blob holding it has been freed.
+ * @returns a blob on success, NULL on failure.
+ * @param data must be != NULL.
+ * @param size must be != 0.
+ * @param release must be != NULL, called with owner when the memory is no longer used.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM if malloc fails.
+*/
+blob_t* blob_wrap(const void* data, size_t size, void (*release)(void*), void* owner);
+
+/**
+ * @brief appends a copy of the data to a blob. The contents are stored in chunks, so that
+ * only the data appended is copied. If other references to the blob are held, the blob is
+ * replaced by a new one sharing its chunks and the holders of the other references still see
+ * the old contents.
+ * @returns 0 on success, -1 on failure.
+ * @param blob must be != NULL, if *blob is NULL a new blob is created. The caller must own
+ * a reference to *blob and must be the only one appending to it.
+ * @param data must be != NULL if size != 0.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM if malloc fails.
+*/
+int blob_append(blob_t** blob, const void* data, size_t size);
+
+/**
+ * @brief takes a new reference to a blob, the contents stay valid until it is released.
+ * @returns the blob.
+ * @param blob must be != NULL.
+*/
+blob_t* blob_ref(blob_t* blob);
+
+/**
+ * @brief releases a reference to a blob, the blob is freed with its last reference.
+*/
+void blob_unref(blob_t* blob);
+
+/**
+ * @brief gets the size of the contents of a blob.
+ * @returns the size on success, 0 on failure.
+ * @param blob must be != NULL.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+size_t blob_get_size(const blob_t* blob);
+
+/**
+ * @brief gets the chunks of a blob, in order, to be used for vectored I/O.
+ * @returns the number of chunks saved to iov, 0 if there are no chunks after first or on failure.
+ * @param blob must be != NULL.
+ * @param iov must be != NULL, it is filled with at most max chunks, they must not be modified.
+ * @param first index of the first chunk to be saved.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+size_t blob_get_chunks(const blob_t* blob, struct iovec* iov, size_t first, size_t max);
+
+/**
+ * @brief copies the contents of a blob, joining its chunks.
+ * @returns the number of bytes copied, 0 if the blob is empty or on failure.
+ * @param blob must be != NULL.
+ * @param dst must be != NULL, with room for the size of the blob.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+size_t blob_copy(const blob_t* blob, void* dst);
+
+#endif
@@ -6,22 +6,48 @@
 #ifndef _CACHE_H_
 #define _CACHE_H_
 
+#include <stdbool.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <linked_list.h>
+#include <blob.h>
 #include "defines.h"
 
 
 typedef struct _cache cache_t;
 
 /**
- * @brief creates a cache of limited size with a certain policy.
+ * @brief creates a cache of limited size with a certain policy, split into shards.
  * @returns a cache on success, NULL on failure.
  * @param files_max must be != 0.
  * @param size_max must be != 0.
- * @exception errno is set to EINVAL for invalid params.
+ * @param admission true if writes causing capacity misses must pass the admission filter.
+ * @param shard_num must be != 0, each shard has its own lock and an equal share of the capacity.
+ * @param cold_age seconds a file must stay unused before a background thread compresses its
+ * contents, 0 if files are never compressed.
+ * @param dedup true if files written with identical contents share them and are charged for
+ * them once.
+ * @param spill_dir existing directory where evicted files are spilled and opened again from,
+ * NULL if evicted files are lost.
+ * @param spill_max max size of the files spilled, 0 for the max size of the cache.
+ * @param wal_path path of the write-ahead log the changes to the files are recorded to, NULL
+ * if changes made after the last snapshot are lost on a crash.
+ * @param wal_delay microseconds the log waits for more changes before committing them together.
+ * @param evict_low percentage of the max size a background thread evicts files down to, must
+ * be != 0 and <= evict_high if there is a background thread.
+ * @param evict_high percentage of the max size above which the background thread evicts files,
+ * must be <= 100, 0 if files are only evicted by the writes exceeding the max size.
+ * @param reclaim true if the large contents left by the files are freed by a background thread,
+ * after the locks of the shards are released.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM for malloc failure, as open,
+ * ftruncate and mmap if the spill directory cannot be used, as opendir and open if the log
+ * cannot be opened.
 */
-cache_t* cache_create(size_t files_max, size_t size_max, policy_t pol);
+cache_t* cache_create(size_t files_max, size_t size_max, policy_t pol, bool admission, size_t shard_num,
+                      time_t cold_age, bool dedup, const char* spill_dir, size_t spill_max,
+                      const char* wal_path, unsigned long wal_delay, unsigned int evict_low,
+                      unsigned int evict_high, bool reclaim);
 
 /**
  * @brief opening of a file by a client with flags.
@@ -32,6 +58,8 @@ cache_t* cache_create(size_t files_max, size_t size_max, policy_t pol);
  * to EBADF if the client has the file already open, to EPERM if the O_LOCK is set but the ownership
  * of the lock belongs to another client, to EEXIST if O_CREATE is set but the file already exists, to
  * ENOENT if O_CREATE is not set and the file does not exist already.
+ * @note if the cache has a spill tier, a file evicted to it is opened by moving it back to the
+ * cache, and a file created replaces the one spilled with the same name.
 */
 int cache_openFile(cache_t* cache, const char* pathname, int flags, int client);
 
@@ -40,19 +68,21 @@ int cache_openFile(cache_t* cache, const char* pathname, int flags, int client);
  * @returns 0 on success, 1 on failure, -1 on fatal errors.
  * @param cache must be != NULL.
  * @param pathname must be != NULL.
- * @param buf must be != NULL.
- * @param size must be != NULL.
+ * @param contents must be != NULL, set to a reference to the contents of the file (NULL if
+ * the file is empty) to be released with blob_unref. Compressed contents are decompressed
+ * after the locks over the file and the cache are released.
  * @exception errno is set to EINVAL for invalid params, to ENOENT if the file is not present,
  * to EPERM if the file is locked is set but the ownership of the lock belongs to another client,
  * to EACCES if the files has not been opened by the client beforehand.
 */
-int cache_readFile(cache_t* cache, const char* pathname, void** buf, size_t* size, int client);
+int cache_readFile(cache_t* cache, const char* pathname, blob_t** contents, int client);
 
 /**
  * @brief reading of n files from server.
  * @returns 0 on success, 1 on failure, -1 on fatal errors.
  * @param cache must be != NULL.
- * @param read_files must be != NULL.
+ * @param read_files must be != NULL, the value of each file read begins with a reference to its
+ * contents (blob_t*, empty for empty files) to be released with blob_unref.
  * @param n == 0 or less files than n are present, all files will be read.
  * @exception errno is set to EINVAL for invalid params.
  * @note opening the file beforehand is not required, if a file is locked by another client the
@@ -62,12 +92,15 @@ int cache_readNFiles(cache_t* cache, linked_list_t** read_files, size_t n, int c
 
 /**
  * @brief writing of files to the server, with eviction of files on capacity misses.
- * @returns 0 on success, 1 on failure, -1 on fatal errors.
+ * @returns 0 on success, 1 on failure, -1 on fatal errors, 2 if the admission filter
+ * rejected the file (the file is removed and nothing is evicted).
  * @param cache must be != NULL.
  * @param pathname must be != NULL.
  * @exception errno is set to EINVAL for invalid params, to EACCES if the client has not writing
  * privileges over the file, to ENOENT if the file is not present, to EFBIG if size of the file
  * exceeds the cache's capacity, to EIDRM if the file to be written was evicted.
+ * @note the value of each evicted file begins with a reference to its contents (blob_t*, empty for
+ * empty files) to be released with blob_unref.
 */
 int cache_writeFile(cache_t* cache, const char* pathname, size_t length, const char* contents, linked_list_t** evicted, int client);
 
@@ -80,22 +113,29 @@ int cache_writeFile(cache_t* cache, const char* pathname, size_t length, const c
  * but the ownership of the lock belongs to another client, to EACCES if the client has not writing
  * privileges over the file, to ENOENT if the file is not present, to EIDRM if the file to be written
  * was evicted, to ENOMEM if malloc has failed.
+ * @note the value of each evicted file begins with a reference to its contents, as for cache_writeFile.
 */
 int cache_appendToFile(cache_t* cache, const char* pathname, void* buf, size_t size, linked_list_t** evicted, int client);
 
 /**
- * @brief locking of a file by a client.
- * @returns 0 on success, 1 on failure, -1 on fatal errors.
+ * @brief locking of a file by a client. If the lock is owned by another client, the client is
+ * parked in the queue of the clients waiting for it and the lock is handed over to it when it is
+ * released, in order of arrival.
+ * @returns 0 on success, 1 on failure, 3 (OP_WAITING) if the client waits for the lock, -1 on
+ * fatal errors.
  * @param cache must be != NULL.
  * @param pathname must be != NULL.
- * @exception errno is set to EINVAL for invalid params, to EPERM if the file is locked is set
- * but the ownership of the lock belongs to another client, to EACCES if the file is not currently opened
- * by the client, to ENOENT if the file is not present.
+ * @param timeout milliseconds the client waits for the lock at most, 0 if it waits until it gets
+ * it, < 0 if it does not wait.
+ * @exception errno is set to EINVAL for invalid params, to EPERM if the ownership of the lock
+ * belongs to another client and the client does not wait, to EACCES if the file is not currently
+ * opened by the client, to ENOENT if the file is not present, to ENOMEM if malloc fails.
+ * @note the outcome of a wait is taken with cache_lock_reply.
 */
-int cache_lockFile(cache_t* cache, const char* pathname, int client);
+int cache_lockFile(cache_t* cache, const char* pathname, int client, long timeout);
 
 /**
- * @brief unlocking of a file by a client.
+ * @brief unlocking of a file by a client, the lock is handed over to the first client waiting for it.
  * @returns 0 on success, 1 on failure, -1 on fatal errors.
  * @exception errno is set to EINVAL for invalid params, to EPERM if the file is locked is set
  * but the ownership of the lock belongs to another client, to EACCES if the file is not currently opened
@@ -121,6 +161,16 @@ int cache_closeFile(cache_t* cache, const char* pathname, int client);
 */
 int cache_removeFile(cache_t* cache, const char* pathname, int client);
 
+/**
+ * @brief releases the files held by a client leaving the server: it leaves their openers, its
+ * writing permissions are given up and its locks are handed over to the clients waiting for them.
+ * @returns 0 on success, 1 on failure, -1 on fatal errors.
+ * @param cache must be != NULL.
+ * @param client must be >= 0, its file descriptor must not be reused before the call returns.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+int cache_closeConnection(cache_t* cache, int client);
+
 /**
  * @brief gets the max number of files inside the server.
  * @param cache must be != NULL.
@@ -137,6 +187,125 @@ size_t cache_get_files_max(cache_t* cache);
 */
 size_t cache_get_size_max(cache_t* cache);
 
+/**
+ * @brief gets the bytes of the contents left by the files and not yet freed by the reclaimer.
+ * @param cache must be != NULL.
+ * @returns bytes waiting to be freed on success, 0 on failure.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+size_t cache_get_reclaim_pending(cache_t* cache);
+
+/**
+ * @brief gets the ratio of requests for files finding the file inside the cache.
+ * @param cache must be != NULL.
+ * @returns hit ratio on success, 0 on failure.
+ * @exception errno is set to EINVAL for invalid params.
+ * @note a request is an openFile, it misses if the file has to be created or is not present.
+*/
+double cache_get_hit_ratio(cache_t* cache);
+
+/**
+ * @brief gets the ratio of bytes requested found inside the cache.
+ * @param cache must be != NULL.
+ * @returns byte hit ratio on success, 0 on failure.
+ * @exception errno is set to EINVAL for invalid params.
+ * @note the bytes missed are the ones written to the files created.
+*/
+double cache_get_byte_hit_ratio(cache_t* cache);
+
+/**
+ * @brief waits until the changes made by the calling thread are recorded on disk by the
+ * write-ahead log, so that they can be acknowledged. Changes made by other threads in the
+ * meantime are committed together with them.
+ * @returns 0 on success, -1 on failure.
+ * @param cache must be != NULL, without a log the call returns at once.
+ * @exception errno is set to EINVAL for invalid params, as write and fdatasync if the log
+ * cannot be written.
+*/
+int cache_sync(cache_t* cache);
+
+/**
+ * @brief saves the files inside the cache to a snapshot, with their contents as they are stored
+ * and the metadata used by the replacement policy.
+ * @returns 0 on success, -1 on failure.
+ * @param cache must be != NULL.
+ * @param path must be != NULL, the snapshot written before is replaced only on success.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM for malloc failure, as fopen,
+ * fwrite, fsync and rename for failures of the file.
+ * @note the segments of the write-ahead log covered by the snapshot are removed.
+*/
+int cache_save(cache_t* cache, const char* path);
+
+/**
+ * @brief loads the files saved to a snapshot inside an empty cache. The contents are not read:
+ * the snapshot is mapped in memory and each file is read from it when first accessed. The files
+ * the cache cannot hold are skipped, starting from the ones to be evicted first.
+ * @returns 0 on success, -1 on failure.
+ * @param cache must be != NULL.
+ * @param path must be != NULL.
+ * @exception errno is set to EINVAL for invalid params and for corrupted snapshots, to ENOMEM for
+ * malloc failure, to ENOENT if there is no snapshot.
+*/
+int cache_load(cache_t* cache, const char* path);
+
+/**
+ * @brief replays the changes recorded by the write-ahead log after the snapshot loaded, or
+ * all of them if no snapshot was loaded. Replaying changes that were already replayed gives
+ * the same files.
+ * @returns 0 on success, -1 on failure.
+ * @param cache must be != NULL, without a log the call returns at once.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM for malloc failure, as open
+ * and read if the log cannot be read.
+*/
+int cache_recover(cache_t* cache);
+
+/**
+ * @brief starts writing a checkpoint of the cache in the background, as a snapshot loadable by
+ * cache_load. The shards are locked only while the server forks: a child process writes the
+ * checkpoint from its copy on write view of the cache, while the server keeps serving requests.
+ * @returns 0 on success, 1 if a checkpoint is still being written, -1 on failure.
+ * @param cache must be != NULL.
+ * @param path must be != NULL, the checkpoint written before is replaced only on success.
+ * @param compact true if the checkpoint is the snapshot loaded at startup, so that the segments
+ * of the write-ahead log it covers are removed once it is written.
+ * @exception errno is set to EINVAL for invalid params, as pipe and fork on failure, as open,
+ * write and fdatasync if the write-ahead log cannot be rotated.
+ * @note checkpoints must be started and waited for by a single thread.
+*/
+int cache_checkpoint(cache_t* cache, const char* path, bool compact);
+
+/**
+ * @brief waits for the checkpoint being written, collecting its duration and the pages copied
+ * on write while it was written.
+ * @returns 1 if a checkpoint has finished, 0 if none is being written or if it is still being
+ * written and block is false, -1 on failure.
+ * @param cache must be != NULL.
+ * @param block true if the call waits until the checkpoint is written.
+ * @exception errno is set to EINVAL for invalid params, as waitpid on failure.
+*/
+int cache_checkpoint_wait(cache_t* cache, bool block);
+
+/**
+ * @brief fails the waits for a lock lasting longer than the timeout of their client, with
+ * ETIMEDOUT as errno.
+ * @returns the number of waits failed on success, -1 on failure.
+ * @param cache must be != NULL.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+int cache_lock_expire(cache_t* cache);
+
+/**
+ * @brief takes the first reply to be sent to a client whose wait for a lock is over, because the
+ * lock has been handed over to it, the file has left the cache or the wait has timed out.
+ * @returns 1 if a reply has been taken, 0 if there is none, -1 on failure.
+ * @param cache must be != NULL.
+ * @param client must be != NULL, set to the file descriptor of the client.
+ * @param result must be != NULL, set to 0 if the client owns the lock, 1 otherwise.
+ * @param error must be != NULL, set to the errno of the failed waits.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+int cache_lock_reply(cache_t* cache, int* client, int* result, int* error);
+
 /**
  * @brief printing of a summary of informations about the cache.
  * @param cache
@@ -26,6 +26,7 @@
 #define SUCCESS "SUCCESS"
 #define FAILURE "FAILURE"
 #define EXIT_FATAL "EXIT_FATAL"
+#define REJECTED "REJECTED"
 
 //setting mask with flag and resetting it
 #define SET_MASK(mask, flag) mask |= flag
@@ -44,6 +45,8 @@
 #define OP_EXIT_FATAL -1
 #define OP_SUCCESS 0
 #define OP_FAILURE 1
+#define OP_REJECTED 2 // the write was not admitted inside the cache
+#define OP_WAITING 3 // the lock is held by another client, the reply is sent once the wait is over
 
 #define BUF_LEN_MAX 512
 #define ERRNO_LEN_MAX 4 // used for errno strings
@@ -119,7 +122,10 @@ typedef enum _ops{
 typedef enum _policy{
 	FIFO,
 	LRU,
-   LFU
+   LFU,
+   ARC,
+   TWO_Q,
+   GDSF
 } policy_t;
 
 
@@ -0,0 +1,60 @@
+/**
+ * @brief header file for the epoch based reclamation of the memory read without locks.
+ *
+*/
+
+#ifndef _EPOCH_H_
+#define _EPOCH_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+//link queueing an object to be freed, held by the object itself so that retiring it never fails
+typedef struct _epoch_entry{
+   struct _epoch_entry* next;
+   void* ptr;
+   void (*free_fun)(void*);
+} epoch_entry_t;
+
+/**
+ * @brief enters a read-side critical section of the calling thread: the objects it reaches
+ * until it leaves are not freed, even if they are retired meanwhile. Sections can be nested.
+ * @returns 0 on success, -1 on failure.
+ * @exception errno is set to ENOMEM if the first section of the thread cannot register it.
+*/
+int epoch_enter(void);
+
+/**
+ * @brief leaves the read-side critical section entered last by the calling thread.
+*/
+void epoch_exit(void);
+
+/**
+ * @brief retires an object no longer reachable by the threads entering a section from now on.
+ * It is freed once every thread inside a section has left it.
+ * @param entry must be != NULL, it must stay inside the object until it is freed.
+ * @param ptr passed to free_fun.
+ * @param free_fun must be != NULL.
+*/
+void epoch_retire(epoch_entry_t* entry, void* ptr, void (*free_fun)(void*));
+
+/**
+ * @brief moves to the next epoch if the threads inside a section allow it, freeing the objects
+ * retired long enough ago. Nothing is done if no object waits or if another thread is retiring,
+ * so that the objects retired are freed even while no other one is.
+*/
+void epoch_poll(void);
+
+/**
+ * @brief waits for the threads inside a section to leave it and frees every object retired.
+*/
+void epoch_barrier(void);
+
+/**
+ * @brief prints the objects retired and freed, the objects waiting to be freed and the
+ * epochs gone by.
+ * @param stream must be != NULL.
+*/
+void epoch_print(FILE* stream);
+
+#endif
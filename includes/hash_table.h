@@ -6,6 +6,7 @@
 #ifndef _HASH_TABLE_H_
 #define _HASH_TABLE_H_
 
+#include <stdint.h>
 #include <stdlib.h>
 
 #include <linked_list.h>
@@ -13,17 +14,36 @@
 typedef struct _hash_table hash_table_t;
 
 /**
- * @brief creates a new hash table.
+ * @brief creates a new hash table with open addressing: the keys are stored inside an array of
+ * slots with their full hash, so that looking them up allocates nothing. The table grows and
+ * shrinks with the keys inside it, moving them to the new slots a few at a time on each
+ * insertion and removal. The data inserted keeps its address until it is removed.
  * @returns an hash table on success, NULL on failure.
- * @param buckets number of buckets
- * @param hash_fun pointer to hashing function
+ * @param buckets number of keys held without growing the table, the table never shrinks below
+ * them. 0 for the smallest table.
+ * @param hash_fun pointer to hashing function, NULL for table_hash_seeded with a seed picked
+ * for the table
  * @param hash_cmp pointer to comparing function
- * @param free_data pointer to function for deallocating a node's memory.
+ * @param free_data pointer to function for deallocating a node's memory, it must release the
+ * data with free, the key is allocated together with it.
  * @exception errno is set to ENOMEM if malloc fails.
 */
 hash_table_t* table_create(size_t buckets, size_t (*hash_fun) (const void*),
                            int (*hash_cmp) (const void*, const void*), void (*free_data) (void*));
 
+/**
+ * @brief hashes a string with the PJW hash, one byte at a time.
+ * @returns the hash of the string, 0 if key is NULL.
+*/
+size_t table_hash_pjw(const void* key);
+
+/**
+ * @brief hashes a string with a seeded hash following wyhash, reading 8 bytes at a time.
+ * Different seeds give unrelated hashes of the same strings.
+ * @returns the hash of the string, 0 if key is NULL.
+*/
+size_t table_hash_seeded(const void* key, uint64_t seed);
+
 /**
  * @brief inserts a key-value pair into the table
  * @returns 1 on success, 0 on duplicate, -1 on failure.
@@ -34,6 +54,49 @@ hash_table_t* table_create(size_t buckets, size_t (*hash_fun) (const void*),
 int table_insert(hash_table_t* table, const void* key,
                       size_t key_size, const void* data, size_t data_size);
 
+/**
+ * @brief inserts a key with room for its data, which is built by the caller where it is stored,
+ * unless the key is already inside the table.
+ * @returns 1 if the key has been inserted, 0 if it was already inside, -1 on failure.
+ * @param key must be != NULL.
+ * @param key_size must be != 0.
+ * @param data_size must be != 0.
+ * @param data must be != NULL, set to the data of the key: zeroed if it has been inserted,
+ * left as it was otherwise.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM if malloc fails.
+*/
+int table_emplace(hash_table_t* table, const void* key, size_t key_size, size_t data_size, void** data);
+
+/**
+ * @brief inserts a key without copying it, with room for its data built by the caller, unless
+ * the key is already inside the table. The key must stay valid as long as it is inside the table,
+ * the function deallocating the data is the one releasing it.
+ * @returns 1 if the key has been inserted, 0 if it was already inside, -1 on failure.
+ * @param key must be != NULL.
+ * @param hash of the key, as the hash function of the table computes it.
+ * @param data_size must be != 0.
+ * @param data must be != NULL, set to the data of the key: zeroed if it has been inserted,
+ * left as it was otherwise.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM if malloc fails.
+*/
+int table_emplace_borrowed(hash_table_t* table, const char* key, size_t hash, size_t data_size, void** data);
+
+/**
+ * @brief looks a key up, hashing it once.
+ * @returns a pointer to the data of the key on success, NULL on failure.
+ * @param table must be != NULL.
+ * @param key must be != NULL, inserted with data.
+ * @exception errno is set to EINVAL for invalid params, to ENOENT if the key
+ * is not inside the hashtable.
+*/
+void* table_find(const hash_table_t* table, const void* key);
+
+/**
+ * @brief looks a key up with a hash computed by the caller, as table_find.
+ * @param hash of the key, as the hash function of the table computes it.
+*/
+void* table_find_hashed(const hash_table_t* table, const void* key, size_t hash);
+
 /**
  * @brief checks if a key is inside the hashtable.
  * @returns 1 if found, 0 if not found, -1 on failure.
@@ -55,13 +118,19 @@ const void* table_get_value(const hash_table_t* table, const void* key);
 
 /**
  * @brief deletes the node having a certain key.
- * @returns 1 on success, 0 on not found, -1 on failure.
+ * @returns 0 on success, 1 on not found, -1 on failure.
  * @param table must be != NULL.
  * @param key must be != NULL.
  * @exception errno is set to EINVAL for invalid params.
 */
 int table_remove(hash_table_t* table, const void* key);
 
+/**
+ * @brief deletes the node having a certain key with a hash computed by the caller, as table_remove.
+ * @param hash of the key, as the hash function of the table computes it.
+*/
+int table_remove_hashed(hash_table_t* table, const void* key, size_t hash);
+
 /**
  * @brief frees resources allocated for the hash table.
  * @param table
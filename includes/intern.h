@@ -0,0 +1,76 @@
+/**
+ * @brief header file for the pool of interned paths, shared by the tables, the policy lists
+ * and the sessions of the cache.
+ *
+*/
+
+#ifndef _INTERN_H_
+#define _INTERN_H_
+
+#include <stdlib.h>
+
+typedef struct _intern_pool intern_pool_t;
+
+/**
+ * @brief creates an empty pool of interned strings.
+ * @returns a pool on success, NULL on failure.
+ * @exception errno is set to ENOMEM if malloc fails, as pthread_mutex_init for its failures.
+*/
+intern_pool_t* intern_create(void);
+
+/**
+ * @brief hashes a string as the pool hashes the strings interned, with a seed picked once for
+ * every pool of the process. It is the hash function of the tables keyed by interned strings.
+ * @returns the hash of the string, 0 if str is NULL.
+*/
+size_t intern_hash_str(const void* str);
+
+/**
+ * @brief gets the interned copy of a string, interning it if no one holds it, with one
+ * reference owned by the caller. Two strings interned by the same pool are equal if and
+ * only if they are the same pointer.
+ * @returns the interned string on success, NULL on failure.
+ * @param pool must be != NULL.
+ * @param str must be != NULL.
+ * @param hash of str, as intern_hash_str computes it.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM if malloc fails.
+*/
+const char* intern_get(intern_pool_t* pool, const char* str, size_t hash);
+
+/**
+ * @brief takes a new reference to an interned string, without locking its pool.
+ * @returns the string.
+ * @param str must be != NULL, the caller must own a reference to it.
+*/
+const char* intern_ref(const char* str);
+
+/**
+ * @brief releases a reference to an interned string, it leaves its pool with the last one.
+ * @param str if NULL nothing is done.
+*/
+void intern_put(const char* str);
+
+/**
+ * @brief gets the hash of an interned string, computed when it was interned.
+ * @param str must be != NULL.
+*/
+size_t intern_hash(const char* str);
+
+/**
+ * @brief gets the length of an interned string, computed when it was interned.
+ * @param str must be != NULL.
+*/
+size_t intern_len(const char* str);
+
+/**
+ * @brief gets the number of strings inside a pool and the bytes they take, headers included.
+ * @param pool must be != NULL.
+*/
+void intern_stats(intern_pool_t* pool, size_t* strings, size_t* bytes);
+
+/**
+ * @brief frees a pool with the strings left inside it, which must no longer be used.
+*/
+void intern_free(intern_pool_t* pool);
+
+#endif
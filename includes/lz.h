@@ -0,0 +1,32 @@
+/**
+ * @brief header file for the LZ77 codec used for compressing the contents of cold files.
+ *
+*/
+
+#ifndef _LZ_H_
+#define _LZ_H_
+
+#include <stdlib.h>
+
+/**
+ * @brief compresses data into a buffer of the given capacity. The output is a sequence of
+ * literal runs, each one followed by a copy of at least 4 bytes from the previous 64KiB.
+ * @returns the size of the compressed data on success, 0 if it does not fit in capacity or
+ * on failure.
+ * @param src must be != NULL.
+ * @param dst must be != NULL.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+size_t lz_compress(const void* src, size_t size, void* dst, size_t capacity);
+
+/**
+ * @brief decompresses data compressed by lz_compress.
+ * @returns 0 on success, -1 on failure.
+ * @param src must be != NULL.
+ * @param dst must be != NULL, it is filled with exactly raw_size bytes.
+ * @param raw_size size of the data before compression.
+ * @exception errno is set to EINVAL for invalid params and for corrupted data.
+*/
+int lz_decompress(const void* src, size_t size, void* dst, size_t raw_size);
+
+#endif
@@ -6,6 +6,7 @@
 #ifndef _PARSER_H_
 #define _PARSER_H_
 
+#include <stdbool.h>
 #include <stdlib.h>
 
 #include <defines.h>
@@ -78,6 +79,125 @@ unsigned long parser_get_sock_path(const parser_t* parser, char** socket_path_pt
 */
 policy_t parser_get_policy(const parser_t* parser);
 
+/**
+ * @brief gets whether writes must pass the admission filter of the cache.
+ * @returns true if the admission filter is on, false if it is off or on failure.
+ * @param parser must be != NULL.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+bool parser_get_admission(const parser_t* parser);
+
+/**
+ * @brief gets the number of shards the cache is split into.
+ * @returns number of shards on success, 1 on failure.
+ * @param parser must be != NULL.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+unsigned long parser_get_shards(const parser_t* parser);
+
+/**
+ * @brief gets the seconds a file must stay unused before its contents are compressed.
+ * @returns number of seconds on success, 0 if files are never compressed or on failure.
+ * @param parser must be != NULL.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+unsigned long parser_get_cold_age(const parser_t* parser);
+
+/**
+ * @brief gets whether files written with identical contents share them inside the cache.
+ * @returns true if contents are deduplicated, false if they are not or on failure.
+ * @param parser must be != NULL.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+bool parser_get_dedup(const parser_t* parser);
+
+/**
+ * @brief saves the path of the directory holding the files spilled by the cache in spill_path_ptr.
+ * @returns length of the spill directory path on success, 0 if it has not been set or on failure.
+ * @param parser must be != NULL.
+ * @param spill_path_ptr must be != NULL, set to NULL if the path has not been set.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM for malloc failure.
+*/
+unsigned long parser_get_spill_path(const parser_t* parser, char** spill_path_ptr);
+
+/**
+ * @brief gets the max size of the files spilled by the cache.
+ * @returns max size on success, 0 if it has not been set or on failure.
+ * @param parser must be != NULL.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+unsigned long parser_get_spill_size(const parser_t* parser);
+
+/**
+ * @brief saves the path of the snapshot of the cache, written at shutdown and loaded at startup,
+ * in snapshot_path_ptr.
+ * @returns length of the snapshot file path on success, 0 if it has not been set or on failure.
+ * @param parser must be != NULL.
+ * @param snapshot_path_ptr must be != NULL, set to NULL if the path has not been set.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM for malloc failure.
+*/
+unsigned long parser_get_snapshot_path(const parser_t* parser, char** snapshot_path_ptr);
+
+/**
+ * @brief saves the path of the checkpoints of the cache, written in the background while the
+ * server is running, in checkpoint_path_ptr.
+ * @returns length of the checkpoint file path on success, 0 if it has not been set or on failure.
+ * @param parser must be != NULL.
+ * @param checkpoint_path_ptr must be != NULL, set to NULL if the path has not been set.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM for malloc failure.
+*/
+unsigned long parser_get_checkpoint_path(const parser_t* parser, char** checkpoint_path_ptr);
+
+/**
+ * @brief gets the seconds between two checkpoints of the cache.
+ * @returns seconds on success, 0 if checkpoints are only written on request or on failure.
+ * @param parser must be != NULL.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+unsigned long parser_get_checkpoint_interval(const parser_t* parser);
+
+/**
+ * @brief saves the path of the write-ahead log of the cache, named after it are the segments
+ * holding the changes to the files, in wal_path_ptr.
+ * @returns length of the write-ahead log path on success, 0 if it has not been set or on failure.
+ * @param parser must be != NULL.
+ * @param wal_path_ptr must be != NULL, set to NULL if the path has not been set.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM for malloc failure.
+*/
+unsigned long parser_get_wal_path(const parser_t* parser, char** wal_path_ptr);
+
+/**
+ * @brief gets the microseconds the write-ahead log waits for more changes before committing them.
+ * @returns microseconds on success, 0 if the changes are committed at once or on failure.
+ * @param parser must be != NULL.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+unsigned long parser_get_wal_delay(const parser_t* parser);
+
+/**
+ * @brief gets the percentage of the max size of the cache the background eviction stops at.
+ * @returns percentage on success, 0 if it has not been set or on failure.
+ * @param parser must be != NULL.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+unsigned long parser_get_evict_low(const parser_t* parser);
+
+/**
+ * @brief gets the percentage of the max size of the cache the background eviction starts at.
+ * @returns percentage on success, 0 if files are only evicted by the writes or on failure.
+ * @param parser must be != NULL.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+unsigned long parser_get_evict_high(const parser_t* parser);
+
+/**
+ * @brief gets whether the large contents left by the files are freed by a background thread.
+ * @returns true if they are, false if they are freed by the workers or on failure.
+ * @param parser must be != NULL.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+bool parser_get_reclaim(const parser_t* parser);
+
 /**
  * @brief frees resources allocated for the parser.
 */
@@ -39,6 +39,14 @@ int unlock_for_reading(rw_lock_t* lock);
 */
 int lock_for_writing(rw_lock_t* lock);
 
+/**
+ * @brief lock for writing without waiting.
+ * @returns 0 on success, 1 if the lock is held by a reader or a writer, -1 on failure.
+ * @param lock must be != NULL.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+int try_lock_for_writing(rw_lock_t* lock);
+
 /**
  * @brief unlock for writing.
  * @returns 0 on success, -1 on failure.
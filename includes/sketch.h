@@ -0,0 +1,47 @@
+/**
+ * @brief header file for the count-min sketch used for estimating how often files are requested.
+ *
+*/
+
+#ifndef _SKETCH_H_
+#define _SKETCH_H_
+
+#include <stdlib.h>
+
+typedef struct _sketch sketch_t;
+
+/**
+ * @brief creates a new count-min sketch with all counters set to 0.
+ * @returns a sketch on success, NULL on failure.
+ * @param width number of counters per row, must be != 0 (rounded up to a power of 2).
+ * @param sample number of increments after which all counters are halved, must be != 0.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM if malloc fails.
+*/
+sketch_t* sketch_create(size_t width, size_t sample);
+
+/**
+ * @brief counts one more occurrence of a key, halving all counters once
+ * the number of increments reaches the sample size.
+ * @returns 0 on success, -1 on failure.
+ * @param sketch must be != NULL.
+ * @param key must be != NULL.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+int sketch_increment(sketch_t* sketch, const char* key);
+
+/**
+ * @brief estimates the number of occurrences of a key since its counters were last halved.
+ * @returns the estimate on success, 0 on failure.
+ * @param sketch must be != NULL.
+ * @param key must be != NULL.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+unsigned int sketch_estimate(const sketch_t* sketch, const char* key);
+
+/**
+ * @brief frees resources allocated for the sketch.
+ * @param sketch
+*/
+void sketch_free(sketch_t* sketch);
+
+#endif
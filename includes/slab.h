@@ -0,0 +1,48 @@
+/**
+ * @brief header file for the slab allocator used for file contents, metadata and list nodes.
+ *
+*/
+
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * @brief allocates memory from the size class fitting size, sizes larger than every class
+ * are allocated with malloc.
+ * @returns a pointer to the memory on success, NULL on failure.
+ * @exception errno is set to ENOMEM if there is no memory left.
+ * @note the memory must be released with slab_free.
+*/
+void* slab_alloc(size_t size);
+
+/**
+ * @brief resizes memory allocated with slab_alloc, moving it to the size class fitting size.
+ * @returns a pointer to the memory on success, NULL on failure (ptr is left untouched).
+ * @param ptr if NULL, behaves as slab_alloc.
+ * @exception errno is set to ENOMEM if there is no memory left.
+*/
+void* slab_realloc(void* ptr, size_t size);
+
+/**
+ * @brief releases memory allocated with slab_alloc, the memory is kept for
+ * later allocations of the same size class.
+*/
+void slab_free(void* ptr);
+
+/**
+ * @brief gets the bytes added by slab_alloc to every object, for sizing objects
+ * that fill a given amount of memory.
+*/
+size_t slab_overhead(void);
+
+/**
+ * @brief prints, for every size class in use, the memory reserved, the memory in use
+ * and the bytes wasted by rounding sizes up to the size class.
+ * @param stream must be != NULL.
+*/
+void slab_print(FILE* stream);
+
+#endif
@@ -0,0 +1,96 @@
+/**
+ * @brief header file for the snapshots of the files stored inside the cache, saved at shutdown
+ * and loaded back at startup.
+ *
+*/
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <blob.h>
+
+typedef struct _snapshot snapshot_t;
+
+//a file saved inside a snapshot, with the metadata used by the replacement policy
+typedef struct _snapshot_entry{
+   const char* name;
+   //contents of the file as they are stored, NULL for empty files (only for writing)
+   const blob_t* contents;
+   //size of the contents as they are stored (only for reading)
+   size_t size;
+   //size of the contents before compression, 0 if they are not compressed
+   size_t raw_size;
+   time_t last_used;
+   int freq;
+   double priority;
+   //the file is inside the list of the files used again (ARC, 2Q)
+   bool frequent;
+} snapshot_entry_t;
+
+/**
+ * @brief writes a snapshot holding an index of the files followed by their contents. The
+ * snapshot is written to a temporary file renamed to path, so that a failure leaves the
+ * snapshot written before.
+ * @returns 0 on success, -1 on failure.
+ * @param path must be != NULL.
+ * @param entries must be != NULL if num != 0, in the order they are loaded back.
+ * @param log first segment of the write-ahead log holding the changes made after the snapshot,
+ * 0 if there is no log.
+ * @exception errno is set to EINVAL for invalid params, as fopen, fwrite, fsync and rename
+ * for failures of the file.
+*/
+int snapshot_write(const char* path, const snapshot_entry_t* entries, size_t num, unsigned long log);
+
+/**
+ * @brief maps a snapshot in memory and checks its index. The contents are read from the
+ * file only when they are first accessed.
+ * @returns the snapshot on success, NULL on failure.
+ * @param path must be != NULL.
+ * @exception errno is set to EINVAL for invalid params and for corrupted snapshots, to ENOMEM
+ * if malloc fails, as open and mmap for failures of the file.
+*/
+snapshot_t* snapshot_open(const char* path);
+
+/**
+ * @brief gets the number of files inside a snapshot.
+*/
+size_t snapshot_get_files(const snapshot_t* snapshot);
+
+/**
+ * @brief gets the first segment of the write-ahead log replayed after the snapshot is loaded,
+ * 0 if it was written without a log.
+*/
+unsigned long snapshot_get_log(const snapshot_t* snapshot);
+
+/**
+ * @brief gets the name, size and metadata of a file inside a snapshot. The name stays valid
+ * until the snapshot is closed.
+ * @returns 0 on success, -1 on failure.
+ * @param snapshot must be != NULL.
+ * @param i must be < the number of files.
+ * @param entry must be != NULL.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+int snapshot_get_entry(const snapshot_t* snapshot, size_t i, snapshot_entry_t* entry);
+
+/**
+ * @brief creates a blob over the contents of a file inside a snapshot, without copying them.
+ * The snapshot stays mapped as long as the blob is held, even after it is closed.
+ * @returns 0 on success, -1 on failure.
+ * @param snapshot must be != NULL.
+ * @param i must be < the number of files.
+ * @param contents must be != NULL, set to NULL for empty files.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM if malloc fails.
+*/
+int snapshot_get_contents(snapshot_t* snapshot, size_t i, blob_t** contents);
+
+/**
+ * @brief closes a snapshot, it is unmapped once the blobs over its contents are released.
+*/
+void snapshot_close(snapshot_t* snapshot);
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * @brief header file for the second tier of the cache, holding the evicted files on local storage.
+ *
+*/
+
+#ifndef _SPILL_H_
+#define _SPILL_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <blob.h>
+
+typedef struct _spill spill_t;
+
+/**
+ * @brief creates an empty spill tier, whose files are appended to memory mapped segment
+ * files created inside a directory.
+ * @returns a spill tier on success, NULL on failure.
+ * @param dir must be != NULL, the directory must exist.
+ * @param size_max must be != 0, max size of the segment files.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM if malloc fails.
+*/
+spill_t* spill_create(const char* dir, size_t size_max);
+
+/**
+ * @brief copies the contents of a file to the spill tier, replacing the copy spilled before.
+ * When the tier is full, the oldest segment is dropped with all the files inside it.
+ * @returns 0 on success, 1 if the contents are larger than the tier, -1 on failure.
+ * @param spill must be != NULL.
+ * @param name must be != NULL.
+ * @param contents NULL for empty files.
+ * @param raw_size size of the contents before compression, 0 if they are not compressed.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM if malloc fails, as
+ * open, ftruncate and mmap for failures of the segment files.
+*/
+int spill_put(spill_t* spill, const char* name, const blob_t* contents, size_t raw_size);
+
+/**
+ * @brief takes a file out of the spill tier, counting a hit if it is there and a miss otherwise.
+ * @returns 0 on success, 1 if the file is not inside the tier, -1 on failure.
+ * @param spill must be != NULL.
+ * @param name must be != NULL.
+ * @param contents set to a new blob holding a copy of the contents, NULL for empty files.
+ * @param raw_size set to the size of the contents before compression, 0 if not compressed.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM if malloc fails.
+*/
+int spill_take(spill_t* spill, const char* name, blob_t** contents, size_t* raw_size);
+
+/**
+ * @brief removes the copy of a file from the spill tier, if there is one.
+ * @returns 0 on success, -1 on failure.
+ * @param spill must be != NULL.
+ * @param name must be != NULL.
+ * @exception errno is set to EINVAL for invalid params.
+*/
+int spill_drop(spill_t* spill, const char* name);
+
+/**
+ * @brief prints the files spilled, the hits and misses of the tier and the size of its segments.
+*/
+void spill_print(spill_t* spill, FILE* out);
+
+/**
+ * @brief frees resources allocated for the spill tier, removing its segment files.
+*/
+void spill_free(spill_t* spill);
+
+#endif
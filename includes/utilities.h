@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <error_handlers.h>
 #include <defines.h>
@@ -61,6 +62,35 @@ static inline int writen(long fd, void* ptr, size_t n){
    return(n - nleft); /* return >= 0 */
 }
 
+/**
+ * @brief writes all the buffers in iov to file descriptor with as few calls as possible.
+ * @returns the number of bytes written, -1 on failure.
+ * @note iov is used as scratch space and is modified.
+ */
+static inline ssize_t writevn(long fd, struct iovec* iov, int iovcnt){
+   ssize_t nwritten;
+   ssize_t total = 0;
+
+   while (iovcnt > 0) {
+      if((nwritten = writev(fd, iov, iovcnt)) < 0) {
+         if (total == 0) return -1; /* error, return -1 */
+         else break; /* error, return amount written so far */
+      } else if (nwritten == 0) break;
+      total += nwritten;
+      /* skip the buffers written fully, then the part written of the next one */
+      while (iovcnt > 0 && (size_t) nwritten >= iov->iov_len) {
+         nwritten -= iov->iov_len;
+         iov++;
+         iovcnt--;
+      }
+      if (iovcnt > 0) {
+         iov->iov_base = (char*) iov->iov_base + nwritten;
+         iov->iov_len -= nwritten;
+      }
+   }
+   return total; /* return >= 0 */
+}
+
 
 /**
  * @brief mimics the mkdir -p command in C.
@@ -0,0 +1,93 @@
+/**
+ * @brief header file for the write-ahead log recording the changes to the files of the cache.
+ *
+*/
+
+#ifndef _WAL_H_
+#define _WAL_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WAL_WRITE 1 // the file has been written with the data, replacing its contents
+#define WAL_APPEND 2 // the data has been appended to the file
+#define WAL_REMOVE 3 // the file has been removed or evicted
+
+typedef struct _wal wal_t;
+
+/**
+ * @brief opens a write-ahead log, made of segment files named after path followed by their
+ * number. The records logged go to a new segment, those found are left to be replayed. A
+ * thread commits the records logged in batches, with one fsync for each batch.
+ * @returns the log on success, NULL on failure.
+ * @param path must be != NULL, its directory must exist.
+ * @param delay microseconds a batch waits for more records after its first one, 0 if every
+ * batch is committed as soon as the commit before it has finished.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM if malloc fails, as opendir,
+ * open and pthread_create on failure.
+*/
+wal_t* wal_open(const char* path, unsigned long delay);
+
+/**
+ * @brief replays the records of the segments found when the log was opened, in order. A record
+ * torn by a crash ends the replay of its segment.
+ * @returns 0 on success, -1 on failure.
+ * @param wal must be != NULL.
+ * @param first number of the first segment replayed, the ones before are skipped.
+ * @param apply must be != NULL, called with arg for each record: it returns 0 on success, -1 on
+ * failure, which stops the replay.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM if malloc fails, as open and
+ * read on failure.
+*/
+int wal_replay(wal_t* wal, unsigned long first,
+               int (*apply)(void* arg, int type, const char* name, const void* data, size_t size), void* arg);
+
+/**
+ * @brief adds a record to the batch being committed next, without waiting for it.
+ * @returns 0 on success, -1 on failure.
+ * @param wal must be != NULL.
+ * @param type WAL_WRITE, WAL_APPEND or WAL_REMOVE.
+ * @param name must be != NULL.
+ * @param data must be != NULL if size != 0.
+ * @exception errno is set to EINVAL for invalid params, to ENOMEM if malloc fails.
+*/
+int wal_log(wal_t* wal, int type, const char* name, const void* data, size_t size);
+
+/**
+ * @brief waits until the records logged before the call are on disk.
+ * @returns 0 on success, -1 if a commit has failed.
+ * @param wal must be != NULL.
+ * @exception errno is set to EINVAL for invalid params, as write and fdatasync if a commit has failed.
+*/
+int wal_sync(wal_t* wal);
+
+/**
+ * @brief starts a new segment for the records logged after the call, without waiting for the
+ * ones logged before, which the committing thread commits to the current segment. Only the
+ * rotation before, if the thread has not committed it yet, is waited for.
+ * @returns the number of the new segment on success, 0 on failure.
+ * @param wal must be != NULL.
+ * @exception errno is set to EINVAL for invalid params, as open on failure.
+*/
+unsigned long wal_rotate(wal_t* wal);
+
+/**
+ * @brief removes the segments before the given one, whose records are no longer needed.
+ * @returns 0 on success, -1 on failure.
+ * @param wal must be != NULL.
+ * @exception errno is set to EINVAL for invalid params, as opendir and unlink on failure.
+*/
+int wal_compact(wal_t* wal, unsigned long first);
+
+/**
+ * @brief prints the records logged and replayed, the batches committed and the time spent
+ * committing them and waiting for them.
+*/
+void wal_print(wal_t* wal, FILE* out);
+
+/**
+ * @brief commits the records left and frees resources allocated for the log.
+*/
+void wal_close(wal_t* wal);
+
+#endif
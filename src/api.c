@@ -607,11 +607,15 @@ int writeFile(const char* pathname, const char* dirname){
       }
    }
 	char errno_str[ERRNO_LEN_MAX];
-	bool failure = false, fatal = false;
+	bool failure = false, fatal = false, rejected = false;
 	// handling server response
 	switch (feedback){
 		case OP_SUCCESS:
 			break;
+		case OP_REJECTED:
+         // the admission filter did not let the file in, no errno follows
+			rejected = true;
+			break;
 		case OP_FAILURE:
          // read operations may return less than we asked for, therefore
          // we must check that the data has been read fully
@@ -753,6 +757,13 @@ int writeFile(const char* pathname, const char* dirname){
 	if (failure) goto failure;
 	if (fatal) goto fatal;
 
+	if (rejected){
+      // the file was removed from the server instead of being written
+		PRINT_IF(verbose_mode, "%s-> %s %s.\n", REJECTED, WRITE_FILE, pathname);
+		errno = ECANCELED;
+		return -1;
+	}
+
 	if (dirname){
 		PRINT_IF(verbose_mode, "%s-> %s %s %s.\n",SUCCESS, WRITE_FILE, pathname, dirname);
       return 0;
@@ -1022,74 +1033,77 @@ failure:
 }
 
 int lockFile(const char* pathname){
+   //the client waits until the lock is handed over to it
+   return lockFileTimed(pathname, 0);
+}
+
+int lockFileTimed(const char* pathname, long msec){
 	int err;
 	char err_str[REQ_LEN_MAX];
 	if (!pathname || strlen(pathname) > PATH_LEN_MAX){
 		err = EINVAL;
-      fail_with(LOCK_FILE,default_flags,default_N,pathname,err_str,err);
+      return fail_with(LOCK_FILE,default_flags,default_N,pathname,err_str,err);
 	}
    strcpy(file_path,pathname);
 	if (fd_socket == -1){
 		err = ENOTCONN;
-      fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
+      return fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
 	}
 
-   //sending lock file request to server in a buffer
+   //sending lock file request to server in a buffer, the server replies only once
+   //the lock is owned by the client or the wait has failed
 	char buffer[REQ_LEN_MAX];
-	while (1){
-		memset(buffer, 0, REQ_LEN_MAX);
-		snprintf(buffer, REQ_LEN_MAX, "%d %s", LOCK, pathname);
+	memset(buffer, 0, REQ_LEN_MAX);
+	snprintf(buffer, REQ_LEN_MAX, "%d %s %ld", LOCK, pathname, msec);
 
-      // a write operation can return less than we specified, so we use
-      // writen to write the remainder of the data.
-		if (writen((long) fd_socket, (void*) buffer, REQ_LEN_MAX) == -1){
-			err = errno;
-         fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
-		}
-		// reading the server response
-		char feedback_str[OP_LEN_MAX];
-		memset(feedback_str, 0, OP_LEN_MAX);
-      // read operations may return less than we asked for, therefore
-      // we must check that the data has been read fully
-		if (readn((long) fd_socket, (void*) feedback_str, OP_LEN_MAX) == -1){
-			err = errno;
-         fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
-		}
-		int feedback;
-		if (sscanf(feedback_str, "%d", &feedback) != 1){
-			err = EBADMSG;
-         fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
-		}
-		char errno_str[ERRNO_LEN_MAX];
-		// handling the server response
-		switch (feedback){
-			case OP_SUCCESS:
-            return succeed_with(LOCK_FILE,default_flags,default_N,file_path);
-         case OP_FAILURE:
-				if (readn((long) fd_socket, (void*) errno_str, ERRNO_LEN_MAX) == -1){
-					err = errno;
-               fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
-				}
-				if (sscanf(errno_str, "%d", &err) != 1){
-					err = EBADMSG;
-               fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
-				}
-				if (err != EPERM){
-               fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
-            }
-         case OP_EXIT_FATAL:
-				if (readn((long) fd_socket, (void*) errno_str, ERRNO_LEN_MAX) == -1){
-					err = errno;
-               fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
-				}
-				if (sscanf(errno_str, "%d", &err) != 1){
-					err = EBADMSG;
-               fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
-				}
-            abort_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
-         default:
-            break;
-		}
+   // a write operation can return less than we specified, so we use
+   // writen to write the remainder of the data.
+	if (writen((long) fd_socket, (void*) buffer, REQ_LEN_MAX) == -1){
+		err = errno;
+      return fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
+	}
+	// reading the server response
+	char feedback_str[OP_LEN_MAX];
+	memset(feedback_str, 0, OP_LEN_MAX);
+   // read operations may return less than we asked for, therefore
+   // we must check that the data has been read fully
+	if (readn((long) fd_socket, (void*) feedback_str, OP_LEN_MAX) == -1){
+		err = errno;
+      return fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
+	}
+	int feedback;
+	if (sscanf(feedback_str, "%d", &feedback) != 1){
+		err = EBADMSG;
+      return fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
+	}
+	char errno_str[ERRNO_LEN_MAX];
+	// handling the server response
+	switch (feedback){
+		case OP_SUCCESS:
+         return succeed_with(LOCK_FILE,default_flags,default_N,file_path);
+      case OP_FAILURE:
+			if (readn((long) fd_socket, (void*) errno_str, ERRNO_LEN_MAX) == -1){
+				err = errno;
+            return fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
+			}
+			if (sscanf(errno_str, "%d", &err) != 1){
+				err = EBADMSG;
+            return fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
+			}
+         return fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
+      case OP_EXIT_FATAL:
+			if (readn((long) fd_socket, (void*) errno_str, ERRNO_LEN_MAX) == -1){
+				err = errno;
+            return fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
+			}
+			if (sscanf(errno_str, "%d", &err) != 1){
+				err = EBADMSG;
+            return fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
+			}
+         abort_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
+      default:
+         err = EBADMSG;
+         return fail_with(LOCK_FILE,default_flags,default_N,file_path,err_str,err);
 	}
 }
 
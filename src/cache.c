@@ -2,64 +2,306 @@
  * @brief implementation of the file storage cache
  *
 */
-
+#define _POSIX_C_SOURCE 200112L
+#include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <pthread.h>
 
 #include <hash_table.h>
+#include <intern.h>
+#include <epoch.h>
 #include <linked_list.h>
 #include <defines.h>
 #include <cache.h>
 #include <rw_lock.h>
+#include <sketch.h>
+#include <blob.h>
+#include <slab.h>
+#include <lz.h>
+#include <spill.h>
+#include <snapshot.h>
+#include <wal.h>
 #include <error_handlers.h>
 
 
+#define ORDER_LINK 0 // links of the list keeping the insertion order of files
+#define POLICY_LINK 1 // links of the list used by the replacement policy
+#define SKETCH_WIDTH 4 // counters per row of the admission sketch, for each file the cache can hold
+#define SKETCH_SAMPLE 10 // requests between agings of the admission sketch, for each file the cache can hold
+#define COMPRESS_PERIOD 1 // seconds between two visits of the compressor to the shards
+#define COMPRESS_BATCH 16 // cold files compressed for each shard visited, without holding its lock
+#define COMPRESS_MIN 1024 // smallest contents worth compressing
+#define BODY_KEY_LEN 40 // hash and size of the contents shared by files, as a string
+#define SMAPS_PATH "/proc/self/smaps_rollup" // memory usage of a process, by kind of page
+#define REPLAY_CLIENT -1 // client the changes recorded by the write-ahead log are replayed as
+#define EVICT_PERIOD 1 // seconds between two checks of the evictor when no write wakes it up
+#define EVICT_BATCH 8 // files evicted from a shard each time the evictor holds its lock
+#define LATENCY_BUCKETS 128 // buckets of the histogram of the write latency, four for each power of 2 microseconds
+#define RECLAIM_MIN 131072 // smallest contents freed by the reclaimer, malloc unmaps the larger ones when freed
+#define OPENERS_INLINE 4 // openers held inside a file, more openers are moved to an array of their own
+#define HEAP_MIN 16 // smallest number of files the priority heap of a shard has room for
+#define INDEX_MIN 16 // smallest number of buckets of the index of a shard
+#define INDEX_SHRINK 4 // the index doubles once it holds more files than buckets, halves once fewer than 1 / INDEX_SHRINK of them
+#define FIBONACCI 11400714819323198485ull // 2^64 divided by the golden ratio, spreads the hashes over the buckets
+#define WATERMARK(size, pct) ((size) / 100 * (pct) + (size) % 100 * (pct) / 100) // pct percent of size
+
+struct _cache_file;
+
+//links of a file inside an intrusive doubly linked list
+typedef struct _file_link{
+   struct _cache_file* prev;
+   struct _cache_file* next;
+} file_link_t;
+
+//intrusive doubly linked list of files, first is the most recent insertion
+typedef struct _file_list{
+   struct _cache_file* first;
+   struct _cache_file* last;
+   size_t len;
+   //total size of the contents of the files in the list
+   size_t bytes;
+} file_list_t;
+
+//bucket holding all the files used the same number of times (LFU)
+typedef struct _freq_bucket{
+   int freq;
+   file_list_t files;
+   struct _freq_bucket* prev;
+   struct _freq_bucket* next;
+} freq_bucket_t;
+
+struct _ghost_list;
+
+//name and size of a file evicted by ARC or 2Q, kept to detect its comeback
+typedef struct _ghost{
+   //interned, a file coming back under the same name is found by its address
+   const char* name;
+   size_t size;
+   struct _ghost_list* list;
+   struct _ghost* prev;
+   struct _ghost* next;
+} ghost_t;
+
+//doubly linked list of ghosts, first is the most recent eviction
+typedef struct _ghost_list{
+   ghost_t* first;
+   ghost_t* last;
+   size_t len;
+   size_t bytes;
+} ghost_list_t;
+
+//contents shared by the files written with identical bodies, charged to the cache once
+typedef struct _body{
+   char key[BODY_KEY_LEN];
+   blob_t* contents;
+   size_t size;
+   //files holding the contents
+   size_t files;
+} body_t;
+
+//value of the files put in the lists returned to the workers: the contents are listed as they
+//are stored and decompressed once the locks are released, the workers only read the reference
+typedef struct _listed{
+   blob_t* contents;
+   //size of the contents before compression, 0 once decompressed, and shard they are counted to
+   size_t raw_size;
+   struct _shard* shard;
+} listed_t;
+
+//clients holding a file open by their file descriptor, in increasing order
+typedef struct _opener_set{
+   size_t len;
+   //capacity of the array, OPENERS_INLINE while the openers are held inside the set
+   size_t max;
+   union{
+      int local[OPENERS_INLINE];
+      int* array;
+   } ids;
+} opener_set_t;
+
+//files opened by a connected client, released for it if it leaves without closing them
+typedef struct _session{
+   //interned names of the files
+   const char** names;
+   size_t len;
+   size_t max;
+} session_t;
+
+//client waiting for the lock over a file, kept as the reply to be sent to it once the wait is over
+typedef struct _lock_waiter{
+   int client;
+   //milliseconds of the monotonic clock the wait fails at, 0 if the client waits until it gets the lock
+   uint64_t deadline;
+   //outcome of the wait and errno for failed waits
+   int result;
+   int error;
+   //file waited for, NULL once the wait is over
+   struct _cache_file* file;
+   //neighbours inside the queue of the file, or inside the replies once the wait is over
+   struct _lock_waiter* prev;
+   struct _lock_waiter* next;
+   //neighbours among all the clients waiting
+   struct _lock_waiter* all_prev;
+   struct _lock_waiter* all_next;
+} lock_waiter_t;
+
 // structure implementing a file to be used by the cache
 typedef struct _cache_file{
-   char* name;
-   void* contents;
+   //interned name, the key of the file inside the table of its shard
+   const char* name;
+   //immutable contents, replaced as a whole by writers so that readers
+   //holding a reference keep a consistent copy
+   blob_t* contents;
+   //size charged to the cache, the size of the compressed contents for compressed files
    size_t contents_size;
+   //size of the contents before compression, 0 if they are not compressed
+   size_t raw_size;
+   //the contents did not shrink when compressed, they are not tried again until written
+   bool incompressible;
+   //contents shared with the files written with the same body, NULL if the file is charged
+   //for its own contents
+   body_t* body;
+   //the shared contents were charged to the file that wrote them first, the size of the
+   //shard does not count them for this file
+   bool joined;
    //the lock to be used on single files
    rw_lock_t* lock;
    //the file descriptor of the owner of the lock over the file
    int locker;
    //the file descriptor of the owner of writing permissions
    int writer;
-   //list of file descriptors of the openers of the file
-   linked_list_t* openers;
+   //file descriptors of the openers of the file
+   opener_set_t openers;
+   //clients waiting for the lock over the file in order of arrival, protected by the mutex of
+   //the waiters of the cache
+   lock_waiter_t* waiters_first;
+   lock_waiter_t* waiters_last;
 
    //to be used for implementing the replacement policy
    time_t last_recen;
    int least_freq;
+   //links to the insertion order list and to the policy list
+   file_link_t links[2];
+   //policy list the file belongs to
+   file_list_t* queue;
+   //frequency bucket the file belongs to (LFU)
+   freq_bucket_t* bucket;
+   //priority of the file and its position inside the priority heap (GDSF)
+   double priority;
+   size_t heap_pos;
+
+   //next file of the same bucket inside the index of its shard, with a link for each of the
+   //last two generations of the index
+   struct _cache_file* index_next[2];
+   //set under the lock over the file when it leaves the cache, for the readers
+   //that found it through the index before it was unlinked
+   bool removed;
+   //links the file to the files waiting for the readers that may hold them
+   epoch_entry_t retired;
 } cache_file_t;
 
-//structure implementing usage information useful
-//for the replacement policy
-typedef struct usage{
-   char* name;
-   time_t last_recen;
-   int least_freq;
-} usage_t;
+//buckets chaining the files of a shard by the hash of their names, replaced as a whole when resized
+typedef struct _file_index{
+   unsigned int bits;
+   //links of the files followed inside the index, the index replaced follows the other ones
+   int gen;
+   //cleared once the index is freed, its generation of links can then be rebuilt
+   bool* retiring;
+   //links the index to the objects waiting for the readers that may walk it
+   epoch_entry_t retired;
+   cache_file_t* buckets[];
+} file_index_t;
 
-//structure implementing the file storage cache
-struct _cache{
-   //table of files stored in the cache
+//partition of the file storage cache, holding the files whose name hashes to it
+typedef struct _shard{
+   //table of files stored in the shard, keyed by their interned names
    hash_table_t* files;
-   //list of names of files stored inside the cache
-   linked_list_t* names;
+   //the same files chained by the hash of their names, looked up without locking the shard:
+   //chains are changed and the index is replaced under the lock held for writing, while the
+   //files and the indexes replaced are freed through epochs
+   file_index_t* index;
+   size_t index_files;
+   //true until the index replaced last is freed
+   bool index_retiring;
+   //pool of the names of the cache
+   intern_pool_t* paths;
+   //files stored inside the shard in order of insertion (FIFO queue)
+   file_list_t order;
+   //files in order of recency of use (LRU)
+   file_list_t recency;
+   //frequency buckets in increasing order of frequency (LFU)
+   freq_bucket_t* buckets;
+   //files used once and files used again (T1 and T2 for ARC, A1in and Am for 2Q)
+   file_list_t recent;
+   file_list_t frequent;
+   //ghosts of the files evicted from recent and frequent (B1 and B2 for ARC,
+   //A1out for 2Q) and a table for looking them up by name
+   ghost_list_t recent_ghosts;
+   ghost_list_t frequent_ghosts;
+   hash_table_t* ghosts;
+   //target size of the recent list, adapted on ghost hits (ARC)
+   size_t target;
+   //files in increasing order of priority and priority of the last victim (GDSF)
+   cache_file_t** heap;
+   size_t heap_len;
+   size_t heap_max;
+   double inflation;
+   //estimates how often files are requested, NULL if every write is admitted
+   sketch_t* sketch;
    //replacement policy
    policy_t pol;
-   //the lock to be used on the whole structure
+   //the lock to be used on the whole shard
    rw_lock_t* lock;
+   //protects the policy structures when files are used concurrently
+   pthread_mutex_t pol_mutex;
+
+   //number of evictions and rejections
+   size_t evictions;
+   size_t rejections;
+   //requests finding the file inside the shard or not, and their bytes
+   size_t hits;
+   size_t misses;
+   size_t hit_bytes;
+   size_t miss_bytes;
+   //writes sharing the contents of a file written before
+   size_t dedup_writes;
+   //files compressed with their size before and after compression
+   size_t compressions;
+   size_t compressed_raw;
+   size_t compressed_bytes;
+   //contents decompressed and time spent decompressing them, in seconds
+   size_t decompressions;
+   double decompress_time;
+   //current file number and size inside the shard
+   size_t files_num;
+   size_t cache_size;
+   //share of the capacity of the cache given to the shard, it can be
+   //exceeded as long as the capacity of the whole cache is not
+   size_t files_max;
+   size_t size_max;
+} shard_t;
+
+//structure implementing the file storage cache
+struct _cache{
+   //shards of the cache
+   shard_t* shards;
+   size_t shard_num;
+   //names of the files, ghosts and sessions, each stored once with its hash
+   intern_pool_t* paths;
+   //protects the global budget, shared by all the shards
+   pthread_mutex_t budget_mutex;
 
-   // files number and size and number of evictions reached by the cache
+   // files number and size reached by the cache
    size_t files_reached;
    size_t size_reached;
-   size_t evictions;
    //current file number and size inside the cache
    size_t files_num;
    size_t cache_size;
@@ -67,367 +309,3034 @@ struct _cache{
    size_t files_max;
    size_t size_max;
 
+   //seconds a file must stay unused before being compressed, 0 if files are never compressed
+   time_t cold_age;
+   //thread compressing cold files and condition waking it up for termination
+   pthread_t compressor;
+   bool compressor_set;
+   bool compressor_stop;
+   pthread_mutex_t compressor_mutex;
+   pthread_cond_t compressor_cond;
+
+   //contents written to files by their hash and size, NULL if contents are not deduplicated
+   hash_table_t* bodies;
+   pthread_mutex_t bodies_mutex;
+   //bytes not charged for the files sharing the contents of another file
+   size_t dedup_bytes;
+
+   //second tier holding the evicted files on local storage, NULL if evicted files are lost
+   spill_t* spill;
+
+   //write-ahead log recording the changes to the files, NULL if there is none, and the first
+   //of its segments holding changes made after the snapshot loaded
+   wal_t* wal;
+   unsigned long log_first;
+
+   //child process writing a checkpoint, 0 if none, and the pipe its results are read from
+   pid_t checkpoint_pid;
+   int checkpoint_fd;
+   //checkpoints written and failed, time the server was stopped for forking, time spent
+   //writing them and pages copied on write while they were written
+   size_t checkpoints;
+   size_t checkpoint_failures;
+   double checkpoint_pause;
+   double checkpoint_time;
+   double checkpoint_time_max;
+   size_t checkpoint_pages;
+   size_t checkpoint_pages_max;
+   //first segment of the log after the checkpoint being written, 0 if the log is not compacted
+   unsigned long checkpoint_log;
+
+   //percentages of the max size the evictor stops and starts evicting at, 0 if there is no evictor
+   unsigned int evict_low;
+   unsigned int evict_high;
+   //thread evicting files in the background, woken up by the writes above the high watermark
+   pthread_t evictor;
+   bool evictor_set;
+   bool evictor_stop;
+   bool evictor_pending;
+   pthread_mutex_t evictor_mutex;
+   pthread_cond_t evictor_cond;
+   //runs of the evictor, files evicted by it and time spent evicting them
+   size_t evictor_runs;
+   size_t evictor_files;
+   double evictor_time;
+
+   //writes and appends done by the time they took, updated atomically
+   size_t write_latency[LATENCY_BUCKETS];
+
+   //sessions of the connected clients by file descriptor, NULL for the clients without one
+   session_t** sessions;
+   size_t sessions_max;
+   pthread_mutex_t sessions_mutex;
+   //clients gone and files released for them
+   size_t sessions_closed;
+   size_t sessions_released;
+
+   //clients waiting for the locks over the files and replies to the clients whose wait is over,
+   //in the order they are to be sent
+   lock_waiter_t* waiters;
+   lock_waiter_t* replies_first;
+   lock_waiter_t* replies_last;
+   pthread_mutex_t waiters_mutex;
+   //waits started, locks handed over to a waiter, waits timed out and waits failed by the
+   //removal of the file
+   size_t lock_waits;
+   size_t lock_handoffs;
+   size_t lock_timeouts;
+   size_t lock_failures;
+
+   //thread freeing the large contents left by the files after the shard locks are released,
+   //the contents waiting for it and the condition waking it up
+   pthread_t reclaimer;
+   bool reclaimer_set;
+   bool reclaimer_stop;
+   pthread_mutex_t reclaimer_mutex;
+   pthread_cond_t reclaimer_cond;
+   blob_t** reclaim_queue;
+   size_t reclaim_len;
+   size_t reclaim_max;
+   //bytes waiting to be freed and the most reached, contents freed and their bytes
+   size_t reclaim_pending;
+   size_t reclaim_pending_max;
+   size_t reclaimed;
+   size_t reclaimed_bytes;
 };
 
-// compare function used in lru for sorting
-int cmp_lru(const void* a, const void* b){
-   usage_t a1 = *(usage_t*) a;
-   usage_t b1 = *(usage_t*) b;
-   return difftime(a1.last_recen, b1.last_recen);
+//outcome of a checkpoint, sent by the child process writing it
+typedef struct _checkpoint_result{
+   int err;
+   double time;
+   size_t pages;
+} checkpoint_result_t;
+
+/**
+ * @brief pushes a file to the front of an intrusive list.
+ * @param link ORDER_LINK or POLICY_LINK.
+*/
+static void flist_push_front(file_list_t* list, cache_file_t* file, int link){
+   file->links[link].prev = NULL;
+   file->links[link].next = list->first;
+   if (list->first) list->first->links[link].prev = file;
+   else list->last = file;
+   list->first = file;
+   list->len++;
+   list->bytes += file->contents_size;
+   if (link == POLICY_LINK) file->queue = list;
+}
+
+/**
+ * @brief unlinks a file from an intrusive list.
+ * @param link ORDER_LINK or POLICY_LINK.
+*/
+static void flist_remove(file_list_t* list, cache_file_t* file, int link){
+   cache_file_t* prev = file->links[link].prev;
+   cache_file_t* next = file->links[link].next;
+   if (prev) prev->links[link].next = next;
+   else list->first = next;
+   if (next) next->links[link].prev = prev;
+   else list->last = prev;
+   file->links[link].prev = NULL;
+   file->links[link].next = NULL;
+   list->len--;
+   list->bytes -= file->contents_size;
+   if (link == POLICY_LINK) file->queue = NULL;
+}
+
+/**
+ * @brief creates an empty frequency bucket and links it after prev (or as the first bucket).
+ * @returns the new bucket on success, NULL on failure.
+ * @exception errno is set to ENOMEM for malloc failure.
+*/
+static freq_bucket_t* bucket_create(shard_t* shard, freq_bucket_t* prev, int freq){
+   freq_bucket_t* new = slab_alloc(sizeof(freq_bucket_t));
+   if (!new){
+      errno = ENOMEM;
+      return NULL;
+   }
+   new->freq = freq;
+   memset(&new->files, 0, sizeof(file_list_t));
+   new->prev = prev;
+   new->next = prev ? prev->next : shard->buckets;
+   if (new->next) new->next->prev = new;
+   if (prev) prev->next = new;
+   else shard->buckets = new;
+   return new;
+}
+
+/**
+ * @brief unlinks and frees a frequency bucket if it holds no files.
+*/
+static void bucket_release(shard_t* shard, freq_bucket_t* bucket){
+   if (bucket->files.len != 0) return;
+   if (bucket->prev) bucket->prev->next = bucket->next;
+   else shard->buckets = bucket->next;
+   if (bucket->next) bucket->next->prev = bucket->prev;
+   slab_free(bucket);
+}
+
+/**
+ * @brief frees resources allocated for a ghost.
+ * @param data to be converted to a ghost.
+*/
+static void ghost_free(void* data){
+   if (!data) return;
+   ghost_t* ghost = (ghost_t*) data;
+   intern_put(ghost->name);
+   free(ghost);
+}
+
+/**
+ * @brief remembers the name and size of an evicted file in a ghost list.
+ * @returns 0 on success, -1 on failure.
+ * @exception errno is set to ENOMEM for malloc failure.
+*/
+static int ghost_insert(shard_t* shard, ghost_list_t* list, const cache_file_t* file){
+   int err;
+   ghost_t* ghost;
+
+   //the ghost is built where the table stores it, the list links it there. It shares the
+   //name of the file, which is the key of the ghost inside the table
+   err = table_emplace_borrowed(shard->ghosts, file->name, intern_hash(file->name), sizeof(ghost_t), (void**) &ghost);
+   if (err != 1) return err;
+   ghost->name = intern_ref(file->name);
+   ghost->size = file->contents_size;
+   ghost->list = list;
+   ghost->prev = NULL;
+   ghost->next = list->first;
+   if (list->first) list->first->prev = ghost;
+   else list->last = ghost;
+   list->first = ghost;
+   list->len++;
+   list->bytes += ghost->size;
+   return 0;
+}
+
+/**
+ * @brief unlinks a ghost from its list and frees it.
+ * @returns 0 on success, -1 on failure.
+*/
+static int ghost_remove(shard_t* shard, ghost_t* ghost){
+   ghost_list_t* list = ghost->list;
+   if (ghost->prev) ghost->prev->next = ghost->next;
+   else list->first = ghost->next;
+   if (ghost->next) ghost->next->prev = ghost->prev;
+   else list->last = ghost->prev;
+   list->len--;
+   list->bytes -= ghost->size;
+   return (table_remove_hashed(shard->ghosts, ghost->name, intern_hash(ghost->name)) == -1) ? -1 : 0;
+}
+
+/**
+ * @brief drops the oldest ghosts until the ghost lists fit their bounds.
+ * @returns 0 on success, -1 on failure.
+*/
+static int ghost_trim(shard_t* shard){
+   ghost_list_t* recent = &shard->recent_ghosts;
+   ghost_list_t* frequent = &shard->frequent_ghosts;
+   //ghosts are never more than the files the shard can hold
+   while (recent->len + frequent->len > shard->files_max){
+      if (ghost_remove(shard, recent->len ? recent->last : frequent->last) != 0) return -1;
+   }
+   if (shard->pol == TWO_Q){
+      //A1out remembers up to half the capacity of the shard
+      while (recent->len && recent->bytes > shard->size_max / 2){
+         if (ghost_remove(shard, recent->last) != 0) return -1;
+      }
+      return 0;
+   }
+   //T1 and B1 together never exceed the capacity of the shard,
+   //the four lists together never exceed twice the capacity
+   while (recent->len && shard->recent.bytes + recent->bytes > shard->size_max){
+      if (ghost_remove(shard, recent->last) != 0) return -1;
+   }
+   while (frequent->len && shard->recent.bytes + shard->frequent.bytes +
+                           recent->bytes + frequent->bytes > 2 * shard->size_max){
+      if (ghost_remove(shard, frequent->last) != 0) return -1;
+   }
+   return 0;
+}
+
+/**
+ * @brief adapts the target size of the recent list after a ghost hit (ARC).
+*/
+static void target_adapt(shard_t* shard, const ghost_t* ghost){
+   size_t delta;
+   size_t recent = shard->recent_ghosts.len;
+   size_t frequent = shard->frequent_ghosts.len;
+   if (ghost->list == &shard->recent_ghosts){
+      //a file evicted too early from the recent list, make it larger
+      delta = MAX(frequent / recent, 1) * MAX(ghost->size, 1);
+      shard->target = (shard->size_max - shard->target > delta) ? shard->target + delta : shard->size_max;
+   }else{
+      //a file evicted too early from the frequent list, make the recent list smaller
+      delta = MAX(recent / frequent, 1) * MAX(ghost->size, 1);
+      shard->target = (shard->target > delta) ? shard->target - delta : 0;
+   }
+}
+
+/**
+ * @brief computes the priority of a file, its frequency weighted by its size
+ * and increased by the priority of the last victim (GDSF).
+*/
+static double gdsf_priority(const shard_t* shard, const cache_file_t* file){
+   return shard->inflation + (double) (file->least_freq + 1) / (double) MAX(file->contents_size, 1);
+}
+
+/**
+ * @brief swaps two files inside the priority heap.
+*/
+static void heap_swap(shard_t* shard, size_t i, size_t j){
+   cache_file_t* tmp = shard->heap[i];
+   shard->heap[i] = shard->heap[j];
+   shard->heap[j] = tmp;
+   shard->heap[i]->heap_pos = i;
+   shard->heap[j]->heap_pos = j;
+}
+
+/**
+ * @brief moves the priority heap to an array with room for max files.
+ * @returns 0 on success, -1 on failure.
+ * @param max must be >= the files inside the heap.
+ * @exception errno is set to ENOMEM for malloc failure.
+*/
+static int heap_resize(shard_t* shard, size_t max){
+   cache_file_t** new_heap = realloc(shard->heap, sizeof(cache_file_t*) * max);
+   if (!new_heap){
+      errno = ENOMEM;
+      return -1;
+   }
+   shard->heap = new_heap;
+   shard->heap_max = max;
+   return 0;
+}
+
+/**
+ * @brief restores the order of the priority heap after the priority
+ * of the file in position pos has changed.
+*/
+static void heap_fix(shard_t* shard, size_t pos){
+   size_t child;
+   //move the file up while its parent has a higher priority
+   while (pos > 0 && shard->heap[(pos - 1) / 2]->priority > shard->heap[pos]->priority){
+      heap_swap(shard, pos, (pos - 1) / 2);
+      pos = (pos - 1) / 2;
+   }
+   //move the file down while one of its children has a lower priority
+   while ((child = 2 * pos + 1) < shard->heap_len){
+      if (child + 1 < shard->heap_len && shard->heap[child + 1]->priority < shard->heap[child]->priority)
+         child++;
+      if (shard->heap[pos]->priority <= shard->heap[child]->priority) break;
+      heap_swap(shard, pos, child);
+      pos = child;
+   }
+}
+
+/**
+ * @brief links a newly inserted file to the structures used by the replacement policy.
+ * @returns 0 on success, -1 on failure.
+ * @exception errno is set to ENOMEM for malloc failure.
+*/
+static int policy_insert(shard_t* shard, cache_file_t* file){
+   int err = 0;
+   freq_bucket_t* bucket;
+   ghost_t* ghost;
+   //readers touching the files of the shard do not lock it
+   if (pthread_mutex_lock(&shard->pol_mutex) != 0) return -1;
+   flist_push_front(&shard->order, file, ORDER_LINK);
+   switch (shard->pol){
+      case FIFO:
+         //the insertion order is all FIFO needs
+         break;
+      case LRU:
+         flist_push_front(&shard->recency, file, POLICY_LINK);
+         break;
+      case LFU:
+         //new files go to the bucket of the files never used
+         bucket = shard->buckets;
+         if (!bucket || bucket->freq != file->least_freq){
+            bucket = bucket_create(shard, NULL, file->least_freq);
+            if (!bucket){
+               flist_remove(&shard->order, file, ORDER_LINK);
+               err = -1;
+               break;
+            }
+         }
+         flist_push_front(&bucket->files, file, POLICY_LINK);
+         file->bucket = bucket;
+         break;
+      case ARC:
+      case TWO_Q:
+         ghost = (ghost_t*) table_find_hashed(shard->ghosts, file->name, intern_hash(file->name));
+         if (!ghost){
+            //first time the file is seen
+            flist_push_front(&shard->recent, file, POLICY_LINK);
+            break;
+         }
+         //the file was evicted recently, it comes back as a frequent file
+         if (shard->pol == ARC) target_adapt(shard, ghost);
+         if (ghost_remove(shard, ghost) != 0){
+            err = -1;
+            break;
+         }
+         flist_push_front(&shard->frequent, file, POLICY_LINK);
+         break;
+      case GDSF:
+         //the heap doubles when full, as the shard can borrow files beyond its share
+         if (shard->heap_len == shard->heap_max && heap_resize(shard, shard->heap_max * 2) != 0){
+            flist_remove(&shard->order, file, ORDER_LINK);
+            err = -1;
+            break;
+         }
+         file->priority = gdsf_priority(shard, file);
+         file->heap_pos = shard->heap_len++;
+         shard->heap[file->heap_pos] = file;
+         heap_fix(shard, file->heap_pos);
+         break;
+   }
+   if (pthread_mutex_unlock(&shard->pol_mutex) != 0) return -1;
+   return err;
+}
+
+/**
+ * @brief unlinks a file from the structures used by the replacement policy.
+ * @returns 0 on success, -1 on failure.
+ * @param evicted true if the file is being evicted, false if it is being removed.
+ * @exception errno is set to ENOMEM for malloc failure.
+*/
+static int policy_remove(shard_t* shard, cache_file_t* file, bool evicted){
+   int err = 0;
+   file_list_t* queue;
+   if (pthread_mutex_lock(&shard->pol_mutex) != 0) return -1;
+   queue = file->queue;
+   flist_remove(&shard->order, file, ORDER_LINK);
+   switch (shard->pol){
+      case FIFO:
+         break;
+      case LRU:
+         flist_remove(&shard->recency, file, POLICY_LINK);
+         break;
+      case LFU:
+         flist_remove(&file->bucket->files, file, POLICY_LINK);
+         bucket_release(shard, file->bucket);
+         file->bucket = NULL;
+         break;
+      case ARC:
+      case TWO_Q:
+         flist_remove(queue, file, POLICY_LINK);
+         if (!evicted) break;
+         //remember the victim, 2Q only remembers the files used once
+         if (queue == &shard->recent){
+            err = ghost_insert(shard, &shard->recent_ghosts, file);
+         }else if (shard->pol == ARC){
+            err = ghost_insert(shard, &shard->frequent_ghosts, file);
+         }
+         if (err == 0) err = ghost_trim(shard);
+         break;
+      case GDSF:
+         //the files left age with respect to the victim
+         if (evicted) shard->inflation = file->priority;
+         //replace the file with the last one in the heap
+         shard->heap_len--;
+         if (file->heap_pos != shard->heap_len){
+            shard->heap[file->heap_pos] = shard->heap[shard->heap_len];
+            shard->heap[file->heap_pos]->heap_pos = file->heap_pos;
+            heap_fix(shard, file->heap_pos);
+         }
+         //halved once a quarter full, a failure leaves it larger than needed
+         if (shard->heap_len < shard->heap_max / 4 && shard->heap_max > HEAP_MIN)
+            heap_resize(shard, shard->heap_max / 2);
+         break;
+   }
+   if (pthread_mutex_unlock(&shard->pol_mutex) != 0) return -1;
+   return err;
+}
+
+/**
+ * @brief updates the policy structures after the size of a file has changed.
+ * @param old_size size of the contents of the file before the change.
+*/
+static void policy_resize(shard_t* shard, cache_file_t* file, size_t old_size){
+   pthread_mutex_lock(&shard->pol_mutex);
+   shard->order.bytes = shard->order.bytes - old_size + file->contents_size;
+   if (file->queue) file->queue->bytes = file->queue->bytes - old_size + file->contents_size;
+   if (shard->pol == GDSF){
+      file->priority = gdsf_priority(shard, file);
+      heap_fix(shard, file->heap_pos);
+   }
+   pthread_mutex_unlock(&shard->pol_mutex);
+}
+
+/**
+ * @brief updates the usage information of a file after an access.
+ * @returns 0 on success, -1 on failure.
+ * @param shard must be != NULL, its lock may not be held.
+ * @param file must be != NULL, its lock must be held for writing.
+ * @param opened true if the access opens the file, false if it is part of an
+ * access already counted (reading, locking, closing an opened file).
+ * @exception errno is set to ENOMEM for malloc failure.
+*/
+static int policy_touch(shard_t* shard, cache_file_t* file, bool opened){
+   int err = 0;
+   freq_bucket_t* bucket;
+   freq_bucket_t* next;
+   //readers may touch different files at the same time, with or without the lock over the shard
+   if (pthread_mutex_lock(&shard->pol_mutex) != 0) return -1;
+   file->last_recen = time(NULL);
+   file->least_freq++;
+   switch (shard->pol){
+      case FIFO:
+         break;
+      case LRU:
+         //move the file to the most recently used end
+         flist_remove(&shard->recency, file, POLICY_LINK);
+         flist_push_front(&shard->recency, file, POLICY_LINK);
+         break;
+      case LFU:
+         //move the file to the bucket with the next frequency
+         bucket = file->bucket;
+         next = bucket->next;
+         if (!next || next->freq != file->least_freq){
+            next = bucket_create(shard, bucket, file->least_freq);
+            if (!next){
+               file->least_freq--;
+               err = -1;
+               break;
+            }
+         }
+         flist_remove(&bucket->files, file, POLICY_LINK);
+         flist_push_front(&next->files, file, POLICY_LINK);
+         file->bucket = next;
+         bucket_release(shard, bucket);
+         break;
+      case ARC:
+         //a file opened again becomes frequent, other accesses
+         //only refresh its position inside its list
+         if (file->queue == &shard->recent && !opened){
+            flist_remove(&shard->recent, file, POLICY_LINK);
+            flist_push_front(&shard->recent, file, POLICY_LINK);
+         }else{
+            flist_remove(file->queue, file, POLICY_LINK);
+            flist_push_front(&shard->frequent, file, POLICY_LINK);
+         }
+         break;
+      case TWO_Q:
+         //accesses to files in A1in are correlated and do not move them,
+         //files in Am are kept in LRU order
+         if (file->queue == &shard->frequent){
+            flist_remove(&shard->frequent, file, POLICY_LINK);
+            flist_push_front(&shard->frequent, file, POLICY_LINK);
+         }
+         break;
+      case GDSF:
+         file->priority = gdsf_priority(shard, file);
+         heap_fix(shard, file->heap_pos);
+         break;
+   }
+   if (pthread_mutex_unlock(&shard->pol_mutex) != 0) return -1;
+   return err;
+}
+
+/**
+ * @brief links a file loaded from a snapshot to the structures used by the replacement
+ * policy, where it was when the snapshot was saved.
+ * @returns 0 on success, -1 on failure.
+ * @param entry metadata of the file saved to the snapshot, least_freq is already restored.
+ * @exception errno is set to ENOMEM for malloc failure.
+*/
+static int policy_restore(shard_t* shard, cache_file_t* file, const snapshot_entry_t* entry){
+   int err = 0;
+   freq_bucket_t* prev = NULL;
+   freq_bucket_t* bucket;
+   //files are loaded in any order of frequency, each goes to the bucket of its own
+   if (shard->pol != LFU && policy_insert(shard, file) != 0) return -1;
+   if (pthread_mutex_lock(&shard->pol_mutex) != 0) return -1;
+   if (shard->pol == LFU){
+      for (bucket = shard->buckets; bucket && bucket->freq < file->least_freq; bucket = bucket->next)
+         prev = bucket;
+      if (!bucket || bucket->freq != file->least_freq) bucket = bucket_create(shard, prev, file->least_freq);
+      if (bucket){
+         flist_push_front(&shard->order, file, ORDER_LINK);
+         flist_push_front(&bucket->files, file, POLICY_LINK);
+         file->bucket = bucket;
+      }else{
+         err = -1;
+      }
+   }
+   if ((shard->pol == ARC || shard->pol == TWO_Q) && entry->frequent){
+      flist_remove(&shard->recent, file, POLICY_LINK);
+      flist_push_front(&shard->frequent, file, POLICY_LINK);
+   }
+   if (shard->pol == GDSF){
+      file->priority = entry->priority;
+      heap_fix(shard, file->heap_pos);
+   }
+   if (pthread_mutex_unlock(&shard->pol_mutex) != 0) return -1;
+   return err;
+}
+
+/**
+ * @brief counts a request for a file as a hit or a miss, and as an
+ * occurrence of the file for the admission filter.
+ * @returns 0 on success, -1 on failure.
+ * @param bytes size of the file requested, if known.
+*/
+static int shard_count(shard_t* shard, const char* file_path, bool hit, size_t bytes){
+   //requests may be counted by readers of the shard at the same time
+   if (pthread_mutex_lock(&shard->pol_mutex) != 0) return -1;
+   //the admission filter learns the frequency of every request
+   if (shard->sketch) sketch_increment(shard->sketch, file_path);
+   if (hit){
+      shard->hits++;
+      shard->hit_bytes += bytes;
+   }else{
+      shard->misses++;
+      shard->miss_bytes += bytes;
+   }
+   if (pthread_mutex_unlock(&shard->pol_mutex) != 0) return -1;
+   return 0;
+}
+
+/**
+ * @brief gets the openers inside a set, in increasing order.
+*/
+static int* openers_get(opener_set_t* set){
+   return set->max > OPENERS_INLINE ? set->ids.array : set->ids.local;
+}
+
+/**
+ * @brief gets the position of a client inside a set, or the one it would be inserted at.
+*/
+static size_t openers_find(opener_set_t* set, int client){
+   int* ids = openers_get(set);
+   size_t low = 0, high = set->len, mid;
+   while (low < high){
+      mid = low + (high - low) / 2;
+      if (ids[mid] < client) low = mid + 1;
+      else high = mid;
+   }
+   return low;
+}
+
+/**
+ * @brief checks whether a client holds a file open.
+ * @returns 1 if it does, 0 if it does not.
+*/
+static int openers_has(opener_set_t* set, int client){
+   size_t pos = openers_find(set, client);
+   return pos < set->len && openers_get(set)[pos] == client;
+}
+
+/**
+ * @brief adds a client to the openers of a file, if it is not among them.
+ * @returns 0 on success, -1 on failure.
+ * @exception errno is set to ENOMEM for malloc failure.
+*/
+static int openers_add(opener_set_t* set, int client){
+   size_t pos = openers_find(set, client);
+   int* ids = openers_get(set);
+   int* array;
+   if (pos < set->len && ids[pos] == client) return 0;
+   //the openers are moved out of the set once they do not fit, the array doubles after that
+   if (set->len == set->max){
+      if (set->max == OPENERS_INLINE){
+         array = malloc(sizeof(int) * 2 * set->max);
+         if (array) memcpy(array, ids, sizeof(int) * set->len);
+      }else{
+         array = realloc(ids, sizeof(int) * 2 * set->max);
+      }
+      if (!array){
+         errno = ENOMEM;
+         return -1;
+      }
+      set->ids.array = array;
+      set->max *= 2;
+      ids = array;
+   }
+   memmove(ids + pos + 1, ids + pos, sizeof(int) * (set->len - pos));
+   ids[pos] = client;
+   set->len++;
+   return 0;
 }
 
-// compare function used in lfu for sorting
-int cmp_lfu(const void* a, const void* b){
-   usage_t a1 = *(usage_t*) a;
-   usage_t b1 = *(usage_t*) b;
-   return (a1.least_freq - b1.least_freq);
+/**
+ * @brief removes a client from the openers of a file, if it is among them.
+*/
+static void openers_remove(opener_set_t* set, int client){
+   size_t pos = openers_find(set, client);
+   int* ids = openers_get(set);
+   if (pos == set->len || ids[pos] != client) return;
+   memmove(ids + pos, ids + pos + 1, sizeof(int) * (set->len - pos - 1));
+   set->len--;
 }
 
 /**
- * @brief creates a file storage cache file.
- * @param name must be != NULL.
- * @returns file storage cache file on success, NULL on failure.
+ * @brief initialises an empty file storage cache file where it is stored, inside the table
+ * of its shard.
+ * @param new zeroed, as table_emplace_borrowed leaves it. It is left holding its name alone on
+ * failure, so that it can be removed from the table.
+ * @param name must be != NULL, interned. The file takes over the reference of the caller, on
+ * failure too: it is released when the file is removed from the table.
+ * @returns 0 on success, -1 on failure.
  * @exception errno is set to EINVAL for invalid params, to ENOMEM for malloc failure.
 */
-static cache_file_t* file_create(const char* name, const void* contents, size_t contents_size){
-   if (!name){
+static int file_init(cache_file_t* new, const char* name){
+   if (!new || !name){
       errno = EINVAL;
-      return NULL;
+      return -1;
    }
 
-   cache_file_t* new = NULL;
-   char* new_name = NULL;
-   void* new_contents = NULL;
-   linked_list_t* new_openers = NULL;
    rw_lock_t* new_lock = NULL;
    int err;
 
+   //the name is the key of the file inside the table
+   new->name = name;
    //for malloc failures save errno and
    //go to label cleanup
-   new = malloc(sizeof(cache_file_t));
-   GOTO_NULL(new, err, cleanup);
-   new_name = malloc(strlen(name) + 1);
-   GOTO_NULL(new_name, err, cleanup);
-   if (contents_size != 0 && contents){
-      new_contents = malloc(contents_size);
-      GOTO_NULL(new_contents, err, cleanup);
-   }
-   new_openers = list_create(free);
-   GOTO_NULL(new_openers, err, cleanup);
    new_lock = lock_create();
    GOTO_NULL(new_lock, err, cleanup);
 
-   //if no errors have occurred, initialise a new file
-   //with a name and contents.
-   strncpy(new_name, name, strlen(name) + 1);
-   memcpy(new_contents, contents, contents_size);
-   new->name = new_name;
-   new->contents = new_contents;
-   new->contents_size = contents_size;
+   //if no errors have occurred, initialise the file
+   //with a name and no contents.
+   new->contents = NULL;
+   new->contents_size = 0;
+   new->raw_size = 0;
+   new->incompressible = false;
+   new->body = NULL;
+   new->joined = false;
    new->lock = new_lock;
-   new->openers = new_openers;
+   new->openers.len = 0;
+   new->openers.max = OPENERS_INLINE;
    new->locker = 0;
    new->writer = 0;
+   new->waiters_first = NULL;
+   new->waiters_last = NULL;
    new->least_freq = 0;
    new->last_recen = time(NULL);
-
-   //return new created file on success
-   return new;
+   memset(new->links, 0, sizeof(new->links));
+   new->queue = NULL;
+   new->bucket = NULL;
+   return 0;
 
    //free resources update errno and return
-   //NULL for failure
+   //-1 for failure
    cleanup:
-   free(new_name);
-   free(new_contents);
-   list_free(new_openers);
    lock_free(new_lock);
-   free(new);
    errno = err;
-   return NULL;
+   return -1;
 }
 
 /**
- * @brief frees resources allocated for the file storage cache file.
- * @param data to be converted to a cache file.
+ * @brief releases the reference to the contents left by a file. Large contents are handed to
+ * the reclaimer, so that they are freed after the locks held by the caller are released.
+ * @param contents may be NULL, it must not be used by the caller after the call.
+ * @note if the contents cannot be queued they are released at once.
 */
-static void file_free(void* data){
-   if (!data) return;
-   cache_file_t* file = (cache_file_t*) data;
-   list_free(file->openers);
-   lock_free(file->lock);
-   free(file->contents);
-   free(file->name);
-   free(file);
+static void cache_reclaim(cache_t* cache, blob_t* contents){
+   size_t size = contents ? blob_get_size(contents) : 0;
+   blob_t** queue;
+   if (size < RECLAIM_MIN || !cache->reclaimer_set || pthread_mutex_lock(&cache->reclaimer_mutex) != 0){
+      blob_unref(contents);
+      return;
+   }
+   if (cache->reclaim_len == cache->reclaim_max){
+      queue = realloc(cache->reclaim_queue, sizeof(blob_t*) * MAX(2 * cache->reclaim_max, 16));
+      if (!queue){
+         pthread_mutex_unlock(&cache->reclaimer_mutex);
+         blob_unref(contents);
+         return;
+      }
+      cache->reclaim_queue = queue;
+      cache->reclaim_max = MAX(2 * cache->reclaim_max, 16);
+   }
+   cache->reclaim_queue[cache->reclaim_len++] = contents;
+   cache->reclaim_pending += size;
+   cache->reclaim_pending_max = MAX(cache->reclaim_pending_max, cache->reclaim_pending);
+   pthread_cond_signal(&cache->reclaimer_cond);
+   pthread_mutex_unlock(&cache->reclaimer_mutex);
 }
 
-cache_t* cache_create(size_t files_max, size_t size_max, policy_t pol){
-   if (files_max == 0 || size_max == 0){
-      errno = EINVAL;
-      return NULL;
+/**
+ * @brief gets the session of a client, creating it if asked to.
+ * @returns the session on success, NULL if the client has none or on failure.
+ * @param client must be >= 0.
+ * @exception errno is set to ENOMEM for malloc failure.
+ * @note the requests of a client are served one at a time, so its session is only used by
+ * one worker at a time: the lock protects the table of the sessions only.
+*/
+static session_t* session_get(cache_t* cache, int client, bool create){
+   session_t** sessions;
+   session_t* session = NULL;
+   size_t max;
+   if (pthread_mutex_lock(&cache->sessions_mutex) != 0) return NULL;
+   if ((size_t) client < cache->sessions_max) session = cache->sessions[client];
+   if (!session && create){
+      //the table grows with the highest file descriptor seen
+      if ((size_t) client >= cache->sessions_max){
+         max = MAX(2 * cache->sessions_max, (size_t) client + 1);
+         sessions = realloc(cache->sessions, sizeof(session_t*) * max);
+         if (!sessions){
+            pthread_mutex_unlock(&cache->sessions_mutex);
+            errno = ENOMEM;
+            return NULL;
+         }
+         memset(sessions + cache->sessions_max, 0, sizeof(session_t*) * (max - cache->sessions_max));
+         cache->sessions = sessions;
+         cache->sessions_max = max;
+      }
+      session = calloc(1, sizeof(session_t));
+      if (!session) errno = ENOMEM;
+      cache->sessions[client] = session;
    }
-   int err;
-   cache_t*  new = NULL;
-   linked_list_t*  new_names = NULL;
-   hash_table_t*  new_files = NULL;
-   rw_lock_t*  new_lock = NULL;
-
-   //for malloc failures save errno and
-   //go to label cleanup
-   new_lock = lock_create();
-   GOTO_NULL(new_lock, err, cleanup);
-   new = malloc(sizeof(cache_t));
-   GOTO_NULL(new, err,  cleanup);
-   new_names = list_create(free);
-   GOTO_NULL(new_names, err,  cleanup);
-   new_files = table_create(files_max, NULL, NULL, file_free);
-   GOTO_NULL(new_files, err,  cleanup);
-
-   //if no errors have occurred, initialise a new cache
-   //with a name and contents.
-   new->files =  new_files;
-   new->names =  new_names;
-   new->pol = pol;
-   new->lock =  new_lock;
-   new->files_max = files_max;
-   new->size_max = size_max;
-   new->cache_size = 0;
-   new->files_num = 0;
-   new->files_reached = 0;
-   new->size_reached = 0;
-   new->evictions = 0;
-
-   //return new created cache on success
-   return  new;
+   if (pthread_mutex_unlock(&cache->sessions_mutex) != 0) return NULL;
+   return session;
+}
 
-   cleanup:
-   err = errno;
-   table_free(new_files);
-   list_free(new_names);
-   lock_free(new_lock);
-   free(new);
-   errno = err;
-   return NULL;
+/**
+ * @brief frees resources allocated for a session.
+*/
+static void session_free(session_t* session){
+   if (!session) return;
+   for (size_t i = 0; i < session->len; i++) intern_put(session->names[i]);
+   free(session->names);
+   free(session);
 }
 
 /**
- * @brief saves the name of the evicted file (dependent on the replacement policy).
+ * @brief adds a file opened by a client to its session, if it is not inside it.
  * @returns 0 on success, -1 on failure.
- * @param cache must be != NULL.
- * @param evicted must be != NULL.
- * @exception errno is set to EINVAL for invalid params, to ENOMEM for malloc failure.
+ * @param client the changes replayed have no session (< 0).
+ * @param hash of the name of the file, as intern_hash_str computes it.
+ * @exception errno is set to ENOMEM for malloc failure.
+ * @note a client holds few files at a time, they are looked up by scanning them.
 */
-static int cache_get_evicted(cache_t* cache, char** evicted){
-   if (!evicted || !cache){
-      errno = EINVAL;
+static int session_add(cache_t* cache, int client, const char* file_path, size_t hash){
+   session_t* session;
+   const char** names;
+   if (client < 0) return 0;
+   if (!(session = session_get(cache, client, true))) return -1;
+   //the names are compared only if their hashes are equal
+   for (size_t i = 0; i < session->len; i++)
+      if (intern_hash(session->names[i]) == hash && strcmp(session->names[i], file_path) == 0) return 0;
+   if (session->len == session->max){
+      names = realloc(session->names, sizeof(const char*) * MAX(2 * session->max, 4));
+      if (!names){
+         errno = ENOMEM;
+         return -1;
+      }
+      session->names = names;
+      session->max = MAX(2 * session->max, 4);
+   }
+   //the name is shared with the file while it is inside the cache
+   if (!(session->names[session->len] = intern_get(cache->paths, file_path, hash))) return -1;
+   session->len++;
+   return 0;
+}
+
+/**
+ * @brief removes a file no longer held by a client from its session.
+ * @param hash of the name of the file, as intern_hash_str computes it.
+*/
+static void session_drop(cache_t* cache, int client, const char* file_path, size_t hash){
+   session_t* session;
+   if (client < 0 || !(session = session_get(cache, client, false))) return;
+   for (size_t i = 0; i < session->len; i++){
+      if (intern_hash(session->names[i]) != hash || strcmp(session->names[i], file_path) != 0) continue;
+      intern_put(session->names[i]);
+      session->names[i] = session->names[--session->len];
+      return;
+   }
+}
+
+/**
+ * @brief gets the time of the monotonic clock in milliseconds.
+*/
+static uint64_t clock_msec(void){
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief parks a client at the back of the queue of the clients waiting for the lock over a file.
+ * @returns 0 on success, -1 on failure.
+ * @param file its lock must be held for writing.
+ * @param timeout milliseconds the client waits at most, 0 if it waits until it gets the lock.
+ * @exception errno is set to ENOMEM for malloc failure.
+*/
+static int waiter_park(cache_t* cache, cache_file_t* file, int client, long timeout){
+   lock_waiter_t* new = malloc(sizeof(lock_waiter_t));
+   if (!new){
+      errno = ENOMEM;
+      return -1;
+   }
+   new->client = client;
+   new->deadline = timeout > 0 ? clock_msec() + (uint64_t) timeout : 0;
+   new->result = OP_SUCCESS;
+   new->error = 0;
+   new->file = file;
+   new->next = NULL;
+   new->all_prev = NULL;
+   if (pthread_mutex_lock(&cache->waiters_mutex) != 0){
+      free(new);
       return -1;
    }
+   new->prev = file->waiters_last;
+   if (file->waiters_last) file->waiters_last->next = new;
+   else file->waiters_first = new;
+   file->waiters_last = new;
+   new->all_next = cache->waiters;
+   if (cache->waiters) cache->waiters->all_prev = new;
+   cache->waiters = new;
+   cache->lock_waits++;
+   if (pthread_mutex_unlock(&cache->waiters_mutex) != 0) return -1;
+   return 0;
+}
+
+/**
+ * @brief ends the wait of a client, moving it to the back of the replies to be sent.
+ * @note the mutex of the waiters must be held.
+*/
+static void waiter_finish(cache_t* cache, lock_waiter_t* waiter, int result, int error){
+   cache_file_t* file = waiter->file;
+   if (waiter->prev) waiter->prev->next = waiter->next;
+   else file->waiters_first = waiter->next;
+   if (waiter->next) waiter->next->prev = waiter->prev;
+   else file->waiters_last = waiter->prev;
+   if (waiter->all_prev) waiter->all_prev->all_next = waiter->all_next;
+   else cache->waiters = waiter->all_next;
+   if (waiter->all_next) waiter->all_next->all_prev = waiter->all_prev;
+   waiter->file = NULL;
+   waiter->result = result;
+   waiter->error = error;
+   waiter->prev = cache->replies_last;
+   waiter->next = NULL;
+   if (cache->replies_last) cache->replies_last->next = waiter;
+   else cache->replies_first = waiter;
+   cache->replies_last = waiter;
+}
+
+/**
+ * @brief releases the lock over a file, handing it over to the first client waiting for it.
+ * @returns 0 on success, -1 on failure.
+ * @param file its lock must be held for writing.
+ * @note the lock is never free while clients wait for it, a client asking for a free lock
+ * gets it at once.
+*/
+static int lock_handoff(cache_t* cache, cache_file_t* file){
+   lock_waiter_t* waiter;
+   //no writing permissions over the file for the new owner
+   file->writer = 0;
+   if (pthread_mutex_lock(&cache->waiters_mutex) != 0) return -1;
+   waiter = file->waiters_first;
+   file->locker = waiter ? waiter->client : 0;
+   if (waiter){
+      waiter_finish(cache, waiter, OP_SUCCESS, 0);
+      cache->lock_handoffs++;
+   }
+   if (pthread_mutex_unlock(&cache->waiters_mutex) != 0) return -1;
+   return 0;
+}
+
+/**
+ * @brief fails the waits for the lock over a file leaving the cache.
+ * @returns 0 on success, -1 on failure.
+ * @param file the lock over its shard and its own lock must be held for writing.
+*/
+static int lock_fail_waiters(cache_t* cache, cache_file_t* file){
+   if (pthread_mutex_lock(&cache->waiters_mutex) != 0) return -1;
+   while (file->waiters_first){
+      waiter_finish(cache, file->waiters_first, OP_FAILURE, ENOENT);
+      cache->lock_failures++;
+   }
+   if (pthread_mutex_unlock(&cache->waiters_mutex) != 0) return -1;
+   return 0;
+}
+
+/**
+ * @brief frees resources allocated for the file storage cache file.
+ * @param data to be converted to a cache file.
+*/
+static void file_free(void* data){
+   if (!data) return;
+   cache_file_t* file = (cache_file_t*) data;
+   if (file->openers.max > OPENERS_INLINE) free(file->openers.ids.array);
+   lock_free(file->lock);
+   blob_unref(file->contents);
+   intern_put(file->name);
+   free(file);
+}
+
+/**
+ * @brief frees a file removed from the table of its shard once the readers that may have
+ * found it through the index are done with it.
+ * @param data to be converted to a cache file.
+*/
+static void file_retire(void* data){
+   if (!data) return;
+   cache_file_t* file = (cache_file_t*) data;
+   epoch_retire(&file->retired, file, file_free);
+}
+
+/**
+ * @brief allocates an empty index.
+ * @returns the index on success, NULL on failure.
+ * @param bits the index has 2^bits buckets.
+ * @param gen links of the files followed inside the index, 0 or 1.
+ * @exception errno is set to ENOMEM for malloc failure.
+*/
+static file_index_t* index_create(unsigned int bits, int gen){
+   file_index_t* index = calloc(1, sizeof(file_index_t) + sizeof(cache_file_t*) * ((size_t) 1 << bits));
+   if (!index){
+      errno = ENOMEM;
+      return NULL;
+   }
+   index->bits = bits;
+   index->gen = gen;
+   return index;
+}
+
+/**
+ * @brief frees an index replaced, once its readers are gone.
+ * @param data to be converted to an index.
+*/
+static void index_release(void* data){
+   if (!data) return;
+   file_index_t* index = (file_index_t*) data;
+   __atomic_store_n(index->retiring, false, __ATOMIC_RELEASE);
+   free(index);
+}
+
+/**
+ * @brief gets the bucket of an index holding the files whose name has the given hash.
+*/
+static cache_file_t** index_bucket(file_index_t* index, size_t hash){
+   return &index->buckets[((uint64_t) hash * FIBONACCI) >> (64 - index->bits)];
+}
+
+/**
+ * @brief replaces the index of a shard with one of 2^bits buckets, chaining its files through
+ * their other links. Nothing is done if the index replaced before is still read or if malloc
+ * fails, the index is then resized by a later insertion or removal.
+ * @param shard its lock must be held for writing.
+*/
+static void index_resize(shard_t* shard, unsigned int bits){
+   file_index_t* old = shard->index;
+   file_index_t* new;
+   cache_file_t** bucket;
+   //the readers of the index replaced before may still follow the links to be rebuilt
+   if (__atomic_load_n(&shard->index_retiring, __ATOMIC_ACQUIRE)) return;
+   if (!(new = index_create(bits, !old->gen))) return;
+   for (size_t i = 0; i < ((size_t) 1 << old->bits); i++){
+      for (cache_file_t* file = old->buckets[i]; file; file = file->index_next[old->gen]){
+         bucket = index_bucket(new, intern_hash(file->name));
+         file->index_next[new->gen] = *bucket;
+         *bucket = file;
+      }
+   }
+   old->retiring = &shard->index_retiring;
+   shard->index_retiring = true;
+   //the readers loading the index from now on only follow the new links, the ones
+   //walking the old index go on along the old links, which no writer changes anymore
+   __atomic_store_n(&shard->index, new, __ATOMIC_RELEASE);
+   epoch_retire(&old->retired, old, index_release);
+}
+
+/**
+ * @brief publishes a file built in full to the readers of the index of its shard.
+ * @param shard its lock must be held for writing.
+*/
+static void index_add(shard_t* shard, cache_file_t* file){
+   file_index_t* index = shard->index;
+   cache_file_t** bucket = index_bucket(index, intern_hash(file->name));
+   file->index_next[index->gen] = *bucket;
+   __atomic_store_n(bucket, file, __ATOMIC_RELEASE);
+   //the index replaced last is freed once the epoch has gone by, even if nothing else is retired
+   if (__atomic_load_n(&shard->index_retiring, __ATOMIC_ACQUIRE)) epoch_poll();
+   if (++shard->index_files > ((size_t) 1 << index->bits)) index_resize(shard, index->bits + 1);
+}
+
+/**
+ * @brief unlinks a file from the index of its shard. The file keeps its link to the next one,
+ * so that a reader standing on it goes on along the chain.
+ * @param shard its lock must be held for writing.
+*/
+static void index_remove(shard_t* shard, cache_file_t* file){
+   file_index_t* index = shard->index;
+   cache_file_t** link = index_bucket(index, intern_hash(file->name));
+   while (*link != file) link = &(*link)->index_next[index->gen];
+   __atomic_store_n(link, file->index_next[index->gen], __ATOMIC_RELEASE);
+   if (__atomic_load_n(&shard->index_retiring, __ATOMIC_ACQUIRE)) epoch_poll();
+   if (--shard->index_files < ((size_t) 1 << index->bits) / INDEX_SHRINK &&
+       ((size_t) 1 << index->bits) > INDEX_MIN)
+      index_resize(shard, index->bits - 1);
+}
+
+/**
+ * @brief looks a file up inside the index of its shard, without locking the shard.
+ * @returns the file, NULL if it is not inside the shard.
+ * @param hash of the name of the file, as intern_hash_str computes it.
+ * @note the caller must be inside an epoch section until it is done with the file,
+ * which may have been removed since it was found.
+*/
+static cache_file_t* index_find(shard_t* shard, const char* file_path, size_t hash){
+   file_index_t* index = __atomic_load_n(&shard->index, __ATOMIC_ACQUIRE);
+   cache_file_t* file = __atomic_load_n(index_bucket(index, hash), __ATOMIC_ACQUIRE);
+   for (; file; file = __atomic_load_n(&file->index_next[index->gen], __ATOMIC_ACQUIRE))
+      if (intern_hash(file->name) == hash && strcmp(file->name, file_path) == 0) return file;
+   return NULL;
+}
+
+/**
+ * @brief estimates the requests for a file of a shard, for the admission filter.
+*/
+static unsigned int shard_estimate(shard_t* shard, const char* file_path){
+   unsigned int estimate;
+   //the requests are counted by readers not locking the shard
+   pthread_mutex_lock(&shard->pol_mutex);
+   estimate = sketch_estimate(shard->sketch, file_path);
+   pthread_mutex_unlock(&shard->pol_mutex);
+   return estimate;
+}
+
+/**
+ * @brief removes a file left by its clients from the index and the table of its shard.
+ * @returns 0 on success, -1 on failure.
+ * @param shard its lock must be held for writing.
+ * @param file must be marked as removed, its lock must not be held.
+*/
+static int shard_drop_file(shard_t* shard, cache_file_t* file){
+   index_remove(shard, file);
+   return table_remove_hashed(shard->files, file->name, intern_hash(file->name)) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief gets the size of the contents of a file as they were written.
+*/
+static size_t file_get_size(const cache_file_t* file){
+   return file->raw_size ? file->raw_size : file->contents_size;
+}
+
+/**
+ * @brief frees resources allocated for shared contents.
+ * @param data to be converted to a body.
+*/
+static void body_free(void* data){
+   if (!data) return;
+   body_t* body = (body_t*) data;
+   blob_unref(body->contents);
+   free(body);
+}
+
+/**
+ * @brief makes the key of some contents, from their FNV-1a hash and their size.
+ * @param key must have room for BODY_KEY_LEN characters.
+*/
+static void body_key(char* key, const void* data, size_t size){
+   uint64_t hash = 14695981039346656037ULL;
+   for (const unsigned char* c = data; c != (const unsigned char*) data + size; c++){
+      hash ^= *c;
+      hash *= 1099511628211ULL;
+   }
+   snprintf(key, BODY_KEY_LEN, "%016llx-%lu", (unsigned long long) hash, (unsigned long) size);
+}
+
+/**
+ * @brief looks for a file holding contents identical to the ones being written, in which
+ * case one more file is counted for them.
+ * @returns 0 on success, -1 on failure.
+ * @param body set to the contents found, NULL if no file holds them.
+ * @note the lock over the bodies must be held.
+*/
+static int body_find(cache_t* cache, const char* key, const void* data, size_t size, body_t** body){
+   struct iovec iov;
+   *body = (body_t*) table_find(cache->bodies, key);
+   //contents with the same hash and size are compared, as hashes may collide
+   if (*body && (blob_get_chunks((*body)->contents, &iov, 0, 1) != 1 || memcmp(iov.iov_base, data, size) != 0))
+      *body = NULL;
+   if (!*body) return 0;
+   (*body)->files++;
+   cache->dedup_bytes += size;
+   return 0;
+}
+
+/**
+ * @brief joins the contents held by another file, before the bytes for them are taken.
+ * @returns 0 on success, -1 on failure.
+ * @param body set to the contents joined, NULL if no file holds them.
+*/
+static int body_join(cache_t* cache, const char* key, const void* data, size_t size, body_t** body){
+   *body = NULL;
+   if (pthread_mutex_lock(&cache->bodies_mutex) != 0) return -1;
+   body_find(cache, key, data, size, body);
+   if (pthread_mutex_unlock(&cache->bodies_mutex) != 0) return -1;
+   return 0;
+}
+
+/**
+ * @brief makes the contents written to a file available to the files written after it, unless
+ * another file has written the same contents in the meantime, in which case they are joined.
+ * @returns 0 on success, 1 if the contents have been joined, 2 if other contents have the same
+ * key and the file keeps its own, -1 on failure.
+ * @param contents reference to the contents written, replaced by a reference to the contents
+ * joined.
+ * @param body set to the contents registered or joined.
+*/
+static int body_register(cache_t* cache, const char* key, const void* data, size_t size,
+                         blob_t** contents, body_t** body){
+   int ret = 0;
+   body_t* new;
+   if (pthread_mutex_lock(&cache->bodies_mutex) != 0) return -1;
+   body_find(cache, key, data, size, body);
+   if (*body){
+      blob_unref(*contents);
+      *contents = blob_ref((*body)->contents);
+      ret = 1;
+   }else{
+      switch (table_emplace(cache->bodies, key, strlen(key) + 1, sizeof(body_t), (void**) &new)){
+         case 0:
+            //other contents have the same key
+            ret = 2;
+            break;
+         case 1:
+            //the table holds a reference of its own to the contents
+            strcpy(new->key, key);
+            new->contents = blob_ref(*contents);
+            new->size = size;
+            new->files = 1;
+            *body = new;
+            break;
+         default:
+            ret = -1;
+      }
+   }
+   if (pthread_mutex_unlock(&cache->bodies_mutex) != 0) return -1;
+   return ret;
+}
+
+/**
+ * @brief counts one file less for shared contents, they are freed with their last file.
+ * @returns 0 on success, 1 if alone is true and other files hold the contents, -1 on failure.
+ * @param alone true if the file must leave only if it is the last holding the contents.
+ * @param freed set to the size of the contents if they are freed, 0 otherwise.
+*/
+static int body_leave(cache_t* cache, body_t* body, bool alone, size_t* freed){
+   int ret = 0;
+   *freed = 0;
+   if (pthread_mutex_lock(&cache->bodies_mutex) != 0) return -1;
+   if (alone && body->files > 1){
+      ret = 1;
+   }else if (--body->files != 0){
+      cache->dedup_bytes -= body->size;
+   }else{
+      *freed = body->size;
+      cache_reclaim(cache, body->contents);
+      body->contents = NULL;
+      if (table_remove(cache->bodies, body->key) != 0) ret = -1;
+   }
+   if (pthread_mutex_unlock(&cache->bodies_mutex) != 0) return -1;
+   return ret;
+}
+
+/**
+ * @brief checks whether shared contents are held by more than one file.
+ * @returns 1 if they are, 0 if they are not, -1 on failure.
+*/
+static int body_shared(cache_t* cache, const body_t* body){
+   int ret;
+   if (pthread_mutex_lock(&cache->bodies_mutex) != 0) return -1;
+   ret = body->files > 1;
+   if (pthread_mutex_unlock(&cache->bodies_mutex) != 0) return -1;
+   return ret;
+}
+
+/**
+ * @brief gets the bytes to be given back to the cache for a file leaving it.
+ * @returns 0 on success, -1 on failure.
+ * @param bytes set to the size of the contents of the file, or of the contents it shares
+ * if it is the last file holding them, 0 if other files still hold them.
+*/
+static int file_release(cache_t* cache, cache_file_t* file, size_t* bytes){
+   *bytes = file->contents_size;
+   if (!file->body) return 0;
+   if (body_leave(cache, file->body, false, bytes) != 0) return -1;
+   file->body = NULL;
+   return 0;
+}
+
+/**
+ * @brief gets the bytes counted for a file by the size of its shard.
+ * @returns the size charged for the contents of the file, 0 if it joined shared contents.
+*/
+static size_t file_counted(const cache_file_t* file){
+   return file->joined ? 0 : file->contents_size;
+}
+
+/**
+ * @brief counts the contents of a file holding them alone to the size of its shard, once the
+ * other files sharing them have left.
+ * @param shard its lock must be held for writing.
+*/
+static void file_own(shard_t* shard, cache_file_t* file){
+   if (!file->joined) return;
+   shard->cache_size += file->contents_size;
+   file->joined = false;
+}
+
+/**
+ * @brief compresses the contents of a file.
+ * @returns 0 on success, 1 if the contents do not shrink by at least an eighth, -1 on failure.
+ * @param size size of the contents, must be != 0.
+ * @param compressed set to a new blob holding the compressed contents on success.
+ * @exception errno is set to ENOMEM for malloc failure.
+*/
+static int contents_compress(const blob_t* contents, size_t size, blob_t** compressed){
+   struct iovec iov[2];
+   const void* src;
+   char* joined = NULL;
+   char* out;
+   size_t out_size;
+
+   //the chunks of appended files are joined before being compressed
+   if (blob_get_chunks(contents, iov, 0, 2) == 1){
+      src = iov[0].iov_base;
+   }else{
+      joined = malloc(size);
+      if (!joined){
+         errno = ENOMEM;
+         return -1;
+      }
+      blob_copy(contents, joined);
+      src = joined;
+   }
+   out = malloc(size - size / 8);
+   if (!out){
+      free(joined);
+      errno = ENOMEM;
+      return -1;
+   }
+   out_size = lz_compress(src, size, out, size - size / 8);
+   free(joined);
+   if (out_size == 0){
+      free(out);
+      return 1;
+   }
+   *compressed = blob_create(out, out_size);
+   free(out);
+   return *compressed ? 0 : -1;
+}
+
+/**
+ * @brief gets the contents of a file as they were written, decompressing them if needed.
+ * @returns a reference to the contents on success, NULL on failure.
+ * @param shard holding the file, its lock is not needed.
+ * @param stored reference to the contents stored by the file, it is released.
+ * @param raw_size size of the contents before compression, 0 if they are not compressed.
+ * @exception errno is set to ENOMEM for malloc failure, to EINVAL for corrupted contents.
+*/
+static blob_t* contents_expand(shard_t* shard, blob_t* stored, size_t raw_size){
+   struct iovec iov;
+   struct timespec start, end;
+   blob_t* new;
+   void* data;
    int err;
-   size_t i=0,j=0,res = 0;
-   usage_t* info = NULL;
-   const cache_file_t* new = NULL;
-   linked_list_t* names_cpy = NULL;
-   char* name = NULL;
-   char* victim = NULL;
-   switch (cache->pol){
+
+   if (raw_size == 0) return stored;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   new = blob_reserve(raw_size, &data);
+   //compressed contents are held by a single chunk
+   if (new && (blob_get_chunks(stored, &iov, 0, 1) != 1 ||
+               lz_decompress(iov.iov_base, iov.iov_len, data, raw_size) != 0)){
+      err = errno;
+      blob_unref(new);
+      errno = err;
+      new = NULL;
+   }
+   blob_unref(stored);
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   //decompressions may be done by readers of the shard at the same time
+   if (pthread_mutex_lock(&shard->pol_mutex) != 0){
+      blob_unref(new);
+      return NULL;
+   }
+   shard->decompressions++;
+   shard->decompress_time += (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+   if (pthread_mutex_unlock(&shard->pol_mutex) != 0){
+      blob_unref(new);
+      return NULL;
+   }
+   return new;
+}
+
+/**
+ * @brief adds a file to a list returned to the workers, with a reference to its contents as
+ * they are stored.
+ * @returns 0 on success, -1 on failure.
+ * @param shard holding the file, the locks over it and over the file must be held.
+ * @param front true if the file is added to the front of the list, false if to the back.
+ * @exception errno is set to ENOMEM for malloc failure.
+*/
+static int list_push_file(linked_list_t* list, shard_t* shard, const cache_file_t* file, bool front){
+   int err;
+   listed_t listed = { file->contents, file->raw_size, shard };
+   //empty files are listed with no contents
+   if (!file->contents){
+      if (front) return list_push_to_front(list, file->name, intern_len(file->name) + 1, NULL, 0);
+      return list_push_to_back(list, file->name, intern_len(file->name) + 1, NULL, 0);
+   }
+   blob_ref(file->contents);
+   if (front) err = list_push_to_front(list, file->name, intern_len(file->name) + 1, &listed, sizeof(listed));
+   else err = list_push_to_back(list, file->name, intern_len(file->name) + 1, &listed, sizeof(listed));
+   if (err != 0) blob_unref(file->contents);
+   return err;
+}
+
+/**
+ * @brief decompresses the contents listed by list_push_file, after the locks are released.
+ * @returns 0 on success, -1 on failure.
+ * @param list may be NULL.
+ * @exception errno is set as contents_expand on failure, it is left as the operation listing the
+ * files has set it on success.
+*/
+static int list_expand(linked_list_t* list){
+   int err = errno;
+   listed_t* listed;
+   if (!list) return 0;
+   for (const node_t* node = list_get_first(list); node; node = node_get_next(node)){
+      listed = (listed_t*) node_get_value(node);
+      if (!listed || listed->raw_size == 0) continue;
+      if (!(listed->contents = contents_expand(listed->shard, listed->contents, listed->raw_size))) return -1;
+      listed->raw_size = 0;
+   }
+   errno = err;
+   return 0;
+}
+
+/**
+ * @brief selects the file to be evicted (dependent on the replacement policy).
+ * @returns the victim on success, NULL on failure.
+ * @param shard must be != NULL and must not be empty.
+ * @exception errno is set to EINVAL for invalid params.
+ * @note the victim is not unlinked from the policy structures.
+*/
+static cache_file_t* shard_get_evicted(shard_t* shard){
+   cache_file_t* victim = NULL;
+   if (!shard || shard->order.len == 0){
+      errno = EINVAL;
+      return NULL;
+   }
+   //the lists are reordered by the readers touching the files, without locking the shard
+   if (pthread_mutex_lock(&shard->pol_mutex) != 0) return NULL;
+   switch (shard->pol){
       //in the FIFO case, the evicted file is the first file in,
-      //meaning the last name in the list of names.
+      //meaning the last file in the insertion order list.
       case FIFO:
-         errno = 0;
-         //removes evicted file from the back of the list
-         res = list_pop_from_back(cache->names, evicted, NULL);
-         //checking if the value has been correctly popped
-         if (res == 0 && errno == ENOMEM) return -1;
-         else return 0;
-         //in the LRU case, the evicted file is the least frequently used,
-         //meaning the first name in the list of names.
+         victim = shard->order.last;
+         break;
+      //in the LRU case, the evicted file is the least recently used,
+      //meaning the last file in the recency list.
       case LRU:
-         // it is useful to sort by frequency of usage
-         info = malloc(sizeof(usage_t) * cache->files_num);
-         GOTO_NULL(info,err,cleanup);
-         names_cpy = list_save_keys(cache->names);
-         GOTO_NULL(names_cpy,err,cleanup);
-         while (list_get_size(names_cpy) != 0){
-            errno = 0;
-            if ((list_pop_from_front(names_cpy, &name, NULL) == 0) && errno == ENOMEM) goto cleanup;
-            info[i].name = malloc(sizeof(char) * (strlen(name) + 1));
-            GOTO_NULL(info[i].name,err,cleanup);
-            new = (const cache_file_t*) table_get_value(cache->files, name);
-            GOTO_NULL(new,err,cleanup);
-            //we update usage information for the evicted file
-            strcpy(info[i].name, name);
-            info[i].last_recen = new->last_recen;
-            info[i].least_freq = new->least_freq;
-            //we are done with this evicted file, we can deallocate
-            // the resources assigned to its name
-            free(name);
-            i++;
-         }
-         //sorting by last_recen of use
-         qsort((void*) info, i, sizeof(usage_t), cmp_lru);
-         victim = malloc(sizeof(char) * (strlen(info[0].name) + 1));
-         GOTO_NULL(victim,err,cleanup);
-         strcpy(victim, info[0].name);
-         // remove the victim's name from the list of names inside the
-         // cache and update the evicted file list
-         list_remove(cache->names, victim);
-         *evicted = victim;
-
-         //DEBUG
-         //fprintf(stdout,"--------------------------------------------------------------\n");
-         //fprintf(stdout,"EVICTED %s\n", victim);
-         //fprintf(stdout,"--------------------------------------------------------------\n");
-
-         //free all resources allocated to the victim
-         for(j=0;j != i;j++) free(info[j].name);
-         free(info);
-         list_free(names_cpy);
-         //success
-         return 0;
-         //in the LFU case, the evicted file is the last recently used,
-         //meaning the first name in the list of names
+         victim = shard->recency.last;
+         break;
+      //in the LFU case, the evicted file is the least frequently used,
+      //meaning the oldest file in the lowest frequency bucket.
       case LFU:
-         // it is useful to sort by usage time
-         info = malloc(sizeof(usage_t) * cache->files_num);
-         GOTO_NULL(info,err,cleanup);
-         names_cpy = list_save_keys(cache->names);
-         GOTO_NULL(names_cpy,err,cleanup);
-         while (list_get_size(names_cpy) != 0){
-            errno = 0;
-            if ((list_pop_from_front(names_cpy, &name, NULL) == 0) && errno == ENOMEM) goto cleanup;
-            info[i].name = malloc(sizeof(char) * (strlen(name) + 1));
-            GOTO_NULL(info[i].name,err,cleanup);
-            new = (const cache_file_t*) table_get_value(cache->files, name);
-            GOTO_NULL(new, err, cleanup);
-            strcpy(info[i].name, name);
-            info[i].last_recen = new->last_recen;
-            info[i].least_freq = new->least_freq;
-            //we are done with this evicted file, we can deallocate
-            // the resources assigned to its name
-            free(name);
-            i++;
-         }
-         //sorting by least_freq of use
-         qsort((void*) info, i, sizeof(usage_t), cmp_lfu);
-         victim = malloc(sizeof(char) * (strlen(info[0].name) + 1));
-         GOTO_NULL(victim,err,cleanup);
-         strcpy(victim, info[0].name);
-         // remove the victim's name from the list of names inside the
-         // cache and update the evicted file list
-         list_remove(cache->names, victim);
-         *evicted = victim;
-
-         //DEBUG
-         //fprintf(stdout,"--------------------------------------------------------------\n");
-         //fprintf(stdout,"EVICTED %s\n", victim);
-         //fprintf(stdout,"--------------------------------------------------------------\n");
-
-         //free all resources allocated to the victim
-         for(j=0;j != i;j++) free(info[j].name);
-         free(info);
-         list_free(names_cpy);
-         return 0;
+         victim = shard->buckets->files.last;
+         break;
+      //in the ARC case, the evicted file is the least recently used file of the
+      //recent list if it is larger than its target, of the frequent list otherwise.
+      case ARC:
+         if (shard->recent.len && (shard->recent.bytes > shard->target || shard->frequent.len == 0))
+            victim = shard->recent.last;
+         else victim = shard->frequent.last;
+         break;
+      //in the 2Q case, the evicted file is the oldest file in A1in if it holds
+      //more than a quarter of the capacity, the least recently used of Am otherwise.
+      case TWO_Q:
+         if (shard->recent.len && (shard->recent.bytes > shard->size_max / 4 || shard->frequent.len == 0))
+            victim = shard->recent.last;
+         else victim = shard->frequent.last;
+         break;
+      //in the GDSF case, the evicted file is the one with the lowest priority,
+      //meaning the root of the heap.
+      case GDSF:
+         victim = shard->heap[0];
+         break;
+   }
+   if (pthread_mutex_unlock(&shard->pol_mutex) != 0) return NULL;
+   if (!victim) errno = EINVAL;
+   return victim;
+}
+
+/**
+ * @brief initialises a shard of the cache.
+ * @returns 0 on success, -1 on failure.
+ * @param files_share share of the files of the cache given to the shard.
+ * @param size_share share of the size of the cache given to the shard.
+ * @exception errno is set to ENOMEM for malloc failure.
+*/
+static int shard_init(shard_t* shard, size_t files_share, size_t size_share,
+                      policy_t pol, bool admission, intern_pool_t* paths){
+   int err;
+   hash_table_t*  new_files = NULL;
+   file_index_t*  new_index = NULL;
+   unsigned int bits = 0;
+   hash_table_t*  new_ghosts = NULL;
+   cache_file_t**  new_heap = NULL;
+   sketch_t*  new_sketch = NULL;
+   rw_lock_t*  new_lock = NULL;
+
+   //for malloc failures save errno and
+   //go to label cleanup
+   new_lock = lock_create();
+   GOTO_NULL(new_lock, err, cleanup);
+   //the tables start small and grow with the files stored, whatever their limit. Their keys
+   //are interned, hashed as the pool hashes them
+   new_files = table_create(0, intern_hash_str, NULL, file_retire);
+   GOTO_NULL(new_files, err,  cleanup);
+   //so does the index, which is replaced by a larger one as files are inserted
+   while (((size_t) 1 << bits) < INDEX_MIN) bits++;
+   new_index = index_create(bits, 0);
+   GOTO_NULL(new_index, err,  cleanup);
+   //ARC and 2Q remember the files evicted recently
+   if (pol == ARC || pol == TWO_Q){
+      new_ghosts = table_create(0, intern_hash_str, NULL, ghost_free);
+      GOTO_NULL(new_ghosts, err,  cleanup);
+   }
+   //GDSF keeps the files in a heap ordered by priority, which grows with them
+   if (pol == GDSF){
+      new_heap = malloc(sizeof(cache_file_t*) * HEAP_MIN);
+      GOTO_NULL(new_heap, err,  cleanup);
+   }
+   if (admission){
+      new_sketch = sketch_create(files_share * SKETCH_WIDTH, files_share * SKETCH_SAMPLE);
+      GOTO_NULL(new_sketch, err,  cleanup);
+   }
+   err = pthread_mutex_init(&shard->pol_mutex, NULL);
+   GOTO_NZ(err, err, cleanup);
+
+   //if no errors have occurred, initialise an empty shard
+   shard->files =  new_files;
+   shard->index = new_index;
+   shard->index_files = 0;
+   shard->index_retiring = false;
+   shard->paths = paths;
+   memset(&shard->order, 0, sizeof(file_list_t));
+   memset(&shard->recency, 0, sizeof(file_list_t));
+   shard->buckets = NULL;
+   memset(&shard->recent, 0, sizeof(file_list_t));
+   memset(&shard->frequent, 0, sizeof(file_list_t));
+   memset(&shard->recent_ghosts, 0, sizeof(ghost_list_t));
+   memset(&shard->frequent_ghosts, 0, sizeof(ghost_list_t));
+   shard->ghosts = new_ghosts;
+   shard->target = 0;
+   shard->heap = new_heap;
+   shard->heap_len = 0;
+   shard->heap_max = HEAP_MIN;
+   shard->inflation = 0;
+   shard->sketch = new_sketch;
+   shard->pol = pol;
+   shard->lock =  new_lock;
+   shard->files_max = files_share;
+   shard->size_max = size_share;
+   shard->cache_size = 0;
+   shard->files_num = 0;
+   shard->evictions = 0;
+   shard->rejections = 0;
+   shard->hits = 0;
+   shard->misses = 0;
+   shard->hit_bytes = 0;
+   shard->miss_bytes = 0;
+   shard->dedup_writes = 0;
+   shard->compressions = 0;
+   shard->compressed_raw = 0;
+   shard->compressed_bytes = 0;
+   shard->decompressions = 0;
+   shard->decompress_time = 0;
+   return 0;
+
+   cleanup:
+   table_free(new_files);
+   free(new_index);
+   table_free(new_ghosts);
+   free(new_heap);
+   sketch_free(new_sketch);
+   lock_free(new_lock);
+   errno = err;
+   return -1;
+}
+
+/**
+ * @brief frees resources allocated for a shard of the cache.
+*/
+static void shard_destroy(shard_t* shard){
+   freq_bucket_t* bucket;
+   lock_free(shard->lock);
+   pthread_mutex_destroy(&shard->pol_mutex);
+   while (shard->buckets){
+      bucket = shard->buckets;
+      shard->buckets = bucket->next;
+      slab_free(bucket);
+   }
+   table_free(shard->files);
+   free(shard->index);
+   table_free(shard->ghosts);
+   free(shard->heap);
+   sketch_free(shard->sketch);
+}
+
+static void* cache_compress(void* arg);
+static void* cache_evict(void* arg);
+static void* cache_reclaimer(void* arg);
+
+cache_t* cache_create(size_t files_max, size_t size_max, policy_t pol, bool admission, size_t shard_num,
+                      time_t cold_age, bool dedup, const char* spill_dir, size_t spill_max,
+                      const char* wal_path, unsigned long wal_delay, unsigned int evict_low,
+                      unsigned int evict_high, bool reclaim){
+   if (files_max == 0 || size_max == 0 || shard_num == 0 ||
+       (evict_high != 0 && (evict_low == 0 || evict_low > evict_high || evict_high > 100))){
+      errno = EINVAL;
+      return NULL;
+   }
+   int err;
+   cache_t*  new = NULL;
+   size_t ready = 0;
+   bool mutex_set = false;
+   bool compressor_mutex_set = false;
+   bool compressor_cond_set = false;
+   bool bodies_mutex_set = false;
+   bool evictor_mutex_set = false;
+   bool evictor_cond_set = false;
+   bool reclaimer_mutex_set = false;
+   bool sessions_mutex_set = false;
+   bool reclaimer_cond_set = false;
+   bool waiters_mutex_set = false;
+
+   //for malloc failures save errno and
+   //go to label cleanup
+   new = malloc(sizeof(cache_t));
+   GOTO_NULL(new, err,  cleanup);
+   new->bodies = NULL;
+   new->spill = NULL;
+   new->wal = NULL;
+   new->shards = NULL;
+   new->paths = intern_create();
+   GOTO_NULL(new->paths, err,  cleanup);
+   new->shards = malloc(sizeof(shard_t) * shard_num);
+   GOTO_NULL(new->shards, err,  cleanup);
+   err = pthread_mutex_init(&new->budget_mutex, NULL);
+   GOTO_NZ(err, err, cleanup);
+   mutex_set = true;
+   //each shard gets an equal share of the capacity
+   for (ready = 0; ready < shard_num; ready++){
+      err = shard_init(&new->shards[ready], MAX(files_max / shard_num, 1),
+                       MAX(size_max / shard_num, 1), pol, admission, new->paths);
+      GOTO_NZ(err, err, cleanup);
+   }
+   err = pthread_mutex_init(&new->compressor_mutex, NULL);
+   GOTO_NZ(err, err, cleanup);
+   compressor_mutex_set = true;
+   err = pthread_cond_init(&new->compressor_cond, NULL);
+   GOTO_NZ(err, err, cleanup);
+   compressor_cond_set = true;
+   //the contents written are looked up among the ones held by every shard
+   if (dedup){
+      new->bodies = table_create(0, NULL, NULL, body_free);
+      GOTO_NULL(new->bodies, err, cleanup);
+   }
+   err = pthread_mutex_init(&new->bodies_mutex, NULL);
+   GOTO_NZ(err, err, cleanup);
+   bodies_mutex_set = true;
+   err = pthread_mutex_init(&new->evictor_mutex, NULL);
+   GOTO_NZ(err, err, cleanup);
+   evictor_mutex_set = true;
+   err = pthread_cond_init(&new->evictor_cond, NULL);
+   GOTO_NZ(err, err, cleanup);
+   evictor_cond_set = true;
+   err = pthread_mutex_init(&new->reclaimer_mutex, NULL);
+   GOTO_NZ(err, err, cleanup);
+   reclaimer_mutex_set = true;
+   err = pthread_cond_init(&new->reclaimer_cond, NULL);
+   GOTO_NZ(err, err, cleanup);
+   reclaimer_cond_set = true;
+   err = pthread_mutex_init(&new->sessions_mutex, NULL);
+   GOTO_NZ(err, err, cleanup);
+   sessions_mutex_set = true;
+   err = pthread_mutex_init(&new->waiters_mutex, NULL);
+   GOTO_NZ(err, err, cleanup);
+   waiters_mutex_set = true;
+   //evicted files are spilled to segment files inside the spill directory
+   if (spill_dir){
+      new->spill = spill_create(spill_dir, spill_max ? spill_max : size_max);
+      GOTO_NULL(new->spill, err, cleanup);
+   }
+   //the changes to the files are recorded before being acknowledged
+   if (wal_path){
+      new->wal = wal_open(wal_path, wal_delay);
+      GOTO_NULL(new->wal, err, cleanup);
+   }
+
+   //if no errors have occurred, initialise a new cache
+   new->shard_num = shard_num;
+   new->files_max = files_max;
+   new->size_max = size_max;
+   new->cache_size = 0;
+   new->files_num = 0;
+   new->files_reached = 0;
+   new->size_reached = 0;
+   new->cold_age = cold_age;
+   new->dedup_bytes = 0;
+   new->compressor_set = false;
+   new->compressor_stop = false;
+   new->checkpoint_pid = 0;
+   new->checkpoint_fd = -1;
+   new->checkpoints = 0;
+   new->checkpoint_failures = 0;
+   new->checkpoint_pause = 0;
+   new->checkpoint_time = 0;
+   new->checkpoint_time_max = 0;
+   new->checkpoint_pages = 0;
+   new->checkpoint_pages_max = 0;
+   new->checkpoint_log = 0;
+   new->log_first = 0;
+   new->evict_low = evict_low;
+   new->evict_high = evict_high;
+   new->evictor_set = false;
+   new->evictor_stop = false;
+   new->evictor_pending = false;
+   new->evictor_runs = 0;
+   new->evictor_files = 0;
+   new->evictor_time = 0;
+   memset(new->write_latency, 0, sizeof(new->write_latency));
+   new->sessions = NULL;
+   new->sessions_max = 0;
+   new->sessions_closed = 0;
+   new->sessions_released = 0;
+   new->waiters = NULL;
+   new->replies_first = NULL;
+   new->replies_last = NULL;
+   new->lock_waits = 0;
+   new->lock_handoffs = 0;
+   new->lock_timeouts = 0;
+   new->lock_failures = 0;
+   new->reclaimer_set = false;
+   new->reclaimer_stop = false;
+   new->reclaim_queue = NULL;
+   new->reclaim_len = 0;
+   new->reclaim_max = 0;
+   new->reclaim_pending = 0;
+   new->reclaim_pending_max = 0;
+   new->reclaimed = 0;
+   new->reclaimed_bytes = 0;
+   //large contents are freed by a thread of their own, out of the locks of the shards
+   if (reclaim){
+      err = pthread_create(&new->reclaimer, NULL, &cache_reclaimer, (void*) new);
+      GOTO_NZ(err, err, cleanup);
+      new->reclaimer_set = true;
+   }
+   //cold files are compressed by a thread of their own
+   if (cold_age != 0){
+      err = pthread_create(&new->compressor, NULL, &cache_compress, (void*) new);
+      GOTO_NZ(err, err, cleanup);
+      new->compressor_set = true;
+   }
+   //the files are evicted ahead of the writes by a thread of their own
+   if (evict_high != 0){
+      err = pthread_create(&new->evictor, NULL, &cache_evict, (void*) new);
+      GOTO_NZ(err, err, cleanup);
+      new->evictor_set = true;
    }
 
+   //return new created cache on success
+   return  new;
+
    cleanup:
+   //the threads started before the failure are stopped
+   if (new && new->compressor_set){
+      pthread_mutex_lock(&new->compressor_mutex);
+      new->compressor_stop = true;
+      pthread_cond_signal(&new->compressor_cond);
+      pthread_mutex_unlock(&new->compressor_mutex);
+      pthread_join(new->compressor, NULL);
+   }
+   if (new && new->reclaimer_set){
+      pthread_mutex_lock(&new->reclaimer_mutex);
+      new->reclaimer_stop = true;
+      pthread_cond_signal(&new->reclaimer_cond);
+      pthread_mutex_unlock(&new->reclaimer_mutex);
+      pthread_join(new->reclaimer, NULL);
+   }
+   if (new && new->shards){
+      for (size_t i = 0; i < ready; i++) shard_destroy(&new->shards[i]);
+      free(new->shards);
+   }
+   if (new) intern_free(new->paths);
+   if (mutex_set) pthread_mutex_destroy(&new->budget_mutex);
+   if (compressor_mutex_set) pthread_mutex_destroy(&new->compressor_mutex);
+   if (compressor_cond_set) pthread_cond_destroy(&new->compressor_cond);
+   if (new) table_free(new->bodies);
+   if (bodies_mutex_set) pthread_mutex_destroy(&new->bodies_mutex);
+   if (evictor_mutex_set) pthread_mutex_destroy(&new->evictor_mutex);
+   if (evictor_cond_set) pthread_cond_destroy(&new->evictor_cond);
+   if (reclaimer_mutex_set) pthread_mutex_destroy(&new->reclaimer_mutex);
+   if (reclaimer_cond_set) pthread_cond_destroy(&new->reclaimer_cond);
+   if (sessions_mutex_set) pthread_mutex_destroy(&new->sessions_mutex);
+   if (waiters_mutex_set) pthread_mutex_destroy(&new->waiters_mutex);
+   if (new) spill_free(new->spill);
+   if (new) wal_close(new->wal);
+   free(new);
+   errno = err;
+   return NULL;
+}
+
+/**
+ * @brief gets the shard a file belongs to, from the hash of its name.
+ * @param hash of the name of the file, as intern_hash_str computes it. It is computed once by
+ * every request, for the shard, the table of the shard and the pool of the names.
+*/
+static shard_t* cache_get_shard(cache_t* cache, size_t hash){
+   return &cache->shards[hash % cache->shard_num];
+}
+
+/**
+ * @brief takes room for a new file from the global budget.
+ * @returns 0 on success, 1 if the cache holds its max number of files, -1 on failure.
+*/
+static int budget_take_file(cache_t* cache){
+   int full = 0;
+   if (pthread_mutex_lock(&cache->budget_mutex) != 0) return -1;
+   if (cache->files_num == cache->files_max){
+      full = 1;
+   }else{
+      cache->files_num++;
+      cache->files_reached = MAX(cache->files_reached, cache->files_num);
+   }
+   if (pthread_mutex_unlock(&cache->budget_mutex) != 0) return -1;
+   return full;
+}
+
+/**
+ * @brief takes bytes from the global budget.
+ * @returns 0 on success, 1 if the bytes do not fit inside the cache, -1 on failure.
+*/
+static int budget_take_bytes(cache_t* cache, size_t bytes){
+   int full = 0;
+   bool wake = false;
+   if (pthread_mutex_lock(&cache->budget_mutex) != 0) return -1;
+   if (cache->cache_size + bytes > cache->size_max){
+      full = 1;
+   }else{
+      cache->cache_size += bytes;
+      cache->size_reached = MAX(cache->size_reached, cache->cache_size);
+   }
+   //the evictor frees room before the writes have to
+   if (cache->evict_high && cache->cache_size + (full ? bytes : 0) > WATERMARK(cache->size_max, cache->evict_high))
+      wake = true;
+   if (pthread_mutex_unlock(&cache->budget_mutex) != 0) return -1;
+   if (wake){
+      if (pthread_mutex_lock(&cache->evictor_mutex) != 0) return -1;
+      //one wake-up is enough until the evictor runs
+      if (!cache->evictor_pending){
+         cache->evictor_pending = true;
+         pthread_cond_signal(&cache->evictor_cond);
+      }
+      if (pthread_mutex_unlock(&cache->evictor_mutex) != 0) return -1;
+   }
+   return full;
+}
+
+/**
+ * @brief gets the bytes taken from the global budget.
+ * @returns the bytes on success, SIZE_MAX on failure.
+*/
+static size_t budget_get_size(cache_t* cache){
+   size_t size;
+   if (pthread_mutex_lock(&cache->budget_mutex) != 0) return SIZE_MAX;
+   size = cache->cache_size;
+   if (pthread_mutex_unlock(&cache->budget_mutex) != 0) return SIZE_MAX;
+   return size;
+}
+
+/**
+ * @brief gives files and bytes back to the global budget.
+ * @returns 0 on success, -1 on failure.
+*/
+static int budget_give(cache_t* cache, size_t files, size_t bytes){
+   if (pthread_mutex_lock(&cache->budget_mutex) != 0) return -1;
+   cache->files_num -= files;
+   cache->cache_size -= bytes;
+   if (pthread_mutex_unlock(&cache->budget_mutex) != 0) return -1;
+   return 0;
+}
+
+/**
+ * @brief leaves the contents joined by a write that has failed, giving them back to the
+ * global budget if no other file holds them.
+ * @returns 0 on success, -1 on failure.
+ * @param body may be NULL if no contents were joined.
+*/
+static int body_drop(cache_t* cache, body_t* body){
+   size_t freed;
+   if (!body) return 0;
+   if (body_leave(cache, body, false, &freed) != 0) return -1;
+   return budget_give(cache, 0, freed);
+}
+
+/**
+ * @brief tries to lock for writing the shard exceeding its share of the size the most.
+ * @returns the shard locked for writing, NULL if no other shard exceeds its share or if
+ * the ones exceeding it are busy.
+ * @param shard is skipped, its lock must be held for writing.
+ * @note the locks are only tried, so that two shards evicting from each other cannot deadlock.
+*/
+static shard_t* cache_borrow_shard(cache_t* cache, const shard_t* shard){
+   shard_t* other;
+   shard_t* richest = NULL;
+   size_t excess = 0;
+   for (size_t i = 0; i < cache->shard_num; i++){
+      other = &cache->shards[i];
+      if (other == shard || try_lock_for_writing(other->lock) != 0) continue;
+      if (other->files_num != 0 && other->cache_size > other->size_max &&
+          other->cache_size - other->size_max > excess){
+         //release the previous candidate, this one exceeds its share more
+         if (richest && unlock_for_writing(richest->lock) != 0) return NULL;
+         richest = other;
+         excess = other->cache_size - other->size_max;
+      }else if (unlock_for_writing(other->lock) != 0){
+         return NULL;
+      }
+   }
+   return richest;
+}
+
+/**
+ * @brief chooses the shard whose files make room for the bytes written to a shard: the shard
+ * exceeding its share the most if the shard is within its own, the shard itself otherwise.
+ * @returns the shard chosen, locked for writing if it is not the shard written to.
+ * @param shard its lock must be held for writing.
+*/
+static shard_t* cache_evicting_shard(cache_t* cache, shard_t* shard){
+   shard_t* from = NULL;
+   if (shard->cache_size <= shard->size_max) from = cache_borrow_shard(cache, shard);
+   return from ? from : shard;
+}
+
+/**
+ * @brief removes a file chosen by the replacement policy from a shard, copying it to the spill
+ * tier and recording its eviction to the write-ahead log if the cache has them.
+ * @returns 0 on success, -1 on failure.
+ * @param from its lock must be held for writing.
+ * @param victim its lock must be held for writing, it is released.
+ * @param spill false if the file must not be copied to the spill tier.
+*/
+static int shard_evict(cache_t* cache, shard_t* from, cache_file_t* victim, bool spill){
+   int err;
+   size_t freed;
+   //the readers that found the file through the index see it gone once they lock it
+   victim->removed = true;
+   //the contents are copied to the spill tier, as they are stored; a file that cannot be
+   //spilled is lost as if there were no tier
+   if (cache->spill && spill) spill_put(cache->spill, victim->name, victim->contents, victim->raw_size);
+   //the eviction is replayed with the changes causing it
+   if (cache->wal) CHECK_NZ_RET(err, wal_log(cache->wal, WAL_REMOVE, victim->name, NULL, 0));
+   //shared contents are given back with their last file
+   from->cache_size -= file_counted(victim);
+   from->files_num--;
+   CHECK_NZ_RET(err, file_release(cache, victim, &freed));
+   CHECK_NZ_RET(err, budget_give(cache, 1, freed));
+   CHECK_NZ_RET(err, policy_remove(from, victim, true));
+   cache_reclaim(cache, victim->contents);
+   victim->contents = NULL;
+   //the clients waiting for the lock over the file are told it is gone
+   CHECK_NZ_RET(err, lock_fail_waiters(cache, victim));
+   CHECK_NZ_RET(err, unlock_for_writing(victim->lock));
+   CHECK_NZ_RET(err, shard_drop_file(from, victim));
+   return 0;
+}
+
+/**
+ * @brief evicts files until the bytes to be written to a file fit inside the
+ * global budget, then takes them from the budget. If there is no capacity miss,
+ * the bytes are taken without evicting anything.
+ * @returns 0 on success, -1 on failure.
+ * @param shard holding the file to be written, its lock must be held for writing.
+ * @param file to be written, its lock must be held for writing.
+ * @param from shard the first file is evicted from, as cache_evicting_shard returns it, NULL
+ * if it is to be chosen when the first eviction is needed.
+ * @param evicted list where the evicted files are saved, if != NULL.
+ * @param failed set to true if the file to be written gets evicted, in which case
+ * the bytes are not taken and the lock over the file is released.
+ * @note the other files evicted are copied to the spill tier, if the cache has one.
+ * @note a shard within its share evicts the files of the shard exceeding its share
+ * the most, otherwise it evicts its own files.
+*/
+static int cache_make_room(cache_t* cache, shard_t* shard, const cache_file_t* file, size_t bytes,
+                           shard_t* from, linked_list_t* evicted, bool* failed){
+   int err;
+   bool missed = false;
+   cache_file_t* victim;
+   while (!*failed){
+      CHECK_FAIL_RET(err, budget_take_bytes(cache, bytes));
+      if (err == 0){
+         //the bytes have been given back by other writers meanwhile
+         if (from && from != shard) CHECK_NZ_RET(err, unlock_for_writing(from->lock));
+         return 0;
+      }
+      //there is a capacity miss, the replacement algorithm runs once for it
+      if (!missed) shard->evictions++;
+      missed = true;
+      //choose the shard to evict from
+      if (!from) from = cache_evicting_shard(cache, shard);
+      CHECK_NULL_RET(victim, shard_get_evicted(from));
+      //the file was evicted before being written
+      if (victim == file) *failed = true;
+      //readers may be using the victim, the file to be written is locked already
+      else CHECK_NZ_RET(err, lock_for_writing(victim->lock));
+      //update evictions list, holding a reference to the contents instead of a copy
+      //(decompressed once the locks are released), and remove the evicted file from cache
+      if (evicted) CHECK_NZ_RET(err, list_push_file(evicted, from, victim, true));
+      CHECK_NZ_RET(err, shard_evict(cache, from, victim, victim != file));
+      if (from != shard) CHECK_NZ_RET(err, unlock_for_writing(from->lock));
+      from = NULL;
+   }
+   return 0;
+}
+
+/**
+ * @brief compresses the contents of the files of a shard unused for at least the cold age
+ * of the cache, charging the cache only for their compressed size.
+ * @returns 0 on success, -1 on failure.
+ * @note the contents are compressed without holding the lock over the shard, a file written
+ * to or removed in the meantime keeps its new contents.
+*/
+static int shard_compress_cold(cache_t* cache, shard_t* shard){
+   int err = 0;
+   size_t num = 0, saved, freed;
+   time_t now = time(NULL);
+   cache_file_t* file;
+   //files taken from the shard, with a reference to their contents
+   struct {
+      const char* name;
+      blob_t* contents;
+      size_t size;
+      blob_t* compressed;
+      int outcome;
+   } batch[COMPRESS_BATCH];
+
+   CHECK_NZ_RET(err, lock_for_writing(shard->lock));
+   //the last use of the files is updated by readers not locking the shard
+   CHECK_NZ_RET(err, pthread_mutex_lock(&shard->pol_mutex));
+   for (file = shard->order.first; file && num < COMPRESS_BATCH; file = file->links[ORDER_LINK].next){
+      if (file->raw_size != 0 || file->incompressible || file->contents_size < COMPRESS_MIN ||
+          now - file->last_recen < cache->cold_age) continue;
+      //contents shared with other files stay as they are
+      if (file->body && body_shared(cache, file->body) != 0) continue;
+      //the name outlives the file if it is removed meanwhile
+      batch[num].name = intern_ref(file->name);
+      batch[num].contents = blob_ref(file->contents);
+      batch[num].size = file->contents_size;
+      batch[num].compressed = NULL;
+      num++;
+   }
+   CHECK_NZ_RET(err, pthread_mutex_unlock(&shard->pol_mutex));
+   CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
+
+   for (size_t i = 0; i < num; i++)
+      batch[i].outcome = contents_compress(batch[i].contents, batch[i].size, &batch[i].compressed);
+
+   CHECK_NZ_RET(err, lock_for_writing(shard->lock));
+   for (size_t i = 0; i < num; i++){
+      file = (cache_file_t*) table_find_hashed(shard->files, batch[i].name, intern_hash(batch[i].name));
+      //the contents are swapped under the lock over the file, for the readers not locking the shard
+      if (batch[i].outcome != -1 && file && lock_for_writing(file->lock) != 0){
+         err = -1;
+         file = NULL;
+      }
+      //the reference held keeps the contents from being reused, if the file still
+      //holds them it has not been written to since they were taken
+      if (batch[i].outcome != -1 && file && file->contents == batch[i].contents){
+         if (batch[i].outcome == 1){
+            file->incompressible = true;
+         }else if (!file->body || body_leave(cache, file->body, true, &freed) == 0){
+            //the file was the last holding its contents, it is still charged for them
+            file->body = NULL;
+            file_own(shard, file);
+            saved = file->contents_size - blob_get_size(batch[i].compressed);
+            cache_reclaim(cache, file->contents);
+            file->contents = batch[i].compressed;
+            batch[i].compressed = NULL;
+            file->raw_size = file->contents_size;
+            file->contents_size -= saved;
+            policy_resize(shard, file, file->raw_size);
+            shard->cache_size -= saved;
+            if (budget_give(cache, 0, saved) != 0) err = -1;
+            shard->compressions++;
+            shard->compressed_raw += file->raw_size;
+            shard->compressed_bytes += file->contents_size;
+         }
+      }
+      if (batch[i].outcome != -1 && file && unlock_for_writing(file->lock) != 0) err = -1;
+      blob_unref(batch[i].compressed);
+      blob_unref(batch[i].contents);
+      intern_put(batch[i].name);
+   }
+   if (unlock_for_writing(shard->lock) != 0) err = -1;
+   return err;
+}
+
+/**
+ * @brief compresses the cold files of every shard, once every COMPRESS_PERIOD seconds
+ * until the cache is freed.
+ * @param arg to be cast to cache_t.
+*/
+static void* cache_compress(void* arg){
+   cache_t* cache = (cache_t*) arg;
+   struct timespec deadline;
+   bool stop = false;
+   while (!stop){
+      if (pthread_mutex_lock(&cache->compressor_mutex) != 0) return NULL;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += COMPRESS_PERIOD;
+      while (!cache->compressor_stop &&
+             pthread_cond_timedwait(&cache->compressor_cond, &cache->compressor_mutex, &deadline) != ETIMEDOUT);
+      stop = cache->compressor_stop;
+      if (pthread_mutex_unlock(&cache->compressor_mutex) != 0) return NULL;
+      //a shard failing to compress its files is visited again in the next period
+      for (size_t i = 0; i < cache->shard_num && !stop; i++)
+         shard_compress_cold(cache, &cache->shards[i]);
+   }
+   return NULL;
+}
+
+/**
+ * @brief evicts files from the shards above their share of the low watermark, a batch at a
+ * time for each shard, until the cache is below the low watermark.
+ * @returns the number of files evicted.
+ * @note files waiting to be written and empty files are left to the writers, evicting them
+ * frees nothing: a shard whose next victim is one of them is skipped.
+*/
+static size_t cache_evict_down(cache_t* cache){
+   size_t evicted = 0, size;
+   bool progress = true;
+   shard_t* shard;
+   cache_file_t* victim;
+   while (progress){
+      progress = false;
+      for (size_t i = 0; i < cache->shard_num; i++){
+         size = budget_get_size(cache);
+         if (size == SIZE_MAX || size <= WATERMARK(cache->size_max, cache->evict_low)) return evicted;
+         shard = &cache->shards[i];
+         //the lock is held for a batch only, so that the writers waiting for it are not delayed
+         if (lock_for_writing(shard->lock) != 0) return evicted;
+         for (size_t n = 0; n < EVICT_BATCH && shard->order.len != 0 &&
+                            shard->cache_size > WATERMARK(shard->size_max, cache->evict_low); n++){
+            victim = shard_get_evicted(shard);
+            if (!victim || lock_for_writing(victim->lock) != 0) break;
+            if (victim->writer != 0 || victim->contents_size == 0){
+               unlock_for_writing(victim->lock);
+               break;
+            }
+            if (shard_evict(cache, shard, victim, true) != 0) break;
+            evicted++;
+            progress = true;
+         }
+         if (unlock_for_writing(shard->lock) != 0) return evicted;
+      }
+   }
+   return evicted;
+}
+
+/**
+ * @brief evicts files in the background whenever the cache goes above the high watermark,
+ * until it is below the low watermark, so that the writes seldom evict files themselves.
+ * @param arg the cache.
+*/
+static void* cache_evict(void* arg){
+   cache_t* cache = (cache_t*) arg;
+   struct timespec deadline, start, end;
+   size_t evicted, size;
+   bool stop = false;
+   while (!stop){
+      if (pthread_mutex_lock(&cache->evictor_mutex) != 0) return NULL;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += EVICT_PERIOD;
+      while (!cache->evictor_stop && !cache->evictor_pending &&
+             pthread_cond_timedwait(&cache->evictor_cond, &cache->evictor_mutex, &deadline) != ETIMEDOUT);
+      stop = cache->evictor_stop;
+      cache->evictor_pending = false;
+      if (pthread_mutex_unlock(&cache->evictor_mutex) != 0) return NULL;
+      size = budget_get_size(cache);
+      if (stop || size == SIZE_MAX || size <= WATERMARK(cache->size_max, cache->evict_high)) continue;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      evicted = cache_evict_down(cache);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      if (pthread_mutex_lock(&cache->evictor_mutex) != 0) return NULL;
+      cache->evictor_runs++;
+      cache->evictor_files += evicted;
+      cache->evictor_time += (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+      if (pthread_mutex_unlock(&cache->evictor_mutex) != 0) return NULL;
+   }
+   return NULL;
+}
+
+/**
+ * @brief frees the contents handed to it, until the cache is freed. The contents left when it
+ * is stopped are freed before it returns.
+ * @param arg the cache.
+*/
+static void* cache_reclaimer(void* arg){
+   cache_t* cache = (cache_t*) arg;
+   blob_t** batch;
+   size_t num, bytes;
+   bool stop = false;
+   while (!stop){
+      if (pthread_mutex_lock(&cache->reclaimer_mutex) != 0) return NULL;
+      while (!cache->reclaimer_stop && cache->reclaim_len == 0)
+         pthread_cond_wait(&cache->reclaimer_cond, &cache->reclaimer_mutex);
+      stop = cache->reclaimer_stop;
+      //the queue is taken as a whole, the workers start a new one
+      batch = cache->reclaim_queue;
+      num = cache->reclaim_len;
+      cache->reclaim_queue = NULL;
+      cache->reclaim_len = 0;
+      cache->reclaim_max = 0;
+      if (pthread_mutex_unlock(&cache->reclaimer_mutex) != 0) return NULL;
+      bytes = 0;
+      for (size_t i = 0; i < num; i++){
+         bytes += blob_get_size(batch[i]);
+         blob_unref(batch[i]);
+      }
+      free(batch);
+      if (pthread_mutex_lock(&cache->reclaimer_mutex) != 0) return NULL;
+      cache->reclaim_pending -= bytes;
+      cache->reclaimed += num;
+      cache->reclaimed_bytes += bytes;
+      if (pthread_mutex_unlock(&cache->reclaimer_mutex) != 0) return NULL;
+   }
+   return NULL;
+}
+
+/**
+ * @brief gets the bucket of the histogram of the write latency holding a duration, four
+ * buckets for each power of 2.
+*/
+static size_t latency_bucket(uint64_t usec){
+   size_t msb, bucket;
+   if (usec < 4) return (size_t) usec;
+   msb = (size_t) (63 - __builtin_clzll(usec));
+   bucket = msb * 4 + (size_t) ((usec >> (msb - 2)) & 3);
+   return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+/**
+ * @brief gets the upper bound in microseconds of the durations inside a bucket of the
+ * histogram of the write latency.
+*/
+static double latency_bound(size_t bucket){
+   if (bucket < 4) return (double) (bucket + 1);
+   if (bucket < 8) return 4;
+   return (double) (4 + bucket % 4 + 1) * (double) (1ULL << (bucket / 4 - 2));
+}
+
+/**
+ * @brief adds the time elapsed since start to the histogram of the write latency.
+*/
+static void latency_record(cache_t* cache, const struct timespec* start){
+   struct timespec end;
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   int64_t usec = (int64_t) (end.tv_sec - start->tv_sec) * 1000000 + (end.tv_nsec - start->tv_nsec) / 1000;
+   __atomic_add_fetch(&cache->write_latency[latency_bucket(usec > 0 ? (uint64_t) usec : 0)], 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief gets a percentile of the write latency from its histogram.
+ * @returns the percentile in milliseconds, 0 if nothing has been written.
+ * @param writes set to the number of writes inside the histogram.
+*/
+static double latency_percentile(cache_t* cache, double pct, size_t* writes){
+   size_t seen = 0, rank;
+   *writes = 0;
+   for (size_t i = 0; i < LATENCY_BUCKETS; i++)
+      *writes += __atomic_load_n(&cache->write_latency[i], __ATOMIC_RELAXED);
+   if (*writes == 0) return 0;
+   rank = (size_t) (pct * (double) *writes);
+   for (size_t i = 0; i < LATENCY_BUCKETS; i++){
+      seen += __atomic_load_n(&cache->write_latency[i], __ATOMIC_RELAXED);
+      if (seen > rank) return latency_bound(i) / 1000;
+   }
+   return latency_bound(LATENCY_BUCKETS - 1) / 1000;
+}
+
+size_t cache_get_files_max(cache_t* cache){
+   if (!cache){
+      errno = EINVAL;
+      return 0;
+   }
+
+   size_t num = 0;
+   //critical section
+   if (pthread_mutex_lock(&cache->budget_mutex) != 0) return 0;
+   num = cache->files_reached;
+   if (pthread_mutex_unlock(&cache->budget_mutex) != 0) return 0;
+
+   return num;
+}
+
+size_t cache_get_size_max(cache_t* cache){
+   if (!cache){
+      errno = EINVAL;
+      return 0;
+   }
+   size_t size = 0;
+   //critical section
+   if (pthread_mutex_lock(&cache->budget_mutex) != 0) return 0;
+   size = cache->size_reached;
+   if (pthread_mutex_unlock(&cache->budget_mutex) != 0) return 0;
+
+   return size;
+}
+
+size_t cache_get_reclaim_pending(cache_t* cache){
+   if (!cache){
+      errno = EINVAL;
+      return 0;
+   }
+   size_t pending = 0;
+   //critical section
+   if (pthread_mutex_lock(&cache->reclaimer_mutex) != 0) return 0;
+   pending = cache->reclaim_pending;
+   if (pthread_mutex_unlock(&cache->reclaimer_mutex) != 0) return 0;
+   return pending;
+}
+
+double cache_get_hit_ratio(cache_t* cache){
+   if (!cache){
+      errno = EINVAL;
+      return 0;
+   }
+   size_t hits = 0, misses = 0;
+   shard_t* shard;
+   //critical section, one shard at a time
+   for (size_t i = 0; i < cache->shard_num; i++){
+      shard = &cache->shards[i];
+      if (pthread_mutex_lock(&shard->pol_mutex) != 0) return 0;
+      hits += shard->hits;
+      misses += shard->misses;
+      if (pthread_mutex_unlock(&shard->pol_mutex) != 0) return 0;
+   }
+
+   return (hits + misses != 0) ? (double) hits / (double) (hits + misses) : 0;
+}
+
+double cache_get_byte_hit_ratio(cache_t* cache){
+   if (!cache){
+      errno = EINVAL;
+      return 0;
+   }
+   size_t hit_bytes = 0, miss_bytes = 0;
+   shard_t* shard;
+   //critical section, one shard at a time
+   for (size_t i = 0; i < cache->shard_num; i++){
+      shard = &cache->shards[i];
+      if (pthread_mutex_lock(&shard->pol_mutex) != 0) return 0;
+      hit_bytes += shard->hit_bytes;
+      miss_bytes += shard->miss_bytes;
+      if (pthread_mutex_unlock(&shard->pol_mutex) != 0) return 0;
+   }
+
+   return (hit_bytes + miss_bytes != 0) ? (double) hit_bytes / (double) (hit_bytes + miss_bytes) : 0;
+}
+
+int cache_sync(cache_t* cache){
+   if (!cache){
+      errno = EINVAL;
+      return -1;
+   }
+   if (!cache->wal) return 0;
+   return wal_sync(cache->wal);
+}
+
+/**
+ * @brief adds the files of a shard to the entries of a snapshot, starting from the first one
+ * to be evicted, so that loading them back in order rebuilds the lists of the policy.
+ * @param shard its lock and its policy mutex must be held.
+*/
+static void shard_snapshot(shard_t* shard, snapshot_entry_t* entries, size_t* num){
+   const file_list_t* lists[2] = { &shard->order, NULL };
+   int link = ORDER_LINK;
+   snapshot_entry_t* entry;
+   if (shard->pol == LRU){
+      lists[0] = &shard->recency;
+      link = POLICY_LINK;
+   }else if (shard->pol == ARC || shard->pol == TWO_Q){
+      lists[0] = &shard->recent;
+      lists[1] = &shard->frequent;
+      link = POLICY_LINK;
+   }
+   for (size_t i = 0; i < 2 && lists[i]; i++){
+      for (cache_file_t* file = lists[i]->last; file; file = file->links[link].prev){
+         entry = &entries[(*num)++];
+         entry->name = file->name;
+         entry->contents = file->contents;
+         entry->raw_size = file->raw_size;
+         entry->last_used = file->last_recen;
+         entry->freq = file->least_freq;
+         entry->priority = file->priority;
+         entry->frequent = file->queue == &shard->frequent;
+      }
+   }
+}
+
+int cache_save(cache_t* cache, const char* path){
+   if (!cache || !path){
+      errno = EINVAL;
+      return -1;
+   }
+   int err = 0;
+   size_t i, files = 0, num = 0;
+   unsigned long log = 0;
+   snapshot_entry_t* entries = NULL;
+   //the compressor may still be working on the shards
+   for (i = 0; i < cache->shard_num; i++){
+      if (lock_for_reading(cache->shards[i].lock) != 0){
+         err = -1;
+         break;
+      }
+      files += cache->shards[i].files_num;
+   }
+   if (err == 0){
+      entries = malloc(sizeof(snapshot_entry_t) * MAX(files, 1));
+      if (!entries){
+         errno = ENOMEM;
+         err = -1;
+      }
+   }
+   //no change can be logged while the shards are locked, the changes logged from now on
+   //go to a new segment of the log
+   if (err == 0 && cache->wal && (log = wal_rotate(cache->wal)) == 0) err = -1;
+   if (err == 0){
+      //the policy lists are reordered by readers not locking the shards
+      for (size_t j = 0; j < cache->shard_num && err == 0; j++){
+         if ((err = pthread_mutex_lock(&cache->shards[j].pol_mutex)) != 0) break;
+         shard_snapshot(&cache->shards[j], entries, &num);
+         err = pthread_mutex_unlock(&cache->shards[j].pol_mutex);
+      }
+      if (err != 0){
+         errno = err;
+         err = -1;
+      }else{
+         err = snapshot_write(path, entries, num, log);
+      }
+   }
+   while (i > 0) unlock_for_reading(cache->shards[--i].lock);
+   free(entries);
+   //the segments before the snapshot are no longer needed
+   if (err == 0 && log != 0) err = wal_compact(cache->wal, log);
+   return err;
+}
+
+/**
+ * @brief inserts a file saved to a snapshot inside a shard, if it fits inside the cache.
+ * @returns 0 on success, -1 on failure.
+ * @param shard its lock must be held for writing.
+ * @param i position of the file inside the snapshot.
+ * @param hash of the name of the file, as intern_hash_str computes it.
+*/
+static int shard_load_file(cache_t* cache, shard_t* shard, snapshot_t* snapshot, size_t i,
+                           const snapshot_entry_t* entry, size_t hash){
+   int err;
+   const char* name;
+   cache_file_t* file;
+   if ((err = budget_take_file(cache)) != 0) return err == 1 ? 0 : -1;
+   if ((err = budget_take_bytes(cache, entry->size)) != 0){
+      budget_give(cache, 1, 0);
+      return err == 1 ? 0 : -1;
+   }
+   if (!(name = intern_get(shard->paths, entry->name, hash))){
+      err = errno;
+      budget_give(cache, 1, entry->size);
+      errno = err;
+      return -1;
+   }
+   //a file saved twice keeps its first copy
+   err = table_emplace_borrowed(shard->files, name, hash, sizeof(cache_file_t), (void**) &file);
+   if (err != 1){
+      intern_put(name);
+      budget_give(cache, 1, entry->size);
+      return err == 0 ? 0 : -1;
+   }
+   //the file is built where the table stores it, it leaves the table with its name on failure
+   if (file_init(file, name) != 0 || snapshot_get_contents(snapshot, i, &file->contents) != 0)
+      goto failure;
+   file->contents_size = entry->size;
+   file->raw_size = entry->raw_size;
+   file->last_recen = entry->last_used;
+   file->least_freq = entry->freq;
+   if (policy_restore(shard, file, entry) != 0) goto failure;
+   index_add(shard, file);
+   shard->files_num++;
+   shard->cache_size += entry->size;
+   return 0;
+
+   failure:
    err = errno;
-   for (j=0;j != i;j++) free(info[j].name);
-   free(info);
-   list_free(names_cpy);
-   free(name);
+   table_remove_hashed(shard->files, name, hash);
+   budget_give(cache, 1, entry->size);
    errno = err;
    return -1;
 }
 
-size_t cache_get_files_max(cache_t* cache){
+int cache_load(cache_t* cache, const char* path){
+   if (!cache || !path){
+      errno = EINVAL;
+      return -1;
+   }
+   int err = 0;
+   size_t first, files, num = 0, bytes = 0;
+   size_t hash;
+   shard_t* shard;
+   snapshot_entry_t entry;
+   snapshot_t* snapshot = snapshot_open(path);
+   if (!snapshot) return -1;
+   files = snapshot_get_files(snapshot);
+   cache->log_first = snapshot_get_log(snapshot);
+   //the files that do not fit are the first ones, the first to be evicted when they were saved
+   for (first = files; first > 0; first--){
+      if (snapshot_get_entry(snapshot, first - 1, &entry) != 0) break;
+      if (num == cache->files_max || bytes + entry.size > cache->size_max) break;
+      num++;
+      bytes += entry.size;
+   }
+   for (size_t i = first; i < files && err == 0; i++){
+      if ((err = snapshot_get_entry(snapshot, i, &entry)) != 0) break;
+      hash = intern_hash_str(entry.name);
+      shard = cache_get_shard(cache, hash);
+      if (lock_for_writing(shard->lock) != 0){
+         err = -1;
+         break;
+      }
+      err = shard_load_file(cache, shard, snapshot, i, &entry, hash);
+      if (unlock_for_writing(shard->lock) != 0) err = -1;
+   }
+   //the files left age with respect to the one to be evicted first (GDSF)
+   for (size_t i = 0; i < cache->shard_num; i++){
+      shard = &cache->shards[i];
+      if (shard->pol == GDSF && shard->heap_len != 0) shard->inflation = shard->heap[0]->priority;
+   }
+   //the blobs over the contents keep the snapshot mapped
+   snapshot_close(snapshot);
+   return err;
+}
+
+/**
+ * @brief applies a change recorded by the write-ahead log to the cache, as the requests of a
+ * client would. A change that cannot be applied, like a write to a file too big for the cache,
+ * is skipped as it was when it was recorded.
+ * @returns 0 on success, -1 on fatal errors.
+ * @param arg the cache.
+*/
+static int cache_replay(void* arg, int type, const char* name, const void* data, size_t size){
+   cache_t* cache = (cache_t*) arg;
+   int err;
+   switch (type){
+      case WAL_WRITE:
+         //the file written replaces the one recorded before
+         err = cache_openFile(cache, name, O_CREATE | O_LOCK, REPLAY_CLIENT);
+         if (err == OP_FAILURE && errno == EEXIST){
+            if ((err = cache_openFile(cache, name, O_LOCK, REPLAY_CLIENT)) != OP_SUCCESS) break;
+            if ((err = cache_removeFile(cache, name, REPLAY_CLIENT)) != OP_SUCCESS) break;
+            err = cache_openFile(cache, name, O_CREATE | O_LOCK, REPLAY_CLIENT);
+         }
+         if (err != OP_SUCCESS) break;
+         if ((err = cache_writeFile(cache, name, size, (const char*) data, NULL, REPLAY_CLIENT)) == OP_EXIT_FATAL) break;
+         //a file not admitted or evicted before being written has left the cache, a file too big
+         //for it is left empty
+         if ((err = cache_unlockFile(cache, name, REPLAY_CLIENT)) == OP_EXIT_FATAL) break;
+         err = cache_closeFile(cache, name, REPLAY_CLIENT);
+         break;
+      case WAL_APPEND:
+         //the file may have been created empty and appended to without being written
+         err = cache_openFile(cache, name, 0, REPLAY_CLIENT);
+         if (err == OP_FAILURE && errno == ENOENT) err = cache_openFile(cache, name, O_CREATE, REPLAY_CLIENT);
+         if (err != OP_SUCCESS) break;
+         if ((err = cache_appendToFile(cache, name, (void*) data, size, NULL, REPLAY_CLIENT)) != OP_SUCCESS) break;
+         err = cache_closeFile(cache, name, REPLAY_CLIENT);
+         break;
+      case WAL_REMOVE:
+         if ((err = cache_openFile(cache, name, O_LOCK, REPLAY_CLIENT)) != OP_SUCCESS) break;
+         err = cache_removeFile(cache, name, REPLAY_CLIENT);
+         break;
+      default:
+         err = OP_SUCCESS;
+         break;
+   }
+   return err == OP_EXIT_FATAL ? -1 : 0;
+}
+
+int cache_recover(cache_t* cache){
    if (!cache){
       errno = EINVAL;
-      return 0;
+      return -1;
    }
+   int err;
+   wal_t* wal = cache->wal;
+   if (!wal) return 0;
+   //the changes replayed are already recorded
+   cache->wal = NULL;
+   err = wal_replay(wal, cache->log_first, cache_replay, cache);
+   cache->wal = wal;
+   return err;
+}
+
+/**
+ * @brief gets the pages of the calling process copied on write since it was forked, the dirty
+ * pages no longer shared with its parent.
+ * @returns the number of pages, 0 if it cannot be read.
+*/
+static size_t checkpoint_pages(void){
+   char line[256];
+   size_t kbytes = 0;
+   FILE* smaps = fopen(SMAPS_PATH, "r");
+   if (!smaps) return 0;
+   while (fgets(line, sizeof(line), smaps))
+      if (sscanf(line, "Private_Dirty: %lu kB", &kbytes) == 1) break;
+   fclose(smaps);
+   return kbytes * 1024 / (size_t) sysconf(_SC_PAGESIZE);
+}
 
+/**
+ * @brief writes a checkpoint from the child process, sends its outcome to the parent and exits.
+ * @param files number of files inside the cache when it was forked.
+ * @param log first segment of the write-ahead log after the checkpoint, 0 if there is no log.
+ * @param fd end of the pipe the outcome is written to.
+ * @note the locks over the shards and their policy mutexes are held by the thread that has
+ * forked, so that their copies cannot change: nothing is locked by the child.
+*/
+static void checkpoint_write(cache_t* cache, const char* path, size_t files, unsigned long log, int fd){
    size_t num = 0;
-   //critical section
-   if (lock_for_writing(cache->lock) != 0) return 0;
-   cache->files_reached = MAX(cache->files_num, cache->files_reached);
-   num = cache->files_reached;
-   if (unlock_for_writing(cache->lock) != 0) return 0;
+   struct timespec start, end;
+   checkpoint_result_t result;
+   snapshot_entry_t* entries;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   result.err = 0;
+   entries = malloc(sizeof(snapshot_entry_t) * MAX(files, 1));
+   if (!entries){
+      result.err = ENOMEM;
+   }else{
+      for (size_t i = 0; i < cache->shard_num; i++) shard_snapshot(&cache->shards[i], entries, &num);
+      if (snapshot_write(path, entries, num, log) != 0) result.err = errno;
+      free(entries);
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   result.time = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+   //the pages copied by the child and by the server while it was writing
+   result.pages = checkpoint_pages();
+   if (write(fd, &result, sizeof(result)) != (ssize_t) sizeof(result)) result.err = EIO;
+   close(fd);
+   _exit(result.err == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
 
-   return num;
+int cache_checkpoint(cache_t* cache, const char* path, bool compact){
+   if (!cache || !path){
+      errno = EINVAL;
+      return -1;
+   }
+   int err = 0;
+   int fds[2];
+   pid_t pid = -1;
+   size_t i, files = 0;
+   unsigned long log = 0;
+   struct timespec start, end;
+   //only one checkpoint at a time
+   if (cache->checkpoint_pid != 0) return 1;
+   if (pipe(fds) == -1) return -1;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   //the shards are locked while forking, so that the child gets a consistent copy of them,
+   //with their policy lists that readers not locking the shards reorder
+   for (i = 0; i < cache->shard_num; i++){
+      if (lock_for_reading(cache->shards[i].lock) != 0){
+         err = errno;
+         break;
+      }
+      if ((err = pthread_mutex_lock(&cache->shards[i].pol_mutex)) != 0){
+         unlock_for_reading(cache->shards[i].lock);
+         break;
+      }
+      files += cache->shards[i].files_num;
+   }
+   //the changes logged after the fork go to a new segment of the log, replayed after the checkpoint,
+   //the ones logged before are committed to the current segment once the shards are unlocked
+   if (i == cache->shard_num && cache->wal && (log = wal_rotate(cache->wal)) == 0) err = errno;
+   if (i == cache->shard_num && err == 0){
+      pid = fork();
+      if (pid == 0){
+         close(fds[0]);
+         checkpoint_write(cache, path, files, log, fds[1]);
+      }
+      if (pid == -1) err = errno;
+   }
+   while (i > 0){
+      pthread_mutex_unlock(&cache->shards[--i].pol_mutex);
+      unlock_for_reading(cache->shards[i].lock);
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   close(fds[1]);
+   if (pid == -1){
+      close(fds[0]);
+      errno = err;
+      return -1;
+   }
+   cache->checkpoint_pid = pid;
+   cache->checkpoint_fd = fds[0];
+   cache->checkpoint_log = compact ? log : 0;
+   cache->checkpoint_pause += (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+   return 0;
 }
 
-size_t cache_get_size_max(cache_t* cache){
+int cache_checkpoint_wait(cache_t* cache, bool block){
    if (!cache){
       errno = EINVAL;
-      return 0;
+      return -1;
    }
-   size_t size = 0;
-   //critical section
-   if (lock_for_writing(cache->lock) != 0) return 0;
-   cache->size_reached = MAX(cache->size_reached, cache->cache_size);
-   size = cache->size_reached;
-   if (unlock_for_writing(cache->lock) != 0) return 0;
-
-   return size;
+   int status;
+   pid_t pid;
+   checkpoint_result_t result;
+   if (cache->checkpoint_pid == 0) return 0;
+   pid = waitpid(cache->checkpoint_pid, &status, block ? 0 : WNOHANG);
+   if (pid == -1) return -1;
+   if (pid == 0) return 0;
+   if (read(cache->checkpoint_fd, &result, sizeof(result)) == (ssize_t) sizeof(result) &&
+       WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS){
+      cache->checkpoints++;
+      cache->checkpoint_time += result.time;
+      cache->checkpoint_time_max = MAX(cache->checkpoint_time_max, result.time);
+      cache->checkpoint_pages += result.pages;
+      cache->checkpoint_pages_max = MAX(cache->checkpoint_pages_max, result.pages);
+      //the segments before the checkpoint are no longer needed
+      if (cache->checkpoint_log != 0) wal_compact(cache->wal, cache->checkpoint_log);
+   }else{
+      cache->checkpoint_failures++;
+   }
+   close(cache->checkpoint_fd);
+   cache->checkpoint_fd = -1;
+   cache->checkpoint_pid = 0;
+   return 1;
 }
 
 void cache_print(cache_t* cache){
-   cache->files_reached = MAX(cache->files_reached, cache->files_num);
-   cache->size_reached = MAX(cache->size_reached, cache->cache_size);
+   size_t evictions = 0, rejections = 0, hits = 0, misses = 0;
+   size_t compressions = 0, compressed_raw = 0, compressed_bytes = 0, decompressions = 0, saved = 0;
+   size_t cache_size = 0, dedup_writes = 0, writes, names, names_bytes, buckets = 0, indexed = 0;
+   double decompress_time = 0, p50, p99;
+   //the compressor may still be working on the shards
+   for (size_t i = 0; i < cache->shard_num; i++){
+      if (lock_for_reading(cache->shards[i].lock) != 0) return;
+      evictions += cache->shards[i].evictions;
+      rejections += cache->shards[i].rejections;
+      hits += cache->shards[i].hits;
+      misses += cache->shards[i].misses;
+      compressions += cache->shards[i].compressions;
+      compressed_raw += cache->shards[i].compressed_raw;
+      compressed_bytes += cache->shards[i].compressed_bytes;
+      decompressions += cache->shards[i].decompressions;
+      decompress_time += cache->shards[i].decompress_time;
+      dedup_writes += cache->shards[i].dedup_writes;
+      for (cache_file_t* file = cache->shards[i].order.first; file; file = file->links[ORDER_LINK].next)
+         if (file->raw_size) saved += file->raw_size - file->contents_size;
+      cache_size += cache->shards[i].cache_size;
+      buckets += (size_t) 1 << cache->shards[i].index->bits;
+      indexed += cache->shards[i].index_files;
+      if (unlock_for_reading(cache->shards[i].lock) != 0) return;
+   }
    printf("\n------------CACHE SUMMARY INFORMATION------------\n");
    printf("Max number of files stored inside the server: %lu.\n", cache->files_reached);
    printf("Max size reached by the file storage cache: %5f / %5fMB.\n",
           cache->size_reached * MBYTE, cache->size_max * MBYTE);
-   printf("The replacement algorithm was executed: %lu time(s).\n", cache->evictions);
+   printf("The replacement algorithm was executed: %lu time(s).\n", evictions);
+   if (cache->shards[0].sketch) printf("The admission filter rejected: %lu write(s).\n", rejections);
+   printf("Hit ratio: %5f (%lu hit(s), %lu miss(es)).\n", cache_get_hit_ratio(cache), hits, misses);
+   printf("Byte hit ratio: %5f.\n", cache_get_byte_hit_ratio(cache));
+   if (cache->bodies){
+      printf("Writes sharing the contents of another file: %lu.\n", dedup_writes);
+      if (pthread_mutex_lock(&cache->bodies_mutex) != 0) return;
+      printf("Size not charged for shared contents: %5f MB.\n", cache->dedup_bytes * MBYTE);
+      if (pthread_mutex_unlock(&cache->bodies_mutex) != 0) return;
+   }
+   if (cache->cold_age){
+      printf("Cold files compressed: %lu (%5f MB into %5f MB).\n", compressions,
+             compressed_raw * MBYTE, compressed_bytes * MBYTE);
+      //the capacity gain is the size of the files stored against the size charged for them
+      printf("Capacity gain from compression: %5f MB saved, %5fx the size charged.\n", saved * MBYTE,
+             cache_size ? (double) (cache_size + saved) / (double) cache_size : 1);
+      printf("Decompressions: %lu, mean latency added: %5f ms.\n", decompressions,
+             decompressions ? decompress_time * 1000 / (double) decompressions : 0);
+   }
+   if (cache->spill) spill_print(cache->spill, stdout);
+   if (cache->wal) wal_print(cache->wal, stdout);
+   if (cache->evictor_set){
+      if (pthread_mutex_lock(&cache->evictor_mutex) != 0) return;
+      printf("Files evicted in the background: %lu in %lu run(s), mean run time: %5f ms.\n",
+             cache->evictor_files, cache->evictor_runs,
+             cache->evictor_runs ? cache->evictor_time * 1000 / (double) cache->evictor_runs : 0);
+      if (pthread_mutex_unlock(&cache->evictor_mutex) != 0) return;
+   }
+   if (cache->reclaimer_set){
+      if (pthread_mutex_lock(&cache->reclaimer_mutex) != 0) return;
+      printf("Contents freed in the background: %lu (%5f MB), pending: %5f MB, max pending: %5f MB.\n",
+             cache->reclaimed, cache->reclaimed_bytes * MBYTE, cache->reclaim_pending * MBYTE,
+             cache->reclaim_pending_max * MBYTE);
+      if (pthread_mutex_unlock(&cache->reclaimer_mutex) != 0) return;
+   }
+   if (pthread_mutex_lock(&cache->sessions_mutex) != 0) return;
+   printf("Clients gone: %lu, files released for them: %lu.\n", cache->sessions_closed, cache->sessions_released);
+   if (pthread_mutex_unlock(&cache->sessions_mutex) != 0) return;
+   intern_stats(cache->paths, &names, &names_bytes);
+   printf("Names interned: %lu (%5f MB), shared by the files, ghosts and sessions holding them.\n",
+          names, names_bytes * MBYTE);
+   //the indexes grow and shrink with the files of their shards
+   printf("Lock-free index: %lu bucket(s) for %lu file(s).\n", buckets, indexed);
+   if (pthread_mutex_lock(&cache->waiters_mutex) != 0) return;
+   printf("Waits for a lock: %lu, locks handed over: %lu, waits timed out: %lu, failed by removal: %lu.\n",
+          cache->lock_waits, cache->lock_handoffs, cache->lock_timeouts, cache->lock_failures);
+   if (pthread_mutex_unlock(&cache->waiters_mutex) != 0) return;
+   p50 = latency_percentile(cache, 0.5, &writes);
+   p99 = latency_percentile(cache, 0.99, &writes);
+   printf("Write latency: p50 %5f ms, p99 %5f ms (%lu write(s)).\n", p50, p99, writes);
+   if (cache->checkpoints + cache->checkpoint_failures != 0){
+      printf("Checkpoints written: %lu (%lu failed), mean pause for forking: %5f ms.\n", cache->checkpoints,
+             cache->checkpoint_failures, cache->checkpoint_pause * 1000 /
+             (double) (cache->checkpoints + cache->checkpoint_failures));
+      printf("Checkpoint duration: mean %5f ms, max %5f ms.\n",
+             cache->checkpoints ? cache->checkpoint_time * 1000 / (double) cache->checkpoints : 0,
+             cache->checkpoint_time_max * 1000);
+      printf("Pages copied on write during checkpoints: mean %lu, max %lu.\n",
+             cache->checkpoints ? cache->checkpoint_pages / cache->checkpoints : 0, cache->checkpoint_pages_max);
+   }
    printf("List of files inside the storage after server shutdown:\n");
-   list_print(cache->names);
+   fprintf(stdout, "Number of files after server shutdown: %lu\n", cache->files_num);
+   for (size_t i = 0; i < cache->shard_num; i++){
+      if (lock_for_reading(cache->shards[i].lock) != 0) return;
+      for (cache_file_t* file = cache->shards[i].order.first; file; file = file->links[ORDER_LINK].next)
+         fprintf(stdout, "\t%s\n", file->name);
+      if (unlock_for_reading(cache->shards[i].lock) != 0) return;
+   }
 }
 
 void cache_free(cache_t* cache){
    if (!cache) return;
-   lock_free(cache->lock);
-   list_free(cache->names);
-   table_free(cache->files);
+   lock_waiter_t* waiter;
+   //the checkpoint being written is finished
+   cache_checkpoint_wait(cache, true);
+   //wake up the evictor and wait for it to finish with the shards
+   if (cache->evictor_set){
+      pthread_mutex_lock(&cache->evictor_mutex);
+      cache->evictor_stop = true;
+      pthread_cond_signal(&cache->evictor_cond);
+      pthread_mutex_unlock(&cache->evictor_mutex);
+      pthread_join(cache->evictor, NULL);
+   }
+   pthread_mutex_destroy(&cache->evictor_mutex);
+   pthread_cond_destroy(&cache->evictor_cond);
+   //wake up the compressor and wait for it to finish with the shards
+   if (cache->compressor_set){
+      pthread_mutex_lock(&cache->compressor_mutex);
+      cache->compressor_stop = true;
+      pthread_cond_signal(&cache->compressor_cond);
+      pthread_mutex_unlock(&cache->compressor_mutex);
+      pthread_join(cache->compressor, NULL);
+   }
+   pthread_mutex_destroy(&cache->compressor_mutex);
+   pthread_cond_destroy(&cache->compressor_cond);
+   //the reclaimer frees the contents left by the other threads before returning
+   if (cache->reclaimer_set){
+      pthread_mutex_lock(&cache->reclaimer_mutex);
+      cache->reclaimer_stop = true;
+      pthread_cond_signal(&cache->reclaimer_cond);
+      pthread_mutex_unlock(&cache->reclaimer_mutex);
+      pthread_join(cache->reclaimer, NULL);
+   }
+   pthread_mutex_destroy(&cache->reclaimer_mutex);
+   pthread_cond_destroy(&cache->reclaimer_cond);
+   //the clients still connected are gone with the server
+   for (size_t i = 0; i < cache->sessions_max; i++) session_free(cache->sessions[i]);
+   free(cache->sessions);
+   pthread_mutex_destroy(&cache->sessions_mutex);
+   //so are the clients waiting for a lock and the replies not sent to them
+   while (cache->waiters){
+      waiter = cache->waiters;
+      cache->waiters = waiter->all_next;
+      free(waiter);
+   }
+   while (cache->replies_first){
+      waiter = cache->replies_first;
+      cache->replies_first = waiter->next;
+      free(waiter);
+   }
+   pthread_mutex_destroy(&cache->waiters_mutex);
+   pthread_mutex_destroy(&cache->bodies_mutex);
+   for (size_t i = 0; i < cache->shard_num; i++) shard_destroy(&cache->shards[i]);
+   //the files retired are freed, with their names
+   epoch_barrier();
+   //every name has been released with the files, ghosts and sessions holding it
+   intern_free(cache->paths);
+   table_free(cache->bodies);
+   spill_free(cache->spill);
+   wal_close(cache->wal);
+   pthread_mutex_destroy(&cache->budget_mutex);
+   free(cache->shards);
    free(cache);
 }
 
-int cache_openFile(cache_t* cache, const char* file_path, int flags, int client) {
+/**
+ * @brief creates an empty file opened by a client and inserts it in a shard.
+ * @returns 0 on success, -1 on failure.
+ * @param shard its lock must be held for writing, the room for the file must have
+ * been taken from the global budget.
+ * @param hash of the name of the file, as intern_hash_str computes it.
+ * @param file set to the file stored inside the shard.
+*/
+static int shard_add_file(shard_t* shard, const char* file_path, size_t hash, int flags, int client,
+                          cache_file_t** file){
+   int err;
+   const char* name;
+   cache_file_t* new;
+   shard->files_num++;
+   //the name is interned before the file, it is the key of the file inside the table
+   if (!(name = intern_get(shard->paths, file_path, hash))) return -1;
+   //the file is built where the table stores it, the policy structures link it there
+   err = table_emplace_borrowed(shard->files, name, hash, sizeof(cache_file_t), (void**) &new);
+   if (err != 1){
+      intern_put(name);
+      //the file must not be inside the shard already
+      if (err == 0) errno = EEXIST;
+      return -1;
+   }
+   //the name is released with the file
+   if (file_init(new, name) != 0){
+      err = errno;
+      table_remove_hashed(shard->files, name, hash);
+      errno = err;
+      return -1;
+   }
+   //the client requests lock over the newly created file
+   if (O_LOCK_TGL(flags)) new->locker = client;
+   //the client requests the lock for writing
+   if (O_LOCK_TGL(flags) && O_CREATE_TGL(flags)) new->writer = client;
+   //add the client to the list of names that have the file open
+   CHECK_NZ_RET(err, openers_add(&new->openers, client));
+   CHECK_FAIL_RET(err, policy_insert(shard, new));
+   //the readers not locking the shard find the file from now on
+   index_add(shard, new);
+   *file = new;
+   return 0;
+}
+
+/**
+ * @brief opens a file not inside the cache without creating it, promoting it back from the
+ * spill tier if it was evicted there. The request is a miss for the cache, the spill tier
+ * counts its own hit or miss.
+ * @returns 0 on success, 1 on failure, -1 on fatal errors.
+ * @param shard the file belongs to, no lock must be held over it.
+ * @exception errno is set to ENOENT if the file is not inside the spill tier either, to ENOSPC
+ * if the cache is at maximum capacity.
+*/
+static int cache_open(cache_t* cache, const char* file_path, size_t hash, int flags, int client);
+
+static int cache_promote(cache_t* cache, shard_t* shard, const char* file_path, size_t hash, int flags, int client){
+   int err, full;
+   bool failed = false;
+   size_t raw_size = 0;
+   blob_t* contents = NULL;
+   cache_file_t* file = NULL;
+
+   CHECK_NZ_RET(err, lock_for_writing(shard->lock));
+   //another client has created or promoted the file while the lock was released
+   if (table_find_hashed(shard->files, file_path, hash)){
+      CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
+      return cache_open(cache, file_path, hash, flags, client);
+   }
+   CHECK_FAIL_RET(err, spill_take(cache->spill, file_path, &contents, &raw_size));
+   if (err == 1){
+      CHECK_NZ_RET(err, shard_count(shard, file_path, false, 0));
+      CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
+      errno = ENOENT;
+      return OP_FAILURE;
+   }
+   //the file goes back to the spill tier if there is no room for it
+   CHECK_FAIL_RET(full, budget_take_file(cache));
+   if (full == 1){
+      spill_put(cache->spill, file_path, contents, raw_size);
+      blob_unref(contents);
+      CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
+      errno = ENOSPC;
+      return OP_FAILURE;
+   }
+   CHECK_NZ_RET(err, shard_add_file(shard, file_path, hash, flags, client, &file));
+   //readers may find the file as soon as it is added, before its contents are set
+   CHECK_NZ_RET(err, lock_for_writing(file->lock));
+   //the contents are charged as they were spilled, compressed or not
+   CHECK_NZ_RET(err, cache_make_room(cache, shard, file, contents ? blob_get_size(contents) : 0, NULL, NULL, &failed));
+   if (failed){
+      spill_put(cache->spill, file_path, contents, raw_size);
+      blob_unref(contents);
+      CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
+      errno = ENOSPC;
+      return OP_FAILURE;
+   }
+   file->contents = contents;
+   file->contents_size = contents ? blob_get_size(contents) : 0;
+   file->raw_size = raw_size;
+   policy_resize(shard, file, 0);
+   shard->cache_size += file->contents_size;
+   CHECK_NZ_RET(err, shard_count(shard, file_path, false, file_get_size(file)));
+   CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+   CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
+   return OP_SUCCESS;
+}
+
+/**
+ * @brief opens a file for a client, see cache_openFile.
+ * @param hash of the name of the file, as intern_hash_str computes it.
+*/
+static int cache_open(cache_t* cache, const char* file_path, size_t hash, int flags, int client) {
    if (!cache || !file_path) {
       errno = EINVAL;
       return OP_FAILURE;
    }
+   shard_t* shard = cache_get_shard(cache, hash);
 
-   int err, created;
+   int err, full;
    cache_file_t *file;
-   char client_str[SIZE_LEN];
-   int len = snprintf(client_str, SIZE_LEN, "%d", client);
 
    // start of critical section
    bool w_lock = O_CREATE_TGL(flags);
    //acquire lock over the whole structure
    if (!w_lock) {
-      CHECK_NZ_RET(err, lock_for_reading(cache->lock));
+      CHECK_NZ_RET(err, lock_for_reading(shard->lock));
    } else {
-      CHECK_NZ_RET(err, lock_for_writing(cache->lock));
+      CHECK_NZ_RET(err, lock_for_writing(shard->lock));
    }
-   //unable to check if the file is in the cache, return
-   CHECK_FAIL_RET(created, table_is_in(cache->files, (void *) file_path));
+   //NULL if the file is not inside the cache
+   file = (cache_file_t*) table_find_hashed(shard->files, file_path, hash);
    //if the file is present and O_CREATE is toggled, return
-   if (created == 1 && w_lock) {
+   if (file && w_lock) {
+      //the file requested is already inside the cache
+      CHECK_NZ_RET(err, shard_count(shard, file_path, true, file_get_size(file)));
       //release lock over the whole structure
-      CHECK_NZ_RET(err, unlock_for_writing(cache->lock));
+      CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
       errno = EEXIST;
       return OP_FAILURE;
-   }else if(created == 1 && !w_lock){
+   }else if(file && !w_lock){
       // file already created and O_CREATED not toggled 
-      CHECK_NULL_RET(file, (cache_file_t*) table_get_value(cache->files, (void*) file_path));
       // acquire lock for reading
       CHECK_NZ_RET(err, lock_for_reading(file->lock));
-      // unable to check if the client is in the list of openers of the file, return
-      CHECK_FAIL_RET(err, list_is_in(file->openers, client_str));
+      //check if the client is among the openers of the file
+      err = openers_has(&file->openers, client);
       // the client has already opened the file, return
       if (err == 1){
          //release the lock over the file and the whole structure
          CHECK_NZ_RET(err, unlock_for_reading(file->lock));
-         CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+         CHECK_NZ_RET(err, unlock_for_reading(shard->lock));
          errno = EBADF;
          return OP_FAILURE;
       }else{
@@ -447,7 +3356,7 @@ int cache_openFile(cache_t* cache, const char* file_path, int flags, int client)
                //a different client already owns the lock over the file, return
                //release reading lock over the file and the whole structure
                CHECK_NZ_RET(err, unlock_for_reading(file->lock));
-               CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+               CHECK_NZ_RET(err, unlock_for_reading(shard->lock));
                errno = EPERM;
                return OP_FAILURE;
             }
@@ -458,136 +3367,152 @@ int cache_openFile(cache_t* cache, const char* file_path, int flags, int client)
          //acquire lock for writing
          CHECK_NZ_RET(err, lock_for_writing(file->lock));
          // add the client to the list of openers of the file
-         CHECK_NZ_RET(err, list_push_to_front(file->openers, client_str, len + 1, NULL, 0));
+         CHECK_NZ_RET(err, openers_add(&file->openers, client));
          // update usage information
-         file->last_recen = time(NULL);
-         file->least_freq++;
+         CHECK_NZ_RET(err, shard_count(shard, file_path, true, file_get_size(file)));
+         CHECK_NZ_RET(err, policy_touch(shard, file, true));
          //release the lock over the file for writing
          CHECK_NZ_RET(err, unlock_for_writing(file->lock));
       }
    }else{
       //file not already created
+      //the file may have been evicted to the spill tier, it is promoted back to the cache
+      if (!w_lock && cache->spill){
+         CHECK_NZ_RET(err, unlock_for_reading(shard->lock));
+         return cache_promote(cache, shard, file_path, hash, flags, client);
+      }
       //if the file is not already created and O_CREATE is not toggled, return
       if (!w_lock) {
+         CHECK_NZ_RET(err, shard_count(shard, file_path, false, 0));
          //release the lock over the whole structure
-         CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+         CHECK_NZ_RET(err, unlock_for_reading(shard->lock));
          errno = ENOENT;
          return OP_FAILURE;
       }
-         //if the maximum capacity has been reached, return
-      else if (cache->files_num == cache->files_max){
+         //take room for the file from the global budget, if the maximum capacity has been reached, return
+      else if ((full = budget_take_file(cache)) != 0){
          //release the lock over the whole structure
-         CHECK_NZ_RET(err, unlock_for_writing(cache->lock));
+         CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
+         if (full == -1) return OP_EXIT_FATAL;
          errno = ENOSPC;
          return OP_FAILURE;
       }else{
          //file not present, O_CREATE toggled and there is enough space, open new file
-         cache->files_num++;
-         CHECK_NULL_RET(file, file_create(file_path, NULL, 0));
-         //the client requests lock over the newly created file
-         if (O_LOCK_TGL(flags)) file->locker = client;
-         //the client requests the lock for writing
-         if (O_LOCK_TGL(flags) && w_lock) file->writer = client;
-         //add the client to the list of names that have the file open and insert the file
-         //in the file storage cache
-         CHECK_NZ_RET(err, list_push_to_front(file->openers, client_str, len+1, NULL, 0));
-         CHECK_FAIL_RET(err, table_insert(cache->files, (void*) file_path, strlen(file_path) + 1,
-                                            (void*) file, sizeof(*file)));
-         CHECK_FAIL_RET(err, list_push_to_front(cache->names, file_path,
-                                                  strlen(file_path) + 1, NULL, 0));
-         // file creation successful, deallocate resources
-         free(file);
+         CHECK_NZ_RET(err, shard_add_file(shard, file_path, hash, flags, client, &file));
+         //the new file replaces the one evicted to the spill tier
+         if (cache->spill) CHECK_NZ_RET(err, spill_drop(cache->spill, file_path));
+         //the bytes missed are counted once the file is written
+         CHECK_NZ_RET(err, shard_count(shard, file_path, false, 0));
       }
    }
    // release lock over the whole structure
    if (!w_lock){
-      CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+      CHECK_NZ_RET(err, unlock_for_reading(shard->lock));
    }else{
-      CHECK_NZ_RET(err, unlock_for_writing(cache->lock));
+      CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
    }
    return OP_SUCCESS;
 }
 
-int cache_readFile(cache_t* cache, const char* file_path, void** buf, size_t* size, int client){
-   if (!cache || !file_path || !buf || !size){
+int cache_openFile(cache_t* cache, const char* file_path, int flags, int client){
+   size_t hash = intern_hash_str(file_path);
+   int err = cache_open(cache, file_path, hash, flags, client);
+   //the file is released for the client if it leaves without closing it
+   if (err == OP_SUCCESS && session_add(cache, client, file_path, hash) != 0) return OP_EXIT_FATAL;
+   return err;
+}
+
+int cache_readFile(cache_t* cache, const char* file_path, blob_t** contents, int client){
+   if (!cache || !file_path || !contents){
       errno = EINVAL;
       return OP_FAILURE;
    }
+   size_t hash = intern_hash_str(file_path);
+   shard_t* shard = cache_get_shard(cache, hash);
 
-   int err, created;
+   int err;
    cache_file_t* file;
-   char client_str[SIZE_LEN];
-   void* new_contents = NULL;
-   size_t new_size = 0;
-   *buf = NULL; *size = 0;
-   snprintf(client_str, SIZE_LEN, "%d", client);
-
-   //acquire lock for reading over the whole structure
-   CHECK_NZ_RET(err, lock_for_reading(cache->lock));
-   //unable to check if the file is present in the cache, return
-   CHECK_FAIL_RET(created, table_is_in(cache->files, (void*) file_path));
+   blob_t* new_contents = NULL;
+   size_t raw_size = 0;
+   *contents = NULL;
+
+   //the file is looked up without locking the whole structure, it is not freed
+   //before the epoch section is left
+   if (epoch_enter() != 0) return OP_EXIT_FATAL;
+   //NULL if the file is not inside the cache
+   file = index_find(shard, file_path, hash);
    //there is no file in the cache to be read, return
-   if (created == 0) {
-      CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+   if (!file) {
+      epoch_exit();
       errno = ENOENT;
       return OP_FAILURE;
    }else{
       //the file is present in the cache
-      //retrieve the file to be read from the cache
-      CHECK_NULL_RET(file, (cache_file_t*) table_get_value(cache->files, (void*) file_path));
       //acquire lock over the file
       CHECK_NZ_RET(err, lock_for_reading(file->lock));
+      //the file has left the cache since it was found, return
+      if (file->removed){
+         CHECK_NZ_RET(err, unlock_for_reading(file->lock));
+         epoch_exit();
+         errno = ENOENT;
+         return OP_FAILURE;
+      }
       //the file lock is owned by another client, return
       if (file->locker != 0 && file->locker != client){
-         //release the lock over the file and the whole structure
+         //release the lock over the file and leave the section
          CHECK_NZ_RET(err, unlock_for_reading(file->lock));
-         CHECK_NZ_RET(err, unlock_for_reading(cache->lock));;
+         epoch_exit();
          errno = EPERM;
          return OP_FAILURE;
       }
-      //unable to check if the file ha been opened by the client, return
-      CHECK_FAIL_RET(err, list_is_in(file->openers, client_str));
+      //check if the file has been opened by the client
+      err = openers_has(&file->openers, client);
       //the file has not previously been opened by the client and therefore
       //it cannot be read, return
       if (err == 0){
-         //release lock over the file and the whole structure
+         //release lock over the file and leave the section
          CHECK_NZ_RET(err, unlock_for_reading(file->lock));
-         CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+         epoch_exit();
          errno = EACCES;
          return OP_FAILURE;
       }else{
          //the file has been opened by this client
          //the file has no contents to be read, return
          if (file->contents_size == 0 || !file->contents){
-            //release the lock over the file and the whole structure
+            //release the lock over the file and leave the section
             CHECK_NZ_RET(err, unlock_for_reading(file->lock));
-            CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+            epoch_exit();
             return OP_SUCCESS;
          }else{
-            //the file has been opened by this client and it is not empty, copy
-            //its contents
-            new_size = file->contents_size;
-            CHECK_NULL_RET(new_contents, malloc(new_size));
-            memcpy(new_contents, file->contents, new_size);
+            //the file has been opened by this client and it is not empty, take
+            //a reference to its contents, they stay valid even if the file is
+            //written to or removed after the lock is released
+            new_contents = blob_ref(file->contents);
+            raw_size = file->raw_size;
             //release lock over the file for reading
             CHECK_NZ_RET(err, unlock_for_reading(file->lock));
             //acquire the lock over the file for writing
             CHECK_NZ_RET(err, lock_for_writing(file->lock));
-            //no writing permissions over this file
-            file->writer = 0;
-            //update usage information
-            file->last_recen = time(NULL);
-            file->least_freq++;
-            //release the lock over the file and the whole structure
+            //a file removed in the meantime is no longer part of the policy structures,
+            //the contents read before are returned as they were
+            if (!file->removed){
+               //no writing permissions over this file
+               file->writer = 0;
+               //update usage information
+               CHECK_NZ_RET(err, policy_touch(shard, file, false));
+            }
+            //release the lock over the file and leave the section
             CHECK_NZ_RET(err, unlock_for_writing(file->lock));
-            CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+            epoch_exit();
 
          }
       }
    }
-   // copy the contents of the file read to the buffer
-   *size = new_size;
-   *buf = new_contents;
+   //compressed contents are decompressed without holding any lock
+   if (new_contents && !(new_contents = contents_expand(shard, new_contents, raw_size)))
+      return OP_EXIT_FATAL;
+   // pass the reference to the contents of the file read
+   *contents = new_contents;
    return OP_SUCCESS;
 }
 
@@ -598,97 +3523,100 @@ int cache_readNFiles(cache_t* cache, linked_list_t** read_files, size_t n, int c
    }
 
    int err;
-   char client_str[SIZE_LEN];
+   shard_t* shard = NULL;
    cache_file_t* file = NULL;
-   linked_list_t* names = NULL;
+   cache_file_t* next = NULL;
    linked_list_t* new = NULL;
-   snprintf(client_str, SIZE_LEN, "%d", client);
-
-   //start of critical section
-   //acquire lock over the whole structure
-   CHECK_NZ_RET(err, lock_for_reading(cache->lock));
 
-   //there are no files to be read, return
-   if (cache->files_num == 0){
-      *read_files = NULL;
-      //release lock over the whole structure
-      CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
-      return OP_SUCCESS;
-   }
-   //save the names of the files stored in the cache in a new list
-   CHECK_NULL_RET(names, list_save_keys(cache->names));
    //successful and failed reads counters
    int successful = 0;
    int failed = 0;
-   bool read_all_files = false;
-   //if n<=0 or less than n files are present, read all files
-   if(n<=0 || (cache->files_num<n)) read_all_files = true;
    CHECK_NULL_RET(new, list_create(NULL));
-   while((!read_all_files && successful+failed !=n) || (read_all_files && successful+failed != cache->files_num)){
-      char* file_path = NULL;
-      //get the first file in the list and attempt to acquire the lock over it
-      CHECK_FAIL_RET(err, list_pop_from_front(names, &file_path, NULL));
-      CHECK_NULL_RET(file, (cache_file_t*) table_get_value(cache->files, (void*) file_path));
-      CHECK_NZ_RET(err, lock_for_reading(file->lock));
-      //the lock is already owned by another client and the file cannot be read
-      if (file->locker != 0 && file->locker != client){
-         //release lock over file and deallocate resources for the file
-         CHECK_NZ_RET(err, unlock_for_reading(file->lock));
-         free(file_path);
-         failed++;
-      }else if (file->contents_size == 0 || !file->contents){
-         // the file is empty
-         CHECK_NZ_RET(err, list_push_to_back(new, file_path, strlen(file_path) + 1, NULL, 0));
-         //release reading lock and acquire writing lock over file
-         CHECK_NZ_RET(err, unlock_for_reading(file->lock));
-         CHECK_NZ_RET(err, lock_for_writing(file->lock));
-         //no writing permissions over this file
-         file->writer = 0;
-         //update usage information
-         file->last_recen = time(NULL);
-         file->least_freq++;
-         //release writing lock over the file
-         CHECK_NZ_RET(err, unlock_for_writing(file->lock));
-         free(file_path);
-         failed++;
-      }else{
-         //file is not empty
-         CHECK_NZ_RET(err, list_push_to_back(new, file_path, strlen(file_path) + 1, file->contents,
-                                                 file->contents_size + 1));
-         //release reading lock and acquire writing lock over file
-         CHECK_NZ_RET(err, unlock_for_reading(file->lock));
-         CHECK_NZ_RET(err, lock_for_writing(file->lock));
-         //no writing permissions over this file
-         file->writer = 0;
-         //update usage information
-         file->last_recen = time(NULL);
-         file->least_freq++;
-         //release writing lock over the file
-         CHECK_NZ_RET(err, unlock_for_writing(file->lock));
-         free(file_path);
-         successful++;
+   //shards are visited one at a time, if n<=0 or less than n files are present, read all files
+   for (size_t i = 0; i < cache->shard_num && (n <= 0 || successful + failed != n); i++){
+      shard = &cache->shards[i];
+      //start of critical section
+      //acquire lock over the shard
+      CHECK_NZ_RET(err, lock_for_reading(shard->lock));
+      //files are visited in insertion order, the list cannot change
+      //while the lock over the shard is held
+      next = shard->order.first;
+      while (next && (n <= 0 || successful + failed != n)){
+         //get the next file in the list and attempt to acquire the lock over it
+         file = next;
+         next = file->links[ORDER_LINK].next;
+         const char* file_path = file->name;
+         CHECK_NZ_RET(err, lock_for_reading(file->lock));
+         //the lock is already owned by another client and the file cannot be read
+         if (file->locker != 0 && file->locker != client){
+            //release lock over file
+            CHECK_NZ_RET(err, unlock_for_reading(file->lock));
+            failed++;
+         }else if (file->contents_size == 0 || !file->contents){
+            // the file is empty
+            CHECK_NZ_RET(err, list_push_to_back(new, file_path, intern_len(file_path) + 1, NULL, 0));
+            //release reading lock and acquire writing lock over file
+            CHECK_NZ_RET(err, unlock_for_reading(file->lock));
+            CHECK_NZ_RET(err, lock_for_writing(file->lock));
+            //no writing permissions over this file
+            file->writer = 0;
+            //update usage information
+            CHECK_NZ_RET(err, policy_touch(shard, file, true));
+            //release writing lock over the file
+            CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+            failed++;
+         }else{
+            //file is not empty, the list holds a reference to its contents instead of a copy,
+            //decompressed once the locks are released
+            CHECK_NZ_RET(err, list_push_file(new, shard, file, false));
+            //release reading lock and acquire writing lock over file
+            CHECK_NZ_RET(err, unlock_for_reading(file->lock));
+            CHECK_NZ_RET(err, lock_for_writing(file->lock));
+            //no writing permissions over this file
+            file->writer = 0;
+            //update usage information
+            CHECK_NZ_RET(err, policy_touch(shard, file, true));
+            //release writing lock over the file
+            CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+            successful++;
+         }
       }
+      //release the reading lock over the shard
+      CHECK_NZ_RET(err, unlock_for_reading(shard->lock));
+   }
+   CHECK_NZ_RET(err, list_expand(new));
+   //there were no files to be read
+   if (list_get_size(new) == 0){
+      list_free(new);
+      new = NULL;
    }
-   list_free(names);
    *read_files = new;
-   //release the reading lock over the whole structure
-   CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
    return OP_SUCCESS;
 }
 
-int cache_writeFile(cache_t* cache, const char* file_path, size_t length, const char* contents,
-                    linked_list_t** evictions, int client){
+/**
+ * @brief writes a file, as cache_writeFile.
+*/
+static int cache_write(cache_t* cache, const char* file_path, size_t length, const char* contents,
+                       linked_list_t** evictions, int client){
    if (!cache || !file_path){
       errno = EINVAL;
       return OP_FAILURE;
    }
+   size_t hash = intern_hash_str(file_path);
+   shard_t* shard = cache_get_shard(cache, hash);
 
-   int err, created;
+   int err;
    bool failed = false;
-   char* new_contents = NULL;
-   char* evicted = NULL;
+   bool shared = false;
+   size_t old_size;
+   size_t charged = length;
+   char key[BODY_KEY_LEN];
+   body_t* body = NULL;
+   blob_t* new_contents = NULL;
    cache_file_t* file = NULL;
    cache_file_t* victim = NULL;
+   shard_t* from;
    linked_list_t* new_evictions = NULL;
 
    // file to be written is too big, return
@@ -698,228 +3626,329 @@ int cache_writeFile(cache_t* cache, const char* file_path, size_t length, const
       return OP_FAILURE;
    }
 
-   // copy the file contents to a buffer
+   // copy the file contents to a new blob, or share the ones of a file written with the same contents
    if (length != 0){
-      CHECK_NULL_RET(new_contents, malloc(sizeof(char) * (length + 1)));
-      memcpy(new_contents, contents, length);
-      new_contents[length] = '\0';
+      if (cache->bodies){
+         body_key(key, contents, length);
+         CHECK_NZ_RET(err, body_join(cache, key, contents, length, &body));
+      }
+      if (body){
+         new_contents = blob_ref(body->contents);
+         //the contents are already charged to the cache
+         charged = 0;
+         shared = true;
+      }else{
+         CHECK_NULL_RET(new_contents, blob_create(contents, length));
+      }
    }
 
    // start of critical section
    //acquire lock for writing
-   CHECK_NZ_RET(err, lock_for_writing(cache->lock));
-   // update cache information
-   cache->files_reached = MAX(cache->files_reached, cache->files_num);
-   cache->size_reached = MAX(cache->size_reached, cache->cache_size);
-   //unable to check if the file is inside the cache
-   CHECK_FAIL_RET(created, table_is_in(cache->files, (void*) file_path));
+   CHECK_NZ_RET(err, lock_for_writing(shard->lock));
+   //NULL if the file is not inside the cache
+   file = (cache_file_t*) table_find_hashed(shard->files, file_path, hash);
    //if the file is not inside the cache
-   if (created == 0){
-      free(new_contents);
+   if (!file){
+      blob_unref(new_contents);
+      CHECK_NZ_RET(err, body_drop(cache, body));
       //release the lock over the whole structure
-      CHECK_NZ_RET(err, unlock_for_writing(cache->lock));
+      CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
       errno = ENOENT;
       return OP_FAILURE;
 
    }else{
       //the file is inside the cache
-      //get the file to be written to server
-      CHECK_NULL_RET(file, (cache_file_t*) table_get_value(cache->files, (void*) file_path));
+      //acquire the lock over the file, readers not locking the shard may be using it
+      CHECK_NZ_RET(err, lock_for_writing(file->lock));
       //if the client has no writing privileges, return
       if (file->writer != client) {
          if (evictions) *evictions = new_evictions;
-         free(new_contents);
-         //release lock over whole structure for writing
-         CHECK_NZ_RET(err, unlock_for_writing(cache->lock));
+         blob_unref(new_contents);
+         CHECK_NZ_RET(err, body_drop(cache, body));
+         //release lock over the file and the whole structure for writing
+         CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+         CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
          errno = EACCES;
          return OP_FAILURE;
       }
+      //the file was missing, its bytes are missed even if it gets evicted
+      shard->miss_bytes += length;
+      //take the bytes from the global budget
+      CHECK_FAIL_RET(err, budget_take_bytes(cache, charged));
       //there is a capacity miss, a file will be evicted
-      if (cache->cache_size + length > cache->size_max){
-         cache->evictions++;
+      if (err == 1){
+         //the first victim is taken from this shard or from the one exceeding its share the most
+         from = cache_evicting_shard(cache, shard);
+         //the admission filter lets the file in only if it is requested
+         //more often than the file it would evict first
+         if (shard->sketch){
+            CHECK_NULL_RET(victim, shard_get_evicted(from));
+            //each shard counts the requests for its own files
+            if (victim != file && shard_estimate(shard, file_path) <= shard_estimate(from, victim->name)){
+               if (from != shard) CHECK_NZ_RET(err, unlock_for_writing(from->lock));
+               if (evictions) *evictions = new_evictions;
+               blob_unref(new_contents);
+               CHECK_NZ_RET(err, body_drop(cache, body));
+               //the file is not admitted, it leaves the cache empty as it was created
+               shard->rejections++;
+               shard->files_num--;
+               CHECK_NZ_RET(err, budget_give(cache, 1, 0));
+               CHECK_NZ_RET(err, policy_remove(shard, file, false));
+               file->removed = true;
+               CHECK_NZ_RET(err, lock_fail_waiters(cache, file));
+               CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+               CHECK_NZ_RET(err, shard_drop_file(shard, file));
+               //release the lock over the whole structure
+               CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
+               return OP_REJECTED;
+            }
+         }
          if (evictions){
             CHECK_NULL_RET(new_evictions, list_create(NULL));
          }
-         while (!failed){
-            if (cache->cache_size + length <= cache->size_max) break;
-            CHECK_NZ_RET(err, cache_get_evicted(cache, &evicted));
-            //the file was evicted before being written
-            if (strcmp(evicted, file_path) == 0) {
-               failed = true;
-            }
-            //update evictions list and remove the evicted file from cache
-            CHECK_NULL_RET(victim, (cache_file_t*)
-               table_get_value(cache->files, (void*) evicted));
-            if (evictions){
-               CHECK_NZ_RET(err, list_push_to_front(new_evictions, evicted,
-                                                        strlen(evicted) + 1, victim->contents, victim->contents_size));
-            }
-            cache->cache_size -= victim->contents_size;
-            cache->files_num--;
-            CHECK_NZ_RET(err, table_remove(cache->files, (void*) evicted));
-            free(evicted);
-         }
+         CHECK_NZ_RET(err, cache_make_room(cache, shard, file, charged, from, new_evictions, &failed));
          if (evictions) *evictions = new_evictions;
-         //if the file was evicted before being written, return
+         //if the file was evicted before being written, return, its lock has been released
          if (failed) {
-            free(new_contents);
+            blob_unref(new_contents);
+            CHECK_NZ_RET(err, body_drop(cache, body));
             //release the lock over the whole structure
-            CHECK_NZ_RET(err, unlock_for_writing(cache->lock));
+            CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
             errno = EIDRM;
             return OP_FAILURE;
          }
       }
       //the file will be written to the server
       if (new_contents){
+         //contents written by no other file are made available to the files written after it
+         if (cache->bodies && !body){
+            CHECK_FAIL_RET(err, body_register(cache, key, contents, length, &new_contents, &body));
+            //another file has written the same contents in the meantime, they are charged once
+            if (err == 1){
+               CHECK_NZ_RET(err, budget_give(cache, 0, length));
+               charged = 0;
+               shared = true;
+            }
+         }
+         if (shared) shard->dedup_writes++;
+         file->body = body;
+         file->joined = shared;
+         old_size = file->contents_size;
+         //readers still holding the old contents keep them until they are done
+         cache_reclaim(cache, file->contents);
          file->contents_size = length;
-         file->contents = (void*) new_contents;
+         file->contents = new_contents;
+         file->raw_size = 0;
+         file->incompressible = false;
+         policy_resize(shard, file, old_size);
       }
       //no writing permissions over this file
       file->writer = 0;
-      cache->cache_size += length;
+      CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+      //shared contents are counted to the shard of the file charged for them
+      shard->cache_size += charged;
+      //the contents are recorded before the lock is released, in the order of the changes
+      if (cache->wal) CHECK_NZ_RET(err, wal_log(cache->wal, WAL_WRITE, file_path, contents, length));
       //release the lock over the whole structure
-      CHECK_NZ_RET(err, unlock_for_writing(cache->lock));
+      CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
    }
    return OP_SUCCESS;
 }
 
-int cache_appendToFile(cache_t* cache, const char* file_path, void* buf, size_t size, linked_list_t** evictions, int client){
+int cache_writeFile(cache_t* cache, const char* file_path, size_t length, const char* contents,
+                    linked_list_t** evictions, int client){
+   int err;
+   struct timespec start;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   err = cache_write(cache, file_path, length, contents, evictions, client);
+   //the files evicted are decompressed once the locks are released
+   if (evictions && list_expand(*evictions) != 0) return OP_EXIT_FATAL;
+   //only the writes done count, the ones refused return at once
+   if (err == OP_SUCCESS) latency_record(cache, &start);
+   return err;
+}
+
+/**
+ * @brief appends to a file, as cache_appendToFile.
+*/
+static int cache_append(cache_t* cache, const char* file_path, void* buf, size_t size, linked_list_t** evictions, int client){
    if (!cache || !file_path){
       errno = EINVAL;
       return OP_FAILURE;
    }
+   size_t hash = intern_hash_str(file_path);
+   shard_t* shard = cache_get_shard(cache, hash);
 
    int err;
-   int created;
    bool failed = false;
-   char* evicted;
+   size_t expansion, sharing, freed;
+   blob_t* expanded;
    cache_file_t* file;
    linked_list_t* new_evictions = NULL;
-   void* new_contents;
-   char client_str[SIZE_LEN];
-   snprintf(client_str, SIZE_LEN, "%d", client);
    //acquire the lock over the whole structure
-   CHECK_NZ_RET(err, lock_for_writing(cache->lock));
+   CHECK_NZ_RET(err, lock_for_writing(shard->lock));
 
-   // update cache information
-   cache->files_reached = MAX(cache->files_reached, cache->files_num);
-   cache->size_reached = MAX(cache->size_reached, cache->cache_size);
-   //unable to check if the file is inside the cache, return
-   CHECK_FAIL_RET(created, table_is_in(cache->files, (void*) file_path));
+   //NULL if the file is not inside the cache
+   file = (cache_file_t*) table_find_hashed(shard->files, file_path, hash);
    //the file is not inside the cache
-   if (created == 0) {
+   if (!file) {
       //release the lock over the whole structure
-      CHECK_NZ_RET(err, unlock_for_writing(cache->lock));
+      CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
       errno = ENOENT;
       return OP_FAILURE;
    }else{
       //the file is inside the cache
-      CHECK_NULL_RET(file, (cache_file_t*) table_get_value(cache->files, (void*) file_path));
-      //unable to check if the client is one of the openers for the file, return
-      CHECK_FAIL_RET(err, list_is_in(file->openers, client_str));
+      //acquire the lock over the file, readers not locking the shard may be using it
+      CHECK_NZ_RET(err, lock_for_writing(file->lock));
+      //check if the client is one of the openers for the file
+      err = openers_has(&file->openers, client);
       //the file is not open by this client, return
       if (err == 0) {
-         //release the lock over the whole structure
-         CHECK_NZ_RET(err, unlock_for_writing(cache->lock));
+         //release the lock over the file and the whole structure
+         CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+         CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
          errno = EACCES;
          return OP_FAILURE;
       }
       //the lock over the file is owned by another client
       if (file->locker != client && file->locker != 0) {
-         //release the lock over the whole structure
-         CHECK_NZ_RET(err, unlock_for_writing(cache->lock));
+         //release the lock over the file and the whole structure
+         CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+         CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
          errno = EPERM;
          return OP_FAILURE;
       }
       //there are no bytes to be written to the file, return with success
       if (size == 0 || !buf) {
-         //release the lock over the whole structure
-         CHECK_NZ_RET(err, unlock_for_writing(cache->lock));
+         //release the lock over the file and the whole structure
+         CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+         CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
          return OP_SUCCESS;
       }
+      //compressed contents are stored as they were written before being appended to,
+      //the bytes saved by compressing them are taken back with the bytes appended
+      expansion = file->raw_size ? file->raw_size - file->contents_size : 0;
+      //a file sharing its contents is charged for its own copy of them, unless it is
+      //the last holding them and their charge passes to it
+      sharing = 0;
+      if (file->body){
+         CHECK_FAIL_RET(err, body_leave(cache, file->body, true, &freed));
+         if (err == 0) file->body = NULL;
+         else sharing = file->contents_size;
+      }
+      //take the bytes from the global budget
+      CHECK_FAIL_RET(err, budget_take_bytes(cache, size + expansion + sharing));
       //there is a capacity miss, a file will be evicted
-      if (cache->cache_size + size > cache->size_max){
-         cache->evictions++;
+      if (err == 1){
          if (evictions) CHECK_NULL_RET(new_evictions, list_create(NULL));
-         while (!failed){
-            if (cache->cache_size + size <= cache->size_max) break;
-            //update evicted list
-            CHECK_NZ_RET(err, cache_get_evicted(cache, &evicted));
-            //the file was evicted before being written to
-            if (strcmp(evicted, file_path) == 0) failed = true;
-            //update evictions list and remove the evicted file from cache
-            CHECK_NULL_RET(file, (cache_file_t*) table_get_value(cache->files, (void*) evicted));
-            if (evictions){
-               CHECK_NZ_RET(err, list_push_to_front(new_evictions, evicted,
-                                                        strlen(evicted) + 1, file->contents, strlen(file->contents) + 1));
-            }
-            cache->cache_size -= file->contents_size;
-            cache->files_num--;
-            CHECK_NZ_RET(err, table_remove(cache->files, (void*) evicted));
-            free(evicted);
-         }
+         CHECK_NZ_RET(err, cache_make_room(cache, shard, file, size + expansion + sharing, NULL, new_evictions, &failed));
          if (evictions) *evictions = new_evictions;
-         //if the file was evicted before being written, return
+         //if the file was evicted before being written, return, its lock has been released
          if (failed){
             //release the lock over the whole structure
-            CHECK_NZ_RET(err, unlock_for_writing(cache->lock));
+            CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
             errno = EIDRM;
             return OP_FAILURE;
          }
       }
-      //the file will be written to server
-      new_contents = realloc(file->contents, file->contents_size + size);
-      if (!new_contents){
-         //release the lock over the whole structure
-         CHECK_NZ_RET(err, unlock_for_writing(cache->lock));
+      //the shared contents are given back if the other files have left them in the meantime
+      if (file->body){
+         CHECK_NZ_RET(err, file_release(cache, file, &freed));
+         CHECK_NZ_RET(err, budget_give(cache, 0, freed));
+      }
+      //the file is charged for its own copy of the contents from now on
+      file_own(shard, file);
+      if (expansion != 0){
+         expanded = contents_expand(shard, blob_ref(file->contents), file->raw_size);
+         if (!expanded){
+            budget_give(cache, 0, size + expansion);
+            //release the lock over the file and the whole structure
+            CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+            CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
+            return OP_EXIT_FATAL;
+         }
+         cache_reclaim(cache, file->contents);
+         file->contents = expanded;
+         file->contents_size = file->raw_size;
+         file->raw_size = 0;
+         policy_resize(shard, file, file->contents_size - expansion);
+         shard->cache_size += expansion;
+      }
+      //the file will be written to server, only the bytes appended are copied and
+      //readers holding the current contents keep seeing them as they were
+      if (blob_append(&file->contents, buf, size) != 0){
+         budget_give(cache, 0, size);
+         //release the lock over the file and the whole structure
+         CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+         CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
          errno = ENOMEM;
          return OP_EXIT_FATAL;
       }
-      file->contents = new_contents;
-      memcpy(file->contents + file->contents_size, buf, size);
       file->contents_size += size;
+      file->incompressible = false;
+      policy_resize(shard, file, file->contents_size - size);
       //no writing permission over this file
       file->writer = 0;
-      cache->cache_size += size;
+      CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+      shard->cache_size += size;
+      if (cache->wal) CHECK_NZ_RET(err, wal_log(cache->wal, WAL_APPEND, file_path, buf, size));
       //release the lock over the whole structure
-      CHECK_NZ_RET(err, unlock_for_writing(cache->lock));
+      CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
    }
    return OP_SUCCESS;
 }
 
-int cache_lockFile(cache_t* cache, const char* file_path, int client){
+int cache_appendToFile(cache_t* cache, const char* file_path, void* buf, size_t size, linked_list_t** evictions, int client){
+   int err;
+   struct timespec start;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   err = cache_append(cache, file_path, buf, size, evictions, client);
+   //the files evicted are decompressed once the locks are released
+   if (evictions && list_expand(*evictions) != 0) return OP_EXIT_FATAL;
+   //only the writes done count, the ones refused return at once
+   if (err == OP_SUCCESS) latency_record(cache, &start);
+   return err;
+}
+
+int cache_lockFile(cache_t* cache, const char* file_path, int client, long timeout){
    if (!cache || !file_path){
       errno = EINVAL;
       return OP_FAILURE;
    }
+   size_t hash = intern_hash_str(file_path);
+   shard_t* shard = cache_get_shard(cache, hash);
 
-   int err, created;
+   int err;
    cache_file_t* file;
-   char client_str[SIZE_LEN];
-   snprintf(client_str, SIZE_LEN, "%d", client);
-   //acquire the reading lock over the whole structure
-   CHECK_NZ_RET(err, lock_for_reading(cache->lock));
-   //unable to check if the file is in the cache, return
-   CHECK_FAIL_RET(created, table_is_in(cache->files, (void*) file_path));
+   //the file is looked up without locking the whole structure
+   if (epoch_enter() != 0) return OP_EXIT_FATAL;
+   //NULL if the file is not inside the cache
+   file = index_find(shard, file_path, hash);
 
    //the file is not inside the cache
-   if (created == 0){
-      //release the lock over the whole structure
-      CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+   if (!file){
+      //leave the section
+      epoch_exit();
       errno = ENOENT;
       return OP_FAILURE;
 
    }else{
       //the file is inside the cache
-      CHECK_NULL_RET(file, (cache_file_t*) table_get_value(cache->files, (void*) file_path));
       //acquire the lock over the file
       CHECK_NZ_RET(err, lock_for_reading(file->lock));
-      CHECK_FAIL_RET(err, list_is_in(file->openers, client_str));
+      //the file has left the cache since it was found, return
+      if (file->removed){
+         CHECK_NZ_RET(err, unlock_for_reading(file->lock));
+         epoch_exit();
+         errno = ENOENT;
+         return OP_FAILURE;
+      }
+      err = openers_has(&file->openers, client);
       //the file has not been opened by the client
       if (err == 0){
-         //release the lock over the file and the whole structure
+         //release the lock over the file and leave the section
          CHECK_NZ_RET(err, unlock_for_reading(file->lock));
-         CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+         epoch_exit();
          errno = EACCES;
          return OP_FAILURE;
       }else{
@@ -927,19 +3956,28 @@ int cache_lockFile(cache_t* cache, const char* file_path, int client){
 
          //the client has already locked the file, return
          if (client == file->locker){
-            //release the lock over the file and the whole structure
+            //release the lock over the file and leave the section
             CHECK_NZ_RET(err, unlock_for_reading(file->lock));
-            CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+            epoch_exit();
             return OP_SUCCESS;
          }
          // release the reading lock and acquire the writing lock over the file
          CHECK_NZ_RET(err, unlock_for_reading(file->lock));
          CHECK_NZ_RET(err, lock_for_writing(file->lock));
-         //the lock is owned by another client, return
+         //the file has left the cache while the lock was released, return
+         if (file->removed){
+            CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+            epoch_exit();
+            errno = ENOENT;
+            return OP_FAILURE;
+         }
+         //the lock is owned by another client, the client waits for it unless it asked not to
          if (file->locker != 0 && file->locker != client) {
-            //release the lock over the file and the whole structure
+            if (timeout >= 0) CHECK_FAIL_RET(err, waiter_park(cache, file, client, timeout));
+            //release the lock over the file and leave the section
             CHECK_NZ_RET(err, unlock_for_writing(file->lock));
-            CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+            epoch_exit();
+            if (timeout >= 0) return OP_WAITING;
             errno = EPERM;
             return OP_FAILURE;
          }
@@ -948,11 +3986,10 @@ int cache_lockFile(cache_t* cache, const char* file_path, int client){
          //no writing permissions over the file
          file->writer = 0;
          //update usage informations
-         file->last_recen = time(NULL);
-         file->least_freq++;
-         //release the lock over the file and the whole structure
+         CHECK_NZ_RET(err, policy_touch(shard, file, false));
+         //release the lock over the file and leave the section
          CHECK_NZ_RET(err, unlock_for_writing(file->lock));
-         CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+         epoch_exit();
       }
    }
    return OP_SUCCESS;
@@ -963,58 +4000,68 @@ int cache_unlockFile(cache_t* cache, const char* file_path, int client){
       errno = EINVAL;
       return OP_FAILURE;
    }
+   size_t hash = intern_hash_str(file_path);
+   shard_t* shard = cache_get_shard(cache, hash);
 
-   int err, created;
+   int err;
    cache_file_t* file;
-   char client_str[SIZE_LEN];
-   snprintf(client_str, SIZE_LEN, "%d", client);
-   //acquire the lock over the whole structure
-   CHECK_NZ_RET(err, lock_for_reading(cache->lock));
-   //unable to check if the file is inside the cache, return
-   CHECK_FAIL_RET(created, table_is_in(cache->files, (void*) file_path));
+   //the file is looked up without locking the whole structure
+   if (epoch_enter() != 0) return OP_EXIT_FATAL;
+   //NULL if the file is not inside the cache
+   file = index_find(shard, file_path, hash);
    //the file is not inside the cache
-   if (created == 0) {
-      //release the lock over the whole structure
-      CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+   if (!file) {
+      //leave the section
+      epoch_exit();
       errno = ENOENT;
       return OP_FAILURE;
    }else{
       //the file is inside the cache
-      CHECK_NULL_RET(file, (cache_file_t*) table_get_value(cache->files, (void*) file_path));
       //acquire the lock over the file
       CHECK_NZ_RET(err, lock_for_reading(file->lock));
-      //unable to check if the file is opened by the client, return
-      CHECK_FAIL_RET(err, list_is_in(file->openers, client_str));
+      //the file has left the cache since it was found, return
+      if (file->removed){
+         CHECK_NZ_RET(err, unlock_for_reading(file->lock));
+         epoch_exit();
+         errno = ENOENT;
+         return OP_FAILURE;
+      }
+      //check if the file is opened by the client
+      err = openers_has(&file->openers, client);
       //the file has not been opened by the client
       if (err == 0) {
-         //release the lock over the file and the whole structure
+         //release the lock over the file and leave the section
          CHECK_NZ_RET(err, unlock_for_reading(file->lock));
-         CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+         epoch_exit();
          errno = EACCES;
          return OP_FAILURE;
       }else{
          //the file is opened by the client
          //the client is not the owner of the lock over the file, return
          if (client != file->locker){
-            //release the lock over the file and the whole structure
+            //release the lock over the file and leave the section
             CHECK_NZ_RET(err, unlock_for_reading(file->lock));
-            CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+            epoch_exit();
             errno = EPERM;
             return OP_FAILURE;
          }
          //release the reading lock and acquire the writing lock over the file
          CHECK_NZ_RET(err, unlock_for_reading(file->lock));
          CHECK_NZ_RET(err, lock_for_writing(file->lock));
-         //the client is not the owner of the lock
-         file->locker = 0;
-         //no writing permission over the file
-         file->writer = 0;
+         //the file has left the cache while the lock was released, return
+         if (file->removed){
+            CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+            epoch_exit();
+            errno = ENOENT;
+            return OP_FAILURE;
+         }
+         //the lock goes to the first client waiting for it, if any, without writing permissions
+         CHECK_NZ_RET(err, lock_handoff(cache, file));
          //update usage information
-         file->last_recen = time(NULL);
-         file->least_freq++;
-         //release the lock over the file and the whole structure
+         CHECK_NZ_RET(err, policy_touch(shard, file, false));
+         //release the lock over the file and leave the section
          CHECK_NZ_RET(err, unlock_for_writing(file->lock));
-         CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+         epoch_exit();
       }
    }
    return OP_SUCCESS;
@@ -1025,33 +4072,43 @@ int cache_closeFile(cache_t* cache, const char* file_path, int client){
       errno = EINVAL;
       return OP_FAILURE;
    }
+   size_t hash = intern_hash_str(file_path);
+   shard_t* shard = cache_get_shard(cache, hash);
 
-   int err, created;
+   int err;
+   bool held;
    cache_file_t* file;
-   char client_str[SIZE_LEN];
-   snprintf(client_str, SIZE_LEN, "%d", client);
-   //acquire the lock over the whole structure
-   CHECK_NZ_RET(err, lock_for_reading(cache->lock));
-   //unable to check if the file is in the cache
-   CHECK_FAIL_RET(created, table_is_in(cache->files, (void*) file_path));
+   //the file is looked up without locking the whole structure
+   if (epoch_enter() != 0) return OP_EXIT_FATAL;
+   //NULL if the file is not inside the cache
+   file = index_find(shard, file_path, hash);
    //the file is not inside the cache, return
-   if (created == 0){
-      //release the lock over the file
-      CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+   if (!file){
+      //leave the section
+      epoch_exit();
+      //the file has been evicted, the client holds it no longer
+      session_drop(cache, client, file_path, hash);
       errno = ENOENT;
       return OP_FAILURE;
    }else{
       //the file is inside the cache
-      CHECK_NULL_RET(file, (cache_file_t*) table_get_value(cache->files, (void*) file_path));
       //acquire the lock over the file
       CHECK_NZ_RET(err, lock_for_reading(file->lock));
-      //unable to check if the client has opened the file, return
-      CHECK_FAIL_RET(err, list_is_in(file->openers, client_str));
+      //the file has been evicted since it was found, the client holds it no longer
+      if (file->removed){
+         CHECK_NZ_RET(err, unlock_for_reading(file->lock));
+         epoch_exit();
+         session_drop(cache, client, file_path, hash);
+         errno = ENOENT;
+         return OP_FAILURE;
+      }
+      //check if the client has opened the file
+      err = openers_has(&file->openers, client);
       //the file has not been opened by the client, return
       if (err == 0) {
-         //release the lock over the file and the whole structure
+         //release the lock over the file and leave the section
          CHECK_NZ_RET(err, unlock_for_reading((file->lock)));
-         CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+         epoch_exit();
          errno = EACCES;
          return OP_FAILURE;
       }else{
@@ -1059,19 +4116,29 @@ int cache_closeFile(cache_t* cache, const char* file_path, int client){
          //release the reading lock and acquire the writing lock over the file
          CHECK_NZ_RET(err, unlock_for_reading((file->lock)));
          CHECK_NZ_RET(err, lock_for_writing(file->lock));
+         //the file has been evicted while the lock was released
+         if (file->removed){
+            CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+            epoch_exit();
+            session_drop(cache, client, file_path, hash);
+            errno = ENOENT;
+            return OP_FAILURE;
+         }
          //remove the client from the list of owners of the file
-         CHECK_NZ_RET(err, list_remove(file->openers, client_str));
+         openers_remove(&file->openers, client);
+         held = file->locker == client;
          //no writing permissions over the file
          file->writer = 0;
          //update usage information
-         file->last_recen = time(NULL);
-         file->least_freq++;
+         CHECK_NZ_RET(err, policy_touch(shard, file, false));
          //release the lock over the file
          CHECK_NZ_RET(err, unlock_for_writing(file->lock));
       }
    }
-   //release the lock over the whole structure
-   CHECK_NZ_RET(err, unlock_for_reading(cache->lock));
+   //leave the section
+   epoch_exit();
+   //a file closed but still locked is released if the client leaves
+   if (!held) session_drop(cache, client, file_path, hash);
    return OP_SUCCESS;
 }
 
@@ -1080,51 +4147,149 @@ int cache_removeFile(cache_t* cache, const char* file_path, int client){
       errno = EINVAL;
       return OP_FAILURE;
    }
+   size_t hash = intern_hash_str(file_path);
+   shard_t* shard = cache_get_shard(cache, hash);
    int err;
-   int created;
+   size_t freed;
    cache_file_t* file;
-   char client_str[SIZE_LEN];
-   snprintf(client_str, SIZE_LEN, "%d", client);
    //acquire the lock over the whole structure
-   CHECK_NZ_RET(err, lock_for_writing(cache->lock));
-   //update the cache information
-   cache->files_reached = MAX(cache->files_reached, cache->files_num);
-   cache->size_reached = MAX(cache->size_reached, cache->cache_size);
-   //unable to check if the file is in the cache, return
-   CHECK_FAIL_RET(created, table_is_in(cache->files, (void*) file_path));
+   CHECK_NZ_RET(err, lock_for_writing(shard->lock));
+   //NULL if the file is not inside the cache
+   file = (cache_file_t*) table_find_hashed(shard->files, file_path, hash);
    //the file is not inside the cache
-   if (created == 0){
+   if (!file){
       //release the lock over the whole structure
-      CHECK_NZ_RET(err, unlock_for_writing(cache->lock));
+      CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
       errno = ENOENT;
       return OP_FAILURE;
    }else{
       //the file is inside the cache
-      CHECK_NULL_RET(file, (cache_file_t*) table_get_value(cache->files, (void*) file_path));
-      //unable to check if the file is opened by the client, return
-      CHECK_FAIL_RET(err, list_is_in(file->openers, client_str));
+      //acquire the lock over the file, readers not locking the shard may be using it
+      CHECK_NZ_RET(err, lock_for_writing(file->lock));
+      //check if the file is opened by the client
+      err = openers_has(&file->openers, client);
       //the file is not opened by the client, return
       if (err == 0){
-         //release the lock over the whole structure
-         CHECK_NZ_RET(err, unlock_for_writing(cache->lock));
+         //release the lock over the file and the whole structure
+         CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+         CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
          errno = EACCES;
          return OP_FAILURE;
       }
       //the lock over the file is not owned by the client, return
       if (file->locker != client){
-         //release the lock over the whole structure
-         CHECK_NZ_RET(err, unlock_for_writing(cache->lock));
+         //release the lock over the file and the whole structure
+         CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+         CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
          errno = EPERM;
          return OP_FAILURE;
       }
-      //remove the file from the cache
-      cache->cache_size -= file->contents_size;
-      cache->files_num--;
+      //remove the file from the cache, shared contents are given back with their last file.
+      //The readers that found it through the index see it gone once they lock it
+      file->removed = true;
+      shard->cache_size -= file_counted(file);
+      shard->files_num--;
+      CHECK_NZ_RET(err, file_release(cache, file, &freed));
+      CHECK_NZ_RET(err, budget_give(cache, 1, freed));
       //unable to remove due to failure, return
-      CHECK_FAIL_RET(err, table_remove(cache->files, (void*) file_path));
-      CHECK_FAIL_RET(err, list_remove(cache->names, file_path));
+      CHECK_NZ_RET(err, policy_remove(shard, file, false));
+      cache_reclaim(cache, file->contents);
+      file->contents = NULL;
+      //the clients waiting for the lock over the file are told it is gone
+      CHECK_NZ_RET(err, lock_fail_waiters(cache, file));
+      CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+      CHECK_NZ_RET(err, shard_drop_file(shard, file));
+      if (cache->wal) CHECK_NZ_RET(err, wal_log(cache->wal, WAL_REMOVE, file_path, NULL, 0));
+      //release the lock over the whole structure
+      CHECK_NZ_RET(err, unlock_for_writing(shard->lock));
+      session_drop(cache, client, file_path, hash);
+   }
+   return OP_SUCCESS;
+}
+
+int cache_closeConnection(cache_t* cache, int client){
+   if (!cache || client < 0){
+      errno = EINVAL;
+      return OP_FAILURE;
+   }
+   int err;
+   shard_t* shard;
+   cache_file_t* file;
+   session_t* session = NULL;
+   //the session is taken out of the table, a new client reusing the descriptor starts a new one
+   CHECK_NZ_RET(err, pthread_mutex_lock(&cache->sessions_mutex));
+   if ((size_t) client < cache->sessions_max){
+      session = cache->sessions[client];
+      cache->sessions[client] = NULL;
+   }
+   CHECK_NZ_RET(err, pthread_mutex_unlock(&cache->sessions_mutex));
+   if (!session) return OP_SUCCESS;
+   for (size_t i = 0; i < session->len; i++){
+      //the names are interned with their hash, the file is found by the address of its name
+      shard = cache_get_shard(cache, intern_hash(session->names[i]));
+      //acquire the lock over the whole structure
+      CHECK_NZ_RET(err, lock_for_reading(shard->lock));
+      file = (cache_file_t*) table_find_hashed(shard->files, session->names[i], intern_hash(session->names[i]));
+      //the file may have been evicted since it was opened
+      if (file){
+         CHECK_NZ_RET(err, lock_for_writing(file->lock));
+         //the client leaves the openers, its lock and its writing permissions, its lock
+         //goes to the first client waiting for it
+         openers_remove(&file->openers, client);
+         if (file->writer == client) file->writer = 0;
+         if (file->locker == client) CHECK_NZ_RET(err, lock_handoff(cache, file));
+         CHECK_NZ_RET(err, unlock_for_writing(file->lock));
+      }
       //release the lock over the whole structure
-      CHECK_NZ_RET(err, unlock_for_writing(cache->lock));
+      CHECK_NZ_RET(err, unlock_for_reading(shard->lock));
    }
+   CHECK_NZ_RET(err, pthread_mutex_lock(&cache->sessions_mutex));
+   cache->sessions_closed++;
+   cache->sessions_released += session->len;
+   CHECK_NZ_RET(err, pthread_mutex_unlock(&cache->sessions_mutex));
+   session_free(session);
    return OP_SUCCESS;
 }
+
+int cache_lock_expire(cache_t* cache){
+   if (!cache){
+      errno = EINVAL;
+      return -1;
+   }
+   int err;
+   int expired = 0;
+   uint64_t now = clock_msec();
+   lock_waiter_t* next;
+   CHECK_NZ_RET(err, pthread_mutex_lock(&cache->waiters_mutex));
+   for (lock_waiter_t* waiter = cache->waiters; waiter; waiter = next){
+      next = waiter->all_next;
+      if (waiter->deadline == 0 || waiter->deadline > now) continue;
+      waiter_finish(cache, waiter, OP_FAILURE, ETIMEDOUT);
+      cache->lock_timeouts++;
+      expired++;
+   }
+   CHECK_NZ_RET(err, pthread_mutex_unlock(&cache->waiters_mutex));
+   return expired;
+}
+
+int cache_lock_reply(cache_t* cache, int* client, int* result, int* error){
+   if (!cache || !client || !result || !error){
+      errno = EINVAL;
+      return -1;
+   }
+   int err;
+   lock_waiter_t* waiter;
+   CHECK_NZ_RET(err, pthread_mutex_lock(&cache->waiters_mutex));
+   waiter = cache->replies_first;
+   if (waiter){
+      cache->replies_first = waiter->next;
+      if (!cache->replies_first) cache->replies_last = NULL;
+   }
+   CHECK_NZ_RET(err, pthread_mutex_unlock(&cache->waiters_mutex));
+   if (!waiter) return 0;
+   *client = waiter->client;
+   *result = waiter->result;
+   *error = waiter->error;
+   free(waiter);
+   return 1;
+}
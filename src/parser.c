@@ -14,13 +14,26 @@
 #include <defines.h>
 
 
-#define FIELDS 6
 #define WORKERS "NUMBER OF WORKER THREADS = "
 #define FILES_MAX "MAX NUMBER OF FILES ACCEPTED = "
 #define CACHE_SIZE "MAX CACHE SIZE = "
 #define SOCKET_PATH "SOCKET FILE PATH = "
 #define LOG_PATH "LOG FILE PATH = "
 #define POLICY "REPLACEMENT POLICY = "
+#define ADMISSION "ADMISSION FILTER = "
+#define SHARDS "NUMBER OF SHARDS = "
+#define COLD_AGE "COMPRESS FILES UNUSED FOR = "
+#define DEDUP "DEDUPLICATE CONTENTS = "
+#define SPILL_PATH "SPILL DIRECTORY PATH = "
+#define SPILL_SIZE "MAX SPILL SIZE = "
+#define SNAPSHOT_PATH "SNAPSHOT FILE PATH = "
+#define CHECKPOINT_PATH "CHECKPOINT FILE PATH = "
+#define CHECKPOINT_INTERVAL "CHECKPOINT INTERVAL = "
+#define WAL_PATH "WAL FILE PATH = "
+#define WAL_DELAY "WAL MAX DELAY = "
+#define EVICT_LOW "EVICTION LOW WATERMARK = "
+#define EVICT_HIGH "EVICTION HIGH WATERMARK = "
+#define RECLAIM "FREE CONTENTS IN BACKGROUND = "
 
 #define CHECK_LIMIT(x,label) \
 if((x)==ULONG_MAX  && errno == ERANGE){ \
@@ -34,6 +47,20 @@ struct _parser{
 	char socket_path[PATH_LEN_MAX];
 	char log_path[PATH_LEN_MAX];
 	policy_t policy;
+	bool admission;
+	unsigned long shards;
+	unsigned long cold_age;
+	bool dedup;
+	char spill_path[PATH_LEN_MAX];
+	unsigned long spill_size;
+	char snapshot_path[PATH_LEN_MAX];
+	char checkpoint_path[PATH_LEN_MAX];
+	unsigned long checkpoint_interval;
+	char wal_path[PATH_LEN_MAX];
+	unsigned long wal_delay;
+	unsigned long evict_low;
+	unsigned long evict_high;
+	bool reclaim;
 };
 
 parser_t* parser_create(){
@@ -47,6 +74,21 @@ parser_t* parser_create(){
 	parser->cache_size = 0;
 	memset(parser->socket_path, 0, PATH_LEN_MAX);
 	memset(parser->log_path, 0, PATH_LEN_MAX);
+	parser->policy = FIFO;
+	parser->admission = false;
+	parser->shards = 1;
+	parser->cold_age = 0;
+	parser->dedup = false;
+	memset(parser->spill_path, 0, PATH_LEN_MAX);
+	parser->spill_size = 0;
+	memset(parser->snapshot_path, 0, PATH_LEN_MAX);
+	memset(parser->checkpoint_path, 0, PATH_LEN_MAX);
+	parser->checkpoint_interval = 0;
+	memset(parser->wal_path, 0, PATH_LEN_MAX);
+	parser->wal_delay = 0;
+	parser->evict_low = 0;
+	parser->evict_high = 0;
+	parser->reclaim = false;
 
 	return parser;
 }
@@ -74,12 +116,27 @@ int parser_update(parser_t* parser, const char* config_file_path){
    bool socket_set = false;
    bool log_set = false;
    bool pol_set = false;
+   bool admission_set = false;
+   bool shards_set = false;
+   bool cold_age_set = false;
+   bool dedup_set = false;
+   bool spill_path_set = false;
+   bool spill_size_set = false;
+   bool snapshot_path_set = false;
+   bool checkpoint_path_set = false;
+   bool checkpoint_interval_set = false;
+   bool wal_path_set = false;
+   bool wal_delay_set = false;
+   bool evict_low_set = false;
+   bool evict_high_set = false;
+   bool reclaim_set = false;
 	unsigned long new;
 
-	for (size_t i = 0;i < FIELDS;i++){
+	while (true){
       //read each line of the config file
 		line = fgets(buffer, BUF_LEN_MAX, config_file);
 		if (!line && !feof(config_file)) return -1;
+		if (!line) break;
       //get number of workers
       if (strncmp(buffer, WORKERS, strlen(WORKERS)) == 0){
          //checking that the number of workers has not been
@@ -146,12 +203,157 @@ int parser_update(parser_t* parser, const char* config_file_path){
 			else goto failure;
 		   //get the replacement policy from config file
 			new = strtoul(buffer + strlen(POLICY), NULL, 10);
-         //the replacement policy only goes from 0 to 2,
+         //the replacement policy only goes from 0 (FIFO) to 5 (GDSF),
          //overflow impossible
-			if (new <= 2){
+			if (new <= GDSF){
 				parser->policy = new;
 			}else {
             goto failure;
+         }
+		}else if (strncmp(buffer, ADMISSION, strlen(ADMISSION)) == 0){
+         //checking that the admission filter has not been
+         //set more than once on the config file
+			if (!admission_set) admission_set = true;
+			else goto failure;
+		   //the admission filter is either off (0) or on (1)
+			new = strtoul(buffer + strlen(ADMISSION), NULL, 10);
+			if (new <= 1){
+				parser->admission = new;
+			}else {
+            goto failure;
+         }
+		}else if (strncmp(buffer, SHARDS, strlen(SHARDS)) == 0){
+         //checking that the number of shards has not been
+         //set more than once on the config file
+			if (!shards_set) shards_set = true;
+			else goto failure;
+		   //get the number of shards from config file, there is at least one
+			new = strtoul(buffer + strlen(SHARDS), NULL, 10);
+			if (new != 0){
+            //check for overflow
+            CHECK_LIMIT(new,failure);
+				parser->shards = new;
+			}else {
+            goto failure;
+         }
+		}else if (strncmp(buffer, COLD_AGE, strlen(COLD_AGE)) == 0){
+         //checking that the compression of cold files has not been
+         //set more than once on the config file
+			if (!cold_age_set) cold_age_set = true;
+			else goto failure;
+		   //get the seconds a file must stay unused before being compressed,
+		   //0 if files are never compressed
+			new = strtoul(buffer + strlen(COLD_AGE), NULL, 10);
+         //check for overflow
+         CHECK_LIMIT(new,failure);
+			parser->cold_age = new;
+		}else if (strncmp(buffer, DEDUP, strlen(DEDUP)) == 0){
+         //checking that the deduplication of contents has not been
+         //set more than once on the config file
+			if (!dedup_set) dedup_set = true;
+			else goto failure;
+		   //the deduplication of contents is either off (0) or on (1)
+			new = strtoul(buffer + strlen(DEDUP), NULL, 10);
+			if (new <= 1){
+				parser->dedup = new;
+			}else {
+            goto failure;
+         }
+		}else if (strncmp(buffer, SPILL_PATH, strlen(SPILL_PATH)) == 0){
+         //checking that the spill directory path has not been
+         //set more than once on the config file
+			if (!spill_path_set) spill_path_set = true;
+			else goto failure;
+		   //get the spill directory path from config file
+			strncpy(parser->spill_path, buffer + strlen(SPILL_PATH), PATH_LEN_MAX - 1);
+			parser->spill_path[strcspn(parser->spill_path, "\n")] = '\0';
+		}else if (strncmp(buffer, SPILL_SIZE, strlen(SPILL_SIZE)) == 0){
+         //checking that the spill size has not been
+         //set more than once on the config file
+			if (!spill_size_set) spill_size_set = true;
+			else goto failure;
+		   //get the max size of the spill directory from config file
+			new = strtoul(buffer + strlen(SPILL_SIZE), NULL, 10);
+			if (new != 0){
+            //check for overflow
+            CHECK_LIMIT(new,failure);
+				parser->spill_size = new;
+			}else {
+            goto failure;
+         }
+		}else if (strncmp(buffer, SNAPSHOT_PATH, strlen(SNAPSHOT_PATH)) == 0){
+         //checking that the snapshot file path has not been
+         //set more than once on the config file
+			if (!snapshot_path_set) snapshot_path_set = true;
+			else goto failure;
+		   //get the snapshot file path from config file
+			strncpy(parser->snapshot_path, buffer + strlen(SNAPSHOT_PATH), PATH_LEN_MAX - 1);
+			parser->snapshot_path[strcspn(parser->snapshot_path, "\n")] = '\0';
+		}else if (strncmp(buffer, CHECKPOINT_PATH, strlen(CHECKPOINT_PATH)) == 0){
+         //checking that the checkpoint file path has not been
+         //set more than once on the config file
+			if (!checkpoint_path_set) checkpoint_path_set = true;
+			else goto failure;
+		   //get the checkpoint file path from config file
+			strncpy(parser->checkpoint_path, buffer + strlen(CHECKPOINT_PATH), PATH_LEN_MAX - 1);
+			parser->checkpoint_path[strcspn(parser->checkpoint_path, "\n")] = '\0';
+		}else if (strncmp(buffer, CHECKPOINT_INTERVAL, strlen(CHECKPOINT_INTERVAL)) == 0){
+         //checking that the checkpoint interval has not been
+         //set more than once on the config file
+			if (!checkpoint_interval_set) checkpoint_interval_set = true;
+			else goto failure;
+		   //get the seconds between two checkpoints, 0 if they are only written on request
+			new = strtoul(buffer + strlen(CHECKPOINT_INTERVAL), NULL, 10);
+         //check for overflow
+         CHECK_LIMIT(new,failure);
+			parser->checkpoint_interval = new;
+		}else if (strncmp(buffer, WAL_PATH, strlen(WAL_PATH)) == 0){
+         //checking that the write-ahead log path has not been
+         //set more than once on the config file
+			if (!wal_path_set) wal_path_set = true;
+			else goto failure;
+		   //get the write-ahead log path from config file
+			strncpy(parser->wal_path, buffer + strlen(WAL_PATH), PATH_LEN_MAX - 1);
+			parser->wal_path[strcspn(parser->wal_path, "\n")] = '\0';
+		}else if (strncmp(buffer, WAL_DELAY, strlen(WAL_DELAY)) == 0){
+         //checking that the write-ahead log delay has not been
+         //set more than once on the config file
+			if (!wal_delay_set) wal_delay_set = true;
+			else goto failure;
+		   //get the microseconds a commit of the log waits for more changes
+			new = strtoul(buffer + strlen(WAL_DELAY), NULL, 10);
+         //check for overflow
+         CHECK_LIMIT(new,failure);
+			parser->wal_delay = new;
+		}else if (strncmp(buffer, EVICT_LOW, strlen(EVICT_LOW)) == 0){
+         //checking that the low watermark has not been
+         //set more than once on the config file
+			if (!evict_low_set) evict_low_set = true;
+			else goto failure;
+		   //get the percentage of the max size the files are evicted down to
+			new = strtoul(buffer + strlen(EVICT_LOW), NULL, 10);
+			if (new > 100) goto failure;
+			parser->evict_low = new;
+		}else if (strncmp(buffer, EVICT_HIGH, strlen(EVICT_HIGH)) == 0){
+         //checking that the high watermark has not been
+         //set more than once on the config file
+			if (!evict_high_set) evict_high_set = true;
+			else goto failure;
+		   //get the percentage of the max size the files are evicted above
+			new = strtoul(buffer + strlen(EVICT_HIGH), NULL, 10);
+			if (new > 100) goto failure;
+			parser->evict_high = new;
+		}else if (strncmp(buffer, RECLAIM, strlen(RECLAIM)) == 0){
+         //checking that the freeing of contents in background has not been
+         //set more than once on the config file
+			if (!reclaim_set) reclaim_set = true;
+			else goto failure;
+		   //the freeing of contents in background is either off (0) or on (1)
+			new = strtoul(buffer + strlen(RECLAIM), NULL, 10);
+			if (new <= 1){
+				parser->reclaim = new;
+			}else {
+            goto failure;
          }
 		}
 	}
@@ -233,6 +435,158 @@ policy_t parser_get_policy(const parser_t* parser){
 	return parser->policy;
 }
 
+bool parser_get_admission(const parser_t* parser){
+	if (!parser){
+		errno = EINVAL;
+		return false;
+	}
+	return parser->admission;
+}
+
+unsigned long parser_get_shards(const parser_t* parser){
+	if (!parser){
+		errno = EINVAL;
+		return 1;
+	}
+	return parser->shards;
+}
+
+unsigned long parser_get_cold_age(const parser_t* parser){
+	if (!parser){
+		errno = EINVAL;
+		return 0;
+	}
+	return parser->cold_age;
+}
+
+bool parser_get_dedup(const parser_t* parser){
+	if (!parser){
+		errno = EINVAL;
+		return false;
+	}
+	return parser->dedup;
+}
+
+unsigned long parser_get_spill_path(const parser_t* parser, char** spill_path_ptr){
+	if (!parser || !spill_path_ptr){
+		errno = EINVAL;
+		return 0;
+	}
+	*spill_path_ptr = NULL;
+	//no spill directory has been set
+	if (parser->spill_path[0] == '\0') return 0;
+	char* new = malloc(sizeof(char) * PATH_LEN_MAX);
+	if (!new){
+		errno = ENOMEM;
+		return 0;
+	}
+	strncpy(new, parser->spill_path, PATH_LEN_MAX);
+	*spill_path_ptr = new;
+	return strlen(new);
+}
+
+unsigned long parser_get_spill_size(const parser_t* parser){
+	if (!parser){
+		errno = EINVAL;
+		return 0;
+	}
+	return parser->spill_size;
+}
+
+unsigned long parser_get_snapshot_path(const parser_t* parser, char** snapshot_path_ptr){
+	if (!parser || !snapshot_path_ptr){
+		errno = EINVAL;
+		return 0;
+	}
+	*snapshot_path_ptr = NULL;
+	//no snapshot file has been set
+	if (parser->snapshot_path[0] == '\0') return 0;
+	char* new = malloc(sizeof(char) * PATH_LEN_MAX);
+	if (!new){
+		errno = ENOMEM;
+		return 0;
+	}
+	strncpy(new, parser->snapshot_path, PATH_LEN_MAX);
+	*snapshot_path_ptr = new;
+	return strlen(new);
+}
+
+unsigned long parser_get_checkpoint_path(const parser_t* parser, char** checkpoint_path_ptr){
+	if (!parser || !checkpoint_path_ptr){
+		errno = EINVAL;
+		return 0;
+	}
+	*checkpoint_path_ptr = NULL;
+	//no checkpoint file has been set
+	if (parser->checkpoint_path[0] == '\0') return 0;
+	char* new = malloc(sizeof(char) * PATH_LEN_MAX);
+	if (!new){
+		errno = ENOMEM;
+		return 0;
+	}
+	strncpy(new, parser->checkpoint_path, PATH_LEN_MAX);
+	*checkpoint_path_ptr = new;
+	return strlen(new);
+}
+
+unsigned long parser_get_checkpoint_interval(const parser_t* parser){
+	if (!parser){
+		errno = EINVAL;
+		return 0;
+	}
+	return parser->checkpoint_interval;
+}
+
+unsigned long parser_get_wal_path(const parser_t* parser, char** wal_path_ptr){
+	if (!parser || !wal_path_ptr){
+		errno = EINVAL;
+		return 0;
+	}
+	*wal_path_ptr = NULL;
+	//no write-ahead log has been set
+	if (parser->wal_path[0] == '\0') return 0;
+	char* new = malloc(sizeof(char) * PATH_LEN_MAX);
+	if (!new){
+		errno = ENOMEM;
+		return 0;
+	}
+	strncpy(new, parser->wal_path, PATH_LEN_MAX);
+	*wal_path_ptr = new;
+	return strlen(new);
+}
+
+unsigned long parser_get_wal_delay(const parser_t* parser){
+	if (!parser){
+		errno = EINVAL;
+		return 0;
+	}
+	return parser->wal_delay;
+}
+
+unsigned long parser_get_evict_low(const parser_t* parser){
+	if (!parser){
+		errno = EINVAL;
+		return 0;
+	}
+	return parser->evict_low;
+}
+
+unsigned long parser_get_evict_high(const parser_t* parser){
+	if (!parser){
+		errno = EINVAL;
+		return 0;
+	}
+	return parser->evict_high;
+}
+
+bool parser_get_reclaim(const parser_t* parser){
+	if (!parser){
+		errno = EINVAL;
+		return false;
+	}
+	return parser->reclaim;
+}
+
 void parser_free(parser_t* parser){
 	free(parser);
 }
@@ -21,12 +21,15 @@
 #include <utilities.h>
 #include <error_handlers.h>
 #include <worker.h>
+#include <slab.h>
+#include <epoch.h>
 
 #define CONN_MAX 10
 #define TASKS_MAX 4096
 
 volatile sig_atomic_t terminate = 0; // toggled on when server should terminate as soon as possible
 volatile sig_atomic_t refuse_new = 0; // toggled on when server must not accept any other client
+volatile sig_atomic_t checkpoint_now = 0; // toggled on when a checkpoint of the cache is requested
 
 /**
  * @brief used to handle signals.
@@ -68,8 +71,19 @@ int main(int argc, char* argv[]){
    struct timeval timeout_master = { 0, 100000 };
    struct timeval timeout_cpy;
    char* log_name = NULL;
+   char* spill_name = NULL;
+   char* snapshot_name = NULL;
+   char* checkpoint_name = NULL;
+   char* wal_name = NULL;
+   time_t checkpoint_interval = 0;
+   time_t checkpoint_last = 0;
    FILE* log_file = NULL;
    size_t online = 0; // clients online now
+   //replies to the clients whose wait for a lock is over
+   int lock_client;
+   int lock_result;
+   int lock_errno;
+   char lock_buf[ERRNO_LEN_MAX];
    size_t i = 0;
 
    //signal handling
@@ -79,6 +93,7 @@ int main(int argc, char* argv[]){
    sigaddset(&sigset, SIGINT);
    sigaddset(&sigset, SIGHUP);
    sigaddset(&sigset, SIGQUIT);
+   sigaddset(&sigset, SIGUSR1);
    sig_action.sa_mask = sigset;
 
    // SIGPIPE is ignored
@@ -129,13 +144,49 @@ int main(int argc, char* argv[]){
       goto failure;
    }
 
+   // getting the spill directory path from the config file, if evicted files are spilled
+   errno = 0;
+   if (parser_get_spill_path(config, &spill_name) == 0 && errno == ENOMEM){
+      perror("parser_get_spill_path");
+      goto failure;
+   }
+   // getting the write-ahead log path from the config file, if changes are logged
+   errno = 0;
+   if (parser_get_wal_path(config, &wal_name) == 0 && errno == ENOMEM){
+      perror("parser_get_wal_path");
+      goto failure;
+   }
    // creating the cache with the details read from the config file
    cache = cache_create((size_t) parser_get_files(config), (size_t) parser_get_size(config),
-                        parser_get_policy(config));
+                        parser_get_policy(config), parser_get_admission(config),
+                        (size_t) parser_get_shards(config), (time_t) parser_get_cold_age(config),
+                        parser_get_dedup(config), spill_name, (size_t) parser_get_spill_size(config),
+                        wal_name, parser_get_wal_delay(config), (unsigned int) parser_get_evict_low(config),
+                        (unsigned int) parser_get_evict_high(config), parser_get_reclaim(config));
    if (!cache){
       perror("cache_create");
       goto failure;
    }
+   // loading the files saved at the last shutdown, the server starts empty if there are none
+   errno = 0;
+   if (parser_get_snapshot_path(config, &snapshot_name) == 0 && errno == ENOMEM){
+      perror("parser_get_snapshot_path");
+      goto failure;
+   }
+   if (snapshot_name && cache_load(cache, snapshot_name) == -1 && errno != ENOENT) perror("cache_load");
+   // replaying the changes logged after the snapshot
+   if (cache_recover(cache) == -1){
+      perror("cache_recover");
+      goto failure;
+   }
+   // getting the checkpoint file path and interval from the config file
+   errno = 0;
+   if (parser_get_checkpoint_path(config, &checkpoint_name) == 0 && errno == ENOMEM){
+      perror("parser_get_checkpoint_path");
+      goto failure;
+   }
+   checkpoint_interval = (time_t) parser_get_checkpoint_interval(config);
+   checkpoint_last = time(NULL);
 
    // creating the buffer holding the tasks
    tasks = buffer_create(TASKS_MAX);
@@ -198,6 +249,38 @@ int main(int argc, char* argv[]){
       if (terminate) goto cleanup;
       //soft exit
       if (online == 0 && refuse_new) goto cleanup;
+      //write a checkpoint on request or once the interval has passed, the last one must be finished
+      if (checkpoint_name){
+         CHECK_FAIL_EXIT(err, cache_checkpoint_wait(cache, false), cache_checkpoint_wait);
+         if (err == 1) LOG_EVENT("Checkpoint to %s finished.\n", checkpoint_name);
+         if (checkpoint_now || (checkpoint_interval && time(NULL) - checkpoint_last >= checkpoint_interval)){
+            checkpoint_now = 0;
+            checkpoint_last = time(NULL);
+            //the log is compacted only by the checkpoints loaded at startup
+            err = cache_checkpoint(cache, checkpoint_name,
+                                   snapshot_name && strcmp(checkpoint_name, snapshot_name) == 0);
+            if (err == -1) perror("cache_checkpoint");
+         }
+      }
+
+      //replying to the clients whose wait for a lock is over, the timed out ones included,
+      //and listening to them again
+      CHECK_FAIL_EXIT(err, cache_lock_expire(cache), cache_lock_expire);
+      while (true){
+         CHECK_FAIL_EXIT(err, cache_lock_reply(cache, &lock_client, &lock_result, &lock_errno), cache_lock_reply);
+         if (err == 0) break;
+         memset(lock_buf, 0, ERRNO_LEN_MAX);
+         snprintf(lock_buf, ERRNO_LEN_MAX, "%d", lock_result);
+         //a client gone while waiting is noticed once it is listened to again
+         if (writen((long) lock_client, (void*) lock_buf, strlen(lock_buf) + 1) != -1 && lock_result != OP_SUCCESS){
+            memset(lock_buf, 0, ERRNO_LEN_MAX);
+            snprintf(lock_buf, ERRNO_LEN_MAX, "%d", lock_errno);
+            writen((long) lock_client, (void*) lock_buf, ERRNO_LEN_MAX);
+         }
+         LOG_EVENT("lockFile after waiting, client %d : %d.\n", lock_client, lock_result);
+         FD_SET(lock_client, &master_read);
+         fd_num = MAX(lock_client, fd_num);
+      }
 
       // reinitialise the read set
       read_cpy = master_read;
@@ -275,8 +358,15 @@ int main(int argc, char* argv[]){
    //write results to log file
    LOG_EVENT("Max size reached by the file storage cache: %3f.\n", cache_get_size_max(cache) * MBYTE);
    LOG_EVENT("Max number of files stored inside the server: %lu.\n", cache_get_files_max(cache));
-   //print the contents of the cache
+   LOG_EVENT("Hit ratio: %5f.\n", cache_get_hit_ratio(cache));
+   LOG_EVENT("Byte hit ratio: %5f.\n", cache_get_byte_hit_ratio(cache));
+   //wait for the last checkpoint and print the contents of the cache
+   cache_checkpoint_wait(cache, true);
    cache_print(cache);
+   //save the files inside the cache for the next startup
+   if (snapshot_name && cache_save(cache, snapshot_name) == -1) perror("cache_save");
+   epoch_print(stdout);
+   slab_print(stdout);
    //free allocated resources and close
    cache_free(cache);
    parser_free(config);
@@ -285,6 +375,10 @@ int main(int argc, char* argv[]){
       unlink(sockname);
       free(sockname); }
    free(log_name);
+   free(spill_name);
+   free(snapshot_name);
+   free(checkpoint_name);
+   free(wal_name);
    free(worker);
    free(workers);
    if (pipe_tgl) {
@@ -317,6 +411,10 @@ int main(int argc, char* argv[]){
       close(fd_pipe[1]); 
    }
    free(log_name);
+   free(spill_name);
+   free(snapshot_name);
+   free(checkpoint_name);
+   free(wal_name);
    free(worker);
    exit(EXIT_FAILURE);
 }
@@ -340,6 +438,10 @@ static void* handle_signal(void* sigs){
          case SIGHUP:
             refuse_new = 1;
             return NULL;
+         // writing a checkpoint of the cache in the background
+         case SIGUSR1:
+            checkpoint_now = 1;
+            break;
          default:
             break;
       }
@@ -14,6 +14,7 @@
 #include <error_handlers.h>
 #include <worker.h>
 #include <cache.h>
+#include <blob.h>
 
 /**
  * @brief notifies via pipe of the completion of a task.
@@ -26,6 +27,8 @@ do{ \
 	break; \
 }while(0);
 
+#define IOV_BATCH 64 // chunks of a blob written to a socket with a single call
+
 
 struct _worker{
    cache_t* cache;
@@ -53,6 +56,23 @@ worker_t *worker_create(cache_t *cache, bounded_buffer_t *tasks, int pipe, FILE
    return worker;
 }
 
+/**
+ * @brief writes the contents of a blob to a file descriptor, walking its chunks
+ * with vectored I/O instead of copying them into a single buffer.
+ * @returns 0 on success, -1 on failure.
+*/
+static int write_blob(long fd, const blob_t* blob){
+   struct iovec iov[IOV_BATCH];
+   size_t first = 0;
+   size_t num;
+   if (!blob) return 0;
+   while ((num = blob_get_chunks(blob, iov, first, IOV_BATCH)) != 0){
+      if (writevn(fd, iov, (int) num) == -1) return -1;
+      first += num;
+   }
+   return 0;
+}
+
 void* do_job(void* wkr){
    //setting up declarations for processing tasks
    char* req;
@@ -79,21 +99,24 @@ void* do_job(void* wkr){
    //setting up declarations for handling the cache
    linked_list_t* evicted = NULL;
    char* evicted_name = NULL;
-   char* evicted_content = NULL;
+   blob_t** evicted_content = NULL;
+   blob_t* evicted_blob = NULL;
    size_t evicted_size = 0;
-   void* read_buf;
+   blob_t* read_blob;
    size_t read_size;
    int flags = 0;
    size_t N = 0;
    linked_list_t* read_files = NULL;
    char* read_file_name = NULL;
-   char* read_file_content = NULL;
+   blob_t** read_file_content = NULL;
+   blob_t* read_file_blob = NULL;
    size_t read_file_size = 0;
    size_t tot_read_size = 0;
    void* append_buf = NULL;
    size_t append_size = 0;
    size_t write_size = 0;
    char* write_contents = NULL;
+   long lock_timeout = 0;
 
    //enters an infinite loop and processes tasks received via buffer, one at a time
    while(true){
@@ -108,6 +131,8 @@ void* do_job(void* wkr){
       memset(req, 0, TASK_LEN_MAX);
       //trying to read a request
       CHECK_FAIL_EXIT(err, readn((long) fd_ready, (void*) req, REQ_LEN_MAX), readn);
+      //a client closing the connection without a request leaves as if it had asked to
+      if (err == 0) snprintf(req, REQ_LEN_MAX, "%d", SHUTDOWN);
       new_req = req;
       // gets a token string from the request and saves it to save_ptr
       token = strtok_r(new_req, " ", &save_ptr);
@@ -152,7 +177,7 @@ void* do_job(void* wkr){
             NOTIFY_DONE;
             break;
          case READ:
-            read_buf = NULL;
+            read_blob = NULL;
             read_size = 0;
             //reading the file_path
             memset(file_path, 0, REQ_LEN_MAX);
@@ -163,10 +188,11 @@ void* do_job(void* wkr){
             CHECK_NULL_EXIT(token, strtok_r(NULL, " ", &save_ptr), strtok_r);
             CHECK_NEQ_EXIT(err, 1, sscanf(token, "%d", &flags), sscanf);
             if (flags == SAVE){
-               //reading the file located at <file_path> as per
-               //client's request and saving it to read_buf
-               err = cache_readFile(cache, file_path, &read_buf, &read_size, fd_ready);
+               //reading the file located at <file_path> as per client's request,
+               //read_blob holds a reference to its contents instead of a copy
+               err = cache_readFile(cache, file_path, &read_blob, fd_ready);
                errno_cpy = errno;
+               read_size = read_blob ? blob_get_size(read_blob) : 0;
                //sending the return value of the operation to the
                //client's fd and logging the operation
                memset(req, 0, REQ_LEN_MAX);
@@ -189,16 +215,16 @@ void* do_job(void* wkr){
                CHECK_FAIL_EXIT(err, writen((long) fd_ready, (void*) msg_size, SIZE_LEN), writen);
                if (read_size != 0) {
                   //sending the file contents of the file to be saved
-                  CHECK_FAIL_EXIT(err, writen((long) fd_ready, read_buf, read_size), writen);
+                  CHECK_FAIL_EXIT(err, write_blob((long) fd_ready, read_blob), writev);
                }
-               //deallocating resources for the file just read and saved
-               free(read_buf);
-               read_buf = NULL;
+               //releasing the contents of the file just read and saved
+               blob_unref(read_blob);
+               read_blob = NULL;
             }else{
                //else flags==DISCARD, the file read will be discarded
                //reading the file located at <file_path> as per
                //client's request without saving it
-               err = cache_readFile(cache, file_path, NULL, NULL, fd_ready);
+               err = cache_readFile(cache, file_path, NULL, fd_ready);
                errno_cpy = errno;
                //sending the return value of the operation to the
                //client's fd and logging the operation
@@ -256,6 +282,9 @@ void* do_job(void* wkr){
                //getting the first read file from the list and saving its name and contents
                read_file_size = list_pop_from_front(read_files, &read_file_name, (void**) &read_file_content);
                if (read_file_size == 0 && errno == ENOMEM) exit(1);
+               //the list holds a reference to the contents of the file read
+               read_file_blob = read_file_content ? *read_file_content : NULL;
+               read_file_size = read_file_blob ? blob_get_size(read_file_blob) : 0;
                tot_read_size += read_file_size;
                memset(req, 0, REQ_LEN_MAX);
                snprintf(req, REQ_LEN_MAX, "%s", read_file_name);
@@ -265,12 +294,14 @@ void* do_job(void* wkr){
                memset(msg_size, 0, SIZE_LEN);
                snprintf(msg_size, SIZE_LEN, "%lu", read_file_size);
                CHECK_FAIL_EXIT(new_err, writen((long) fd_ready, (void*) msg_size, SIZE_LEN), writen);
-               CHECK_FAIL_EXIT(new_err, writen((long) fd_ready, (void*) read_file_content, read_file_size), writen);
+               CHECK_FAIL_EXIT(new_err, write_blob((long) fd_ready, read_file_blob), writev);
                //deallocating resources for the file just read
                free(read_file_name);
                read_file_name = NULL;
                free(read_file_content);
                read_file_content = NULL;
+               blob_unref(read_file_blob);
+               read_file_blob = NULL;
             }//log event
             LOG_EVENT("[%d] readNFiles %lu : %d. Bytes: %lu.\n", (int) pthread_self(), N, err, tot_read_size);
             //all read files are handled, deallocate resources
@@ -302,6 +333,8 @@ void* do_job(void* wkr){
             //client's request
             err = cache_writeFile(cache, file_path, write_size, write_contents, &evicted, fd_ready);
             errno_cpy = errno;
+            //the changes are on disk before being acknowledged
+            CHECK_FAIL_EXIT(new_err, cache_sync(cache), cache_sync);
             free(write_contents);
             //sending the return value of the operation to the
             //client's fd and logging the operation
@@ -330,6 +363,9 @@ void* do_job(void* wkr){
                //getting the first evicted file from the list and saving its name and contents
                evicted_size = list_pop_from_front(evicted, &evicted_name, (void**) &evicted_content);
                if (evicted_size == 0 && errno == ENOMEM) exit(1);
+               //the list holds a reference to the contents of the evicted file
+               evicted_blob = evicted_content ? *evicted_content : NULL;
+               evicted_size = evicted_blob ? blob_get_size(evicted_blob) : 0;
                //sending the return value of the operation to the
                //client's fd and logging the operation
                memset(req, 0, REQ_LEN_MAX);
@@ -340,12 +376,14 @@ void* do_job(void* wkr){
                memset(msg_size, 0, SIZE_LEN);
                snprintf(msg_size, SIZE_LEN, "%lu", evicted_size);
                CHECK_FAIL_EXIT(new_err, writen((long) fd_ready, (void*) msg_size, SIZE_LEN), writen);
-               CHECK_FAIL_EXIT(new_err, writen((long) fd_ready, (void*) evicted_content, evicted_size), writen);
+               CHECK_FAIL_EXIT(new_err, write_blob((long) fd_ready, evicted_blob), writev);
                //deallocating resources for the evicted file
                free(evicted_name);
                evicted_name = NULL;
                free(evicted_content);
                evicted_content = NULL;
+               blob_unref(evicted_blob);
+               evicted_blob = NULL;
             }//all evicted files are handled, deallocate resources
             list_free(evicted);
             evicted = NULL;
@@ -374,6 +412,8 @@ void* do_job(void* wkr){
             //client's request
             err = cache_appendToFile(cache, file_path, append_buf, append_size, &evicted, fd_ready);
             errno_cpy = errno;
+            //the changes are on disk before being acknowledged
+            CHECK_FAIL_EXIT(new_err, cache_sync(cache), cache_sync);
             //deallocating resources for the buffer
             free(append_buf);
             //sending the return value of the operation to the
@@ -403,6 +443,9 @@ void* do_job(void* wkr){
                //getting the first evicted file from the list and saving its name and contents
                evicted_size = list_pop_from_front(evicted, &evicted_name, (void**) &evicted_content);
                if (evicted_size == 0 && errno == ENOMEM) exit(1);
+               //the list holds a reference to the contents of the evicted file
+               evicted_blob = evicted_content ? *evicted_content : NULL;
+               evicted_size = evicted_blob ? blob_get_size(evicted_blob) : 0;
                memset(req, 0, REQ_LEN_MAX);
                snprintf(req, REQ_LEN_MAX, "%s", evicted_name);
                //sending the return value of the operation to the
@@ -412,12 +455,14 @@ void* do_job(void* wkr){
                memset(msg_size, 0, SIZE_LEN);
                snprintf(msg_size, SIZE_LEN, "%lu", evicted_size);
                CHECK_FAIL_EXIT(new_err, writen((long) fd_ready, (void*) msg_size, SIZE_LEN), writen);
-               CHECK_FAIL_EXIT(new_err, writen((long) fd_ready, (void*) evicted_content, evicted_size), writen);
+               CHECK_FAIL_EXIT(new_err, write_blob((long) fd_ready, evicted_blob), writev);
                //deallocating resources for the evicted file
                free(evicted_name);
                evicted_name = NULL;
                free(evicted_content);
                evicted_content = NULL;
+               blob_unref(evicted_blob);
+               evicted_blob = NULL;
             }//all evicted files are handled, deallocate resources
             list_free(evicted);
             evicted = NULL;
@@ -458,10 +503,20 @@ void* do_job(void* wkr){
             memset(file_path, 0, REQ_LEN_MAX);
             CHECK_NULL_EXIT(token, strtok_r(NULL, " ", &save_ptr), strtok_r);
             CHECK_NEQ_EXIT(err, 1, sscanf(token, "%s", file_path), sscanf);
+            //reading the milliseconds the client waits for the lock, if it has set them
+            lock_timeout = 0;
+            token = strtok_r(NULL, " ", &save_ptr);
+            if (token) CHECK_NEQ_EXIT(err, 1, sscanf(token, "%ld", &lock_timeout), sscanf);
             //locking the file located at <file_path> as per
             //client's request
-            err = cache_lockFile(cache, file_path, fd_ready);
+            err = cache_lockFile(cache, file_path, fd_ready, lock_timeout);
             errno_cpy = errno;
+            //the client waits for the lock, the server replies to it once the wait is over
+            //and only then listens to it again
+            if (err == OP_WAITING){
+               LOG_EVENT("[%d] lockFile %s %ld : waiting.\n", (int) pthread_self(), file_path, lock_timeout);
+               break;
+            }
             //sending the return value of the operation to the
             //client's fd and logging the operation
             memset(req, 0, REQ_LEN_MAX);
@@ -517,6 +572,8 @@ void* do_job(void* wkr){
             CHECK_NEQ_EXIT(err, 1, sscanf(token, "%s", file_path), sscanf);
             err = cache_removeFile(cache, file_path, fd_ready);
             errno_cpy = errno;
+            //the changes are on disk before being acknowledged
+            CHECK_FAIL_EXIT(new_err, cache_sync(cache), cache_sync);
             //removing the file located at <file_path> as per
             //client's request and logging the operation
             memset(req, 0, REQ_LEN_MAX);
@@ -538,6 +595,9 @@ void* do_job(void* wkr){
             NOTIFY_DONE;
             break;
          case SHUTDOWN:
+            //releasing the files held by the client before its descriptor can be reused
+            CHECK_FAIL_EXIT(err, cache_closeConnection(cache, fd_ready), cache_closeConnection);
+            CHECK_FAIL_EXIT(err, close(fd_ready), close);
             //sending the shutdown message via a buffer and logging the operation
             memset(pipe_buf, 0, PIPE_LEN_MAX);
             snprintf(pipe_buf, PIPE_LEN_MAX, "%d", SHUTDOWN_WORKER);
@@ -102,11 +102,17 @@ MAXSIZE_MBYTES=$(echo "${MAXSIZE_BYTES} * 0.000001" | bc -l)
 MAXFILES=$(grep "Max number" $LOG_FILE | grep -oE '[^ ]+$' | sed -e 's/\.//g')
 SUCCESS=$(grep " : 0\." -c $LOG_FILE)
 FAILURE=$(grep " : 1\." -c $LOG_FILE)
+REJECTED=$(grep "writeFile.* : 2\." -c $LOG_FILE)
+HITRATIO=$(grep "^Hit ratio" $LOG_FILE | grep -oE '[^ ]+$' | sed -e 's/\.$//g')
+BYTEHITRATIO=$(grep "^Byte hit ratio" $LOG_FILE | grep -oE '[^ ]+$' | sed -e 's/\.$//g')
 echo -e "Replacement algorithm was executed: ${EVICTED} time(s)."
 echo -e "Max size reached by the file storage cache: ${MAXSIZE_MBYTES}MBytes."
 echo -e "Max number of files stored inside the server: ${MAXFILES}."
+echo -e "Hit ratio: ${HITRATIO}."
+echo -e "Byte hit ratio: ${BYTEHITRATIO}."
 echo -e "Number of succesful operations: ${SUCCESS}"
 echo -e "Number of failed operations: ${FAILURE}"
+echo -e "Number of writes rejected by the admission filter: ${REJECTED}"
 
 echo -e "-${BOLD}REQUESTS HANDLED PER WORKER${RESET}-"
 # worker ids are inside []
@@ -0,0 +1,108 @@
+#!/bin/bash
+
+# throughput of the server against the number of worker threads, with the cache
+# made of a single shard and of as many shards as the maximum number of workers,
+# on a read-mostly load and against the max delay of the write-ahead log
+
+BLUE="\e[94m"
+YELLOW="\e[93m"
+BOLD="\e[1m"
+RESET="\e[0m"
+
+CLIENTS=8
+ROUNDS=20
+WORKERS=(1 2 4 8)
+SHARDS=(1 8)
+WAL_DELAYS=(0 500 2000)
+
+echo -e "${BOLD}\n--------------------STARTING BENCHMARK--------------------\n${RESET}"
+
+echo -e "Creating stub files, please wait..."
+# every client writes its own copy of the files, so that clients only contend
+# for the locks of the cache and not for the same files
+mkdir -p bench/stubs1
+for j in {1..40}; do
+	head -c 8KB /dev/urandom | tr -dc 'a-zA-Z0-9~!@#$%^&*_-' | fold > bench/stubs1/stub$j.txt
+done
+for i in $(seq 2 $CLIENTS); do
+	cp -r bench/stubs1 bench/stubs$i
+done
+
+# runs the clients against a server started with the config given, each one running its
+# rounds with the options given (CLIENT is replaced by its number, \$r by the round),
+# printing the throughput, the latency the write-ahead log has added to the writes and
+# the buckets of the lock-free index against the files left
+run(){
+	echo -e "$2" > bench/config.txt
+	build/server bench/config.txt > bench/server.out &
+	SERVER=$!
+	sleep 1s
+
+	START=$(date +%s.%N)
+	pids=()
+	for i in $(seq 1 $CLIENTS); do
+		bash -c "for r in \$(seq 1 ${ROUNDS}); do build/client -f bench/bench.sk ${3//CLIENT/$i}; done" > /dev/null 2>&1 &
+		pids+=($!)
+	done
+	for i in "${pids[@]}"; do
+		wait ${i}
+	done
+	END=$(date +%s.%N)
+
+	kill -2 ${SERVER}
+	wait ${SERVER}
+	# every request handled by a worker is logged with its outcome
+	OPS=$(grep -cE "^\[.*\] .* : -?[0-9]\." bench/bench.log)
+	ELAPSED=$(awk "BEGIN { printf \"%.3f\", ${END} - ${START} }")
+	THROUGHPUT=$(awk "BEGIN { printf \"%.1f\", ${OPS} / ${ELAPSED} }")
+	LATENCY=$(grep -oE "waiting for the log: [0-9.]+ ms" bench/server.out | grep -oE "[0-9.]+ ms")
+	BATCH=$(grep -oE "records per batch: [0-9.]+" bench/server.out | grep -oE "[0-9.]+$")
+	INDEX=$(grep -oE "Lock-free index: .*" bench/server.out | grep -oE "[0-9]+ bucket\(s\) for [0-9]+ file\(s\)")
+	echo -e "${YELLOW}$1${RESET}\trequests: ${OPS}\ttime: ${ELAPSED}s\tthroughput: ${THROUGHPUT} requests/s${LATENCY:+\tlatency added to writes: ${LATENCY}\tchanges per fsync: ${BATCH}}\tindex: ${INDEX}"
+	rm -rf bench/read* bench/wal.*
+}
+
+READS="-w bench/stubsCLIENT -R 20 -d bench/readCLIENT"
+
+BASE="MAX NUMBER OF FILES ACCEPTED = 200\nMAX CACHE SIZE = 1000000\nSOCKET FILE PATH = bench/bench.sk\nLOG FILE PATH = bench/bench.log\nREPLACEMENT POLICY = 1"
+
+for s in "${SHARDS[@]}"; do
+	echo -e "${BLUE}${s} shard(s)${RESET}"
+	for w in "${WORKERS[@]}"; do
+		run "workers: ${w}" "NUMBER OF WORKER THREADS = ${w}\n${BASE}\nNUMBER OF SHARDS = ${s}" "${READS}"
+	done
+done
+
+# read-mostly load: every client writes its files in its first round only, then each round
+# reads all of them four times by name; reads, locks and closes look the files up without
+# locking their shard
+FILES=$(ls bench/stubs1 | sed "s|^|${PWD}/bench/stubsCLIENT/|" | paste -sd, -)
+READ_MOSTLY="\$([ \$r = 1 ] && echo -w bench/stubsCLIENT)$(for k in 1 2 3 4; do echo -n " -r ${FILES}"; done)"
+s=${SHARDS[-1]}
+echo -e "${BLUE}read-mostly, ${s} shard(s)${RESET}"
+for w in "${WORKERS[@]}"; do
+	run "workers: ${w}" "NUMBER OF WORKER THREADS = ${w}\n${BASE}\nNUMBER OF SHARDS = ${s}" "${READ_MOSTLY}"
+done
+
+# the writes are acknowledged once their changes are on disk, the commits of the
+# changes made by different workers within the delay are grouped into one fsync;
+# every round writes new files, so that each write creates a file
+for i in $(seq 1 $CLIENTS); do
+	for r in $(seq 1 $ROUNDS); do
+		cp -r bench/stubs1 bench/stubs${i}_${r}
+	done
+done
+w=${WORKERS[-1]}
+WAL_BASE="NUMBER OF WORKER THREADS = ${w}\n${BASE/200/10000}"
+WRITES="-w bench/stubsCLIENT_\$r"
+echo -e "${BLUE}write-ahead log, ${w} workers${RESET}"
+run "no log" "${WAL_BASE}" "${WRITES}"
+for d in "${WAL_DELAYS[@]}"; do
+	run "delay: ${d}us" "${WAL_BASE}\nWAL FILE PATH = bench/wal\nWAL MAX DELAY = ${d}" "${WRITES}"
+done
+
+rm -rf bench
+
+echo -e "${BOLD}--------------------BENCHMARK HAS FINISHED--------------------\n${RESET}"
+
+exit 0
@@ -0,0 +1,325 @@
+/**
+ * @brief microbenchmark of the hash table holding the files of the cache, against the chained
+ * table it replaced. Each table gets the same paths and runs the operations the cache runs:
+ * inserts (checking the path first), lookups of paths inside and outside the table (checking
+ * the path, then getting its file) and removals. A table created empty is then filled and
+ * emptied again, timing each operation alone to find the slowest, as a single request pays for
+ * the slots it resizes. Last, the PJW and the seeded hash are compared on the same paths and on
+ * the files listing paths given as arguments, one per line (make table_bench lists the files
+ * under the project and the system headers with their absolute path, as the lsR of the client
+ * sends them).
+ *
+*/
+#define _POSIX_C_SOURCE 200112L
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <hash_table.h>
+#include <linked_list.h>
+
+#define LOOKUPS 200000 // lookups of each kind timed for every table
+#define FILE_SIZE 192 // size of the data of each key, about the size of the file of the cache
+#define PATH_LEN 128
+#define HASHES 4000000 // hashes timed for every hash function
+
+/**
+ * @brief the chained table used before, with a linked list for each bucket whose keys are
+ * copied out of the nodes to be compared. It is the baseline of the benchmark.
+*/
+typedef struct _chained{
+   size_t bucket_num;
+   linked_list_t** buckets;
+} chained_t;
+
+static size_t chained_hash(const char* datum){
+   size_t hash_value, i;
+   for (hash_value = 0; *datum; ++datum){
+      hash_value = (hash_value << 4) + *datum;
+      if ((i = hash_value & 0xF0000000u) != 0) hash_value = (hash_value ^ (i >> 24)) & ~0xF0000000u;
+   }
+   return hash_value;
+}
+
+static chained_t* chained_create(size_t bucket_num){
+   chained_t* table = malloc(sizeof(chained_t));
+   if (!table) return NULL;
+   table->bucket_num = bucket_num;
+   table->buckets = malloc(sizeof(linked_list_t*) * bucket_num);
+   if (!table->buckets) return NULL;
+   for (size_t i = 0; i < bucket_num; i++)
+      if (!(table->buckets[i] = list_create(free))) return NULL;
+   return table;
+}
+
+static int chained_is_in(const chained_t* table, const char* key){
+   char* curr_key;
+   for (const node_t* curr = list_get_first(table->buckets[chained_hash(key) % table->bucket_num]); curr;
+        curr = node_get_next(curr)){
+      if (node_save_key(curr, &curr_key) != 0) return -1;
+      if (strcmp(key, curr_key) == 0){
+         free(curr_key);
+         return 1;
+      }
+      free(curr_key);
+   }
+   return 0;
+}
+
+static const void* chained_get_value(const chained_t* table, const char* key){
+   char* curr_key;
+   const void* val;
+   for (const node_t* curr = list_get_first(table->buckets[chained_hash(key) % table->bucket_num]); curr;
+        curr = node_get_next(curr)){
+      if (node_save_key(curr, &curr_key) != 0) return NULL;
+      if (strcmp(key, curr_key) == 0){
+         val = node_get_value(curr);
+         free(curr_key);
+         return val;
+      }
+      free(curr_key);
+   }
+   return NULL;
+}
+
+static int chained_insert(chained_t* table, const char* key, const void* data, size_t data_size){
+   int err = chained_is_in(table, key);
+   if (err != 0) return err == 1 ? 0 : -1;
+   if (list_push_to_back(table->buckets[chained_hash(key) % table->bucket_num], key, strlen(key) + 1,
+                         data, data_size) != 0) return -1;
+   return 1;
+}
+
+static int chained_remove(chained_t* table, const char* key){
+   return list_remove(table->buckets[chained_hash(key) % table->bucket_num], key);
+}
+
+static void chained_free(chained_t* table){
+   for (size_t i = 0; i < table->bucket_num; i++) list_free(table->buckets[i]);
+   free(table->buckets);
+   free(table);
+}
+
+/**
+ * @brief gets the time elapsed since start in nanoseconds.
+*/
+static double elapsed_ns(const struct timespec* start){
+   struct timespec end;
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+/**
+ * @brief runs the benchmark for the given number of paths and buckets, printing the mean time
+ * of each operation for both tables.
+ * @returns 0 on success, -1 on failure.
+*/
+static int run(size_t paths, size_t buckets){
+   char (*names)[PATH_LEN] = malloc(sizeof(*names) * paths * 2);
+   char file[FILE_SIZE];
+   size_t* order = malloc(sizeof(size_t) * LOOKUPS);
+   struct timespec start;
+   double ns[3][4];
+   size_t found = 0;
+   void* data;
+   hash_table_t* table;
+   chained_t* chained;
+   if (!names || !order) return -1;
+   memset(file, 0, FILE_SIZE);
+   //paths sharing long prefixes, as the ones written by the clients; the second half is never inserted
+   for (size_t i = 0; i < paths * 2; i++)
+      snprintf(names[i], PATH_LEN, "/home/student/sol-project/test%lu/stubs%lu/stub%lu.txt", i % 3, i / 100, i);
+   srand(1);
+   for (size_t i = 0; i < LOOKUPS; i++) order[i] = (size_t) rand() % paths;
+
+   //the open table with the seeded hash, then with the PJW hash
+   for (int h = 0; h < 2; h++){
+      if (!(table = table_create(buckets, h ? table_hash_pjw : NULL, NULL, free))) return -1;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (size_t i = 0; i < paths; i++)
+         if (table_emplace(table, names[i], strlen(names[i]) + 1, FILE_SIZE, &data) != 1) return -1;
+         else memcpy(data, file, FILE_SIZE);
+      ns[h][0] = elapsed_ns(&start) / paths;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (size_t i = 0; i < LOOKUPS; i++)
+         if (table_find(table, names[order[i]])) found++;
+      ns[h][1] = elapsed_ns(&start) / LOOKUPS;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (size_t i = 0; i < LOOKUPS; i++)
+         if (table_find(table, names[paths + order[i]])) found++;
+      ns[h][2] = elapsed_ns(&start) / LOOKUPS;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (size_t i = 0; i < paths; i++)
+         if (table_remove(table, names[i]) != 0) return -1;
+      ns[h][3] = elapsed_ns(&start) / paths;
+      table_free(table);
+   }
+
+   if (!(chained = chained_create(buckets))) return -1;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (size_t i = 0; i < paths; i++)
+      if (chained_insert(chained, names[i], file, FILE_SIZE) != 1) return -1;
+   ns[2][0] = elapsed_ns(&start) / paths;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (size_t i = 0; i < LOOKUPS; i++)
+      if (chained_is_in(chained, names[order[i]]) == 1 && chained_get_value(chained, names[order[i]])) found++;
+   ns[2][1] = elapsed_ns(&start) / LOOKUPS;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (size_t i = 0; i < LOOKUPS; i++)
+      if (chained_is_in(chained, names[paths + order[i]]) == 1) found++;
+   ns[2][2] = elapsed_ns(&start) / LOOKUPS;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (size_t i = 0; i < paths; i++)
+      if (chained_remove(chained, names[i]) != 0) return -1;
+   ns[2][3] = elapsed_ns(&start) / paths;
+   chained_free(chained);
+
+   //every lookup of a path inside the table finds it, no other does
+   if (found != 3 * LOOKUPS) return -1;
+   printf("paths: %lu, buckets: %lu\n", paths, buckets);
+   printf("\t%-10s %12s %12s %12s %12s\n", "table", "insert", "hit", "miss", "remove");
+   printf("\t%-10s %9.1f ns %9.1f ns %9.1f ns %9.1f ns\n", "open", ns[0][0], ns[0][1], ns[0][2], ns[0][3]);
+   printf("\t%-10s %9.1f ns %9.1f ns %9.1f ns %9.1f ns\n", "open pjw", ns[1][0], ns[1][1], ns[1][2], ns[1][3]);
+   printf("\t%-10s %9.1f ns %9.1f ns %9.1f ns %9.1f ns\n", "chained", ns[2][0], ns[2][1], ns[2][2], ns[2][3]);
+   free(names);
+   free(order);
+   return 0;
+}
+
+/**
+ * @brief fills a table created empty with the given number of paths, then removes them, printing
+ * the mean and the longest time of an insertion and of a removal.
+ * @returns 0 on success, -1 on failure.
+*/
+static int grow(size_t paths){
+   char name[PATH_LEN];
+   char file[FILE_SIZE];
+   struct timespec start;
+   double ns, sum[2] = { 0, 0 }, max[2] = { 0, 0 };
+   hash_table_t* table = table_create(0, NULL, NULL, free);
+   if (!table) return -1;
+   memset(file, 0, FILE_SIZE);
+   for (size_t i = 0; i < paths * 2; i++){
+      snprintf(name, PATH_LEN, "/home/student/sol-project/test%lu/stubs%lu/stub%lu.txt",
+               i % paths % 3, i % paths / 100, i % paths);
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      if ((i < paths && table_insert(table, name, strlen(name) + 1, file, FILE_SIZE) != 1) ||
+          (i >= paths && table_remove(table, name) != 0)) return -1;
+      ns = elapsed_ns(&start);
+      sum[i >= paths] += ns;
+      if (ns > max[i >= paths]) max[i >= paths] = ns;
+   }
+   table_free(table);
+   printf("paths: %lu, from an empty table\n", paths);
+   printf("\t%-10s %12s %12s\n", "", "mean", "slowest");
+   printf("\t%-10s %9.1f ns %9.1f ns\n", "insert", sum[0] / paths, max[0]);
+   printf("\t%-10s %9.1f ns %9.1f ns\n", "remove", sum[1] / paths, max[1]);
+   return 0;
+}
+
+static int cmp_hash(const void* a, const void* b){
+   size_t x = *(const size_t*) a, y = *(const size_t*) b;
+   return (x > y) - (x < y);
+}
+
+/**
+ * @brief compares the PJW and the seeded hash on a set of paths, printing for each the paths
+ * whose hash is taken by another path, the buckets left empty when the low bits of the hashes
+ * pick one of as many buckets as paths, and the time spent hashing.
+ * @returns 0 on success, -1 on failure.
+*/
+static int quality(const char* set, char** names, size_t paths){
+   size_t* hashes = malloc(sizeof(size_t) * paths);
+   size_t buckets = 1, same, empty, bytes = 0;
+   unsigned char* used;
+   struct timespec start;
+   volatile size_t sink = 0;
+   double ns, uniform = 1;
+   if (!hashes || paths == 0) return -1;
+   while (buckets < paths) buckets *= 2;
+   if (!(used = malloc(buckets))) return -1;
+   for (size_t i = 0; i < paths; i++) bytes += strlen(names[i]);
+   printf("paths: %lu from %s, %.1f bytes on average\n", paths, set, (double) bytes / paths);
+   printf("\t%-10s %12s %12s %12s %12s\n", "hash", "collisions", "empty", "per path", "throughput");
+   for (int h = 0; h < 2; h++){
+      //timed on the paths in order, as many times as needed for HASHES hashes
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (size_t i = 0; i < HASHES; i++)
+         sink += h ? table_hash_pjw(names[i % paths]) : table_hash_seeded(names[i % paths], i);
+      ns = elapsed_ns(&start) / HASHES;
+      for (size_t i = 0; i < paths; i++) hashes[i] = h ? table_hash_pjw(names[i]) : table_hash_seeded(names[i], 1);
+      memset(used, 0, buckets);
+      empty = buckets;
+      for (size_t i = 0; i < paths; i++){
+         if (!used[hashes[i] & (buckets - 1)]) empty--;
+         used[hashes[i] & (buckets - 1)] = 1;
+      }
+      qsort(hashes, paths, sizeof(size_t), cmp_hash);
+      for (size_t i = same = 0; i + 1 < paths; i++) if (hashes[i] == hashes[i + 1]) same++;
+      printf("\t%-10s %10.3f %% %10.1f %% %9.1f ns %7.2f GB/s\n", h ? "pjw" : "seeded", 100.0 * same / paths,
+             100.0 * empty / buckets, ns, (double) bytes / paths / ns);
+   }
+   //with a uniform hash each bucket is left empty with probability (1 - 1/buckets)^paths
+   for (size_t i = 0; i < paths; i++) uniform *= 1 - 1.0 / buckets;
+   printf("\t%-10s %10.3f %% %10.1f %%\n", "uniform", 0.0, 100.0 * uniform);
+   free(hashes);
+   free(used);
+   return sink == 0 ? -1 : 0;
+}
+
+/**
+ * @brief reads the paths listed inside a file, one per line.
+ * @returns the number of paths read, 0 on failure.
+*/
+static size_t read_paths(const char* path, char*** names){
+   char line[PATH_LEN * 4];
+   size_t num = 0, cap = 1024;
+   char** tmp;
+   FILE* file = fopen(path, "r");
+   if (!file || !(*names = malloc(sizeof(char*) * cap))) return 0;
+   while (fgets(line, sizeof(line), file)){
+      line[strcspn(line, "\n")] = '\0';
+      if (line[0] == '\0') continue;
+      if (num == cap){
+         if (!(tmp = realloc(*names, sizeof(char*) * (cap *= 2)))) return 0;
+         *names = tmp;
+      }
+      if (!((*names)[num] = malloc(strlen(line) + 1))) return 0;
+      strcpy((*names)[num++], line);
+   }
+   fclose(file);
+   return num;
+}
+
+int main(int argc, char* argv[]){
+   char** names;
+   size_t num;
+   //a table sized for its files, as the cache creates it, and one holding many more paths
+   //than the limit it was sized for
+   if (run(1000, 1000) != 0 || run(100000, 100000) != 0 || run(10000, 100) != 0 || grow(1000000) != 0){
+      perror("table_bench");
+      return 1;
+   }
+   //the paths of the benchmark above, sharing long prefixes
+   num = 100000;
+   if (!(names = malloc(sizeof(char*) * num))) return 1;
+   for (size_t i = 0; i < num; i++){
+      if (!(names[i] = malloc(PATH_LEN))) return 1;
+      snprintf(names[i], PATH_LEN, "/home/student/sol-project/test%lu/stubs%lu/stub%lu.txt", i % 3, i / 100, i);
+   }
+   for (int arg = 0; arg < argc; arg++){
+      if (arg != 0 && (num = read_paths(argv[arg], &names)) == 0){
+         perror(argv[arg]);
+         return 1;
+      }
+      if (quality(arg == 0 ? "the benchmark" : argv[arg], names, num) != 0){
+         perror("table_bench");
+         return 1;
+      }
+      for (size_t i = 0; i < num; i++) free(names[i]);
+      free(names);
+   }
+   return 0;
+}
@@ -3,6 +3,9 @@
 GREEN="\e[92m"
 BLUE="\e[94m"
 YELLOW="\e[93m"
+MAGENTA="\e[95m"
+CYAN="\e[96m"
+RED="\e[91m"
 BOLD="\e[1m"
 RESET="\e[0m"
 
@@ -122,6 +125,90 @@ kill -s SIGHUP $SERVER
 wait $SERVER
 echo -e "${GREEN}LFU> Finished.
 ${RESET}"
+
+# changing config file name, changing to ARC replacement policy
+sed -i '$s/2/3/' config2.txt
+# change log file name
+sed -i -e 's/LFU2.log/ARC2.log/g' config2.txt
+
+echo -e "${CYAN}ARC> Starting up the server...${RESET}"
+
+build/server ./config2.txt &
+# server pid
+SERVER=$!
+export SERVER
+
+sleep 3s
+
+echo -e "${CYAN}ARC> Setting up clients...${RESET}"
+# connect, send files, save victims if any
+build/client -p -t 10 -f LSOFileStorage.sk -w stubs1 -D test2/ARC/evicted1
+# connect, send files, save victims if any
+build/client -p -t 10 -f LSOFileStorage.sk -w stubs2 -D test2/ARC/evicted2
+# connect, send files, save victims if any
+build/client -p -t 10 -f LSOFileStorage.sk -w stubs3 -D test2/ARC/evicted3
+
+echo -e "${CYAN}ARC> Shutting down the server with SIGHUP...${RESET}"
+kill -s SIGHUP $SERVER
+wait $SERVER
+echo -e "${CYAN}ARC> Finished.
+${RESET}"
+
+# changing config file name, changing to 2Q replacement policy
+sed -i '$s/3/4/' config2.txt
+# change log file name
+sed -i -e 's/ARC2.log/2Q2.log/g' config2.txt
+
+echo -e "${RED}2Q> Starting up the server...${RESET}"
+
+build/server ./config2.txt &
+# server pid
+SERVER=$!
+export SERVER
+
+sleep 3s
+
+echo -e "${RED}2Q> Setting up clients...${RESET}"
+# connect, send files, save victims if any
+build/client -p -t 10 -f LSOFileStorage.sk -w stubs1 -D test2/2Q/evicted1
+# connect, send files, save victims if any
+build/client -p -t 10 -f LSOFileStorage.sk -w stubs2 -D test2/2Q/evicted2
+# connect, send files, save victims if any
+build/client -p -t 10 -f LSOFileStorage.sk -w stubs3 -D test2/2Q/evicted3
+
+echo -e "${RED}2Q> Shutting down the server with SIGHUP...${RESET}"
+kill -s SIGHUP $SERVER
+wait $SERVER
+echo -e "${RED}2Q> Finished.
+${RESET}"
+
+# changing config file name, changing to GDSF replacement policy
+sed -i '$s/4/5/' config2.txt
+# change log file name
+sed -i -e 's/2Q2.log/GDSF2.log/g' config2.txt
+
+echo -e "${MAGENTA}GDSF> Starting up the server...${RESET}"
+
+build/server ./config2.txt &
+# server pid
+SERVER=$!
+export SERVER
+
+sleep 3s
+
+echo -e "${MAGENTA}GDSF> Setting up clients...${RESET}"
+# connect, send files, save victims if any
+build/client -p -t 10 -f LSOFileStorage.sk -w stubs1 -D test2/GDSF/evicted1
+# connect, send files, save victims if any
+build/client -p -t 10 -f LSOFileStorage.sk -w stubs2 -D test2/GDSF/evicted2
+# connect, send files, save victims if any
+build/client -p -t 10 -f LSOFileStorage.sk -w stubs3 -D test2/GDSF/evicted3
+
+echo -e "${MAGENTA}GDSF> Shutting down the server with SIGHUP...${RESET}"
+kill -s SIGHUP $SERVER
+wait $SERVER
+echo -e "${MAGENTA}GDSF> Finished.
+${RESET}"
 echo -e "${BOLD}--------------------TEST 2 HAS FINISHED--------------------\n${RESET}"
 
 rm config2.txt
@@ -3,6 +3,9 @@
 GREEN="\e[92m"
 BLUE="\e[94m"
 YELLOW="\e[93m"
+MAGENTA="\e[95m"
+CYAN="\e[96m"
+RED="\e[91m"
 BOLD="\e[1m"
 RESET="\e[0m"
 
@@ -160,6 +163,117 @@ killall -q build/client
 echo -e "${GREEN}LFU> Finished.
 ${RESET}"
 
+# changing config file name, changing to ARC replacement policy
+sed -i '$s/2/3/' config3.txt
+# change log file name
+sed -i -e 's/LFU3.log/ARC3.log/g' config3.txt
+
+echo -e "${CYAN}ARC> Starting up the server...${RESET}"
+build/server ./config3.txt &
+# server pid
+SERVER=$!
+export SERVER
+sleep 3s
+
+bash -c 'sleep 30 && kill -2 ${SERVER}' &
+echo -e "${CYAN}ARC> Shutting down the server with SIGINT in 30s...${RESET}"
+
+# start 10 times stress test
+pids=()
+for i in {1..10}; do
+	bash -c 'tests/test3_stress.sh' &
+	pids+=($!)
+	sleep 0.1
+done
+
+# sleep 30 seconds and kill all instances
+sleep 30s
+
+for i in "${pids[@]}"; do
+	kill ${i}
+	wait ${i} 2>/dev/null
+done
+
+wait $SERVER
+# kill all clients quietly
+killall -q build/client
+echo -e "${CYAN}ARC> Finished.
+${RESET}"
+
+# changing config file name, changing to 2Q replacement policy
+sed -i '$s/3/4/' config3.txt
+# change log file name
+sed -i -e 's/ARC3.log/2Q3.log/g' config3.txt
+
+echo -e "${RED}2Q> Starting up the server...${RESET}"
+build/server ./config3.txt &
+# server pid
+SERVER=$!
+export SERVER
+sleep 3s
+
+bash -c 'sleep 30 && kill -2 ${SERVER}' &
+echo -e "${RED}2Q> Shutting down the server with SIGINT in 30s...${RESET}"
+
+# start 10 times stress test
+pids=()
+for i in {1..10}; do
+	bash -c 'tests/test3_stress.sh' &
+	pids+=($!)
+	sleep 0.1
+done
+
+# sleep 30 seconds and kill all instances
+sleep 30s
+
+for i in "${pids[@]}"; do
+	kill ${i}
+	wait ${i} 2>/dev/null
+done
+
+wait $SERVER
+# kill all clients quietly
+killall -q build/client
+echo -e "${RED}2Q> Finished.
+${RESET}"
+
+# changing config file name, changing to GDSF replacement policy
+sed -i '$s/4/5/' config3.txt
+# change log file name
+sed -i -e 's/2Q3.log/GDSF3.log/g' config3.txt
+
+echo -e "${MAGENTA}GDSF> Starting up the server...${RESET}"
+build/server ./config3.txt &
+# server pid
+SERVER=$!
+export SERVER
+sleep 3s
+
+bash -c 'sleep 30 && kill -2 ${SERVER}' &
+echo -e "${MAGENTA}GDSF> Shutting down the server with SIGINT in 30s...${RESET}"
+
+# start 10 times stress test
+pids=()
+for i in {1..10}; do
+	bash -c 'tests/test3_stress.sh' &
+	pids+=($!)
+	sleep 0.1
+done
+
+# sleep 30 seconds and kill all instances
+sleep 30s
+
+for i in "${pids[@]}"; do
+	kill ${i}
+	wait ${i} 2>/dev/null
+done
+
+wait $SERVER
+# kill all clients quietly
+killall -q build/client
+echo -e "${MAGENTA}GDSF> Finished.
+${RESET}"
+
 rm -rf stubs* config3.txt
 
 echo -e "${BOLD}--------------------TEST 3 HAS FINISHED--------------------\n${RESET}"
@@ -0,0 +1,289 @@
+/**
+ * @brief implementation of the reference counted immutable buffers holding the contents of files.
+ *
+*/
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "blob.h"
+#include "slab.h"
+
+#define CHUNK_SIZE 65536 // memory taken by the chunks created by appends, headers included
+#define CHUNKS_MIN 4 // initial length of the array of chunks of a blob
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+
+//buffer shared by the blobs holding the same contents
+typedef struct _chunk{
+   size_t refs;
+   size_t capacity;
+   //bytes claimed by the blobs sharing the chunk, only ever grows: each blob
+   //sees a prefix of the chunk and appends only past every prefix
+   size_t used;
+   //the data of the chunk, or memory owned by someone else for wrapped chunks
+   char* bytes;
+   //called with owner when a wrapped chunk is freed, NULL for the other chunks
+   void (*release)(void*);
+   void* owner;
+   char data[];
+} chunk_t;
+
+//part of a chunk belonging to a blob
+typedef struct _slice{
+   chunk_t* chunk;
+   size_t len;
+} slice_t;
+
+struct _blob{
+   //references held by the cache and by the workers sending the contents
+   size_t refs;
+   size_t size;
+   slice_t* slices;
+   size_t slices_num;
+   size_t slices_max;
+};
+
+/**
+ * @brief creates a chunk holding a copy of the data.
+ * @returns the chunk on success, NULL on failure.
+*/
+static chunk_t* chunk_create(const void* data, size_t size, size_t capacity){
+   chunk_t* new = slab_alloc(sizeof(chunk_t) + capacity);
+   if (!new){
+      errno = ENOMEM;
+      return NULL;
+   }
+   new->refs = 1;
+   new->capacity = capacity;
+   new->used = size;
+   new->bytes = new->data;
+   new->release = NULL;
+   new->owner = NULL;
+   memcpy(new->data, data, size);
+   return new;
+}
+
+static void chunk_unref(chunk_t* chunk){
+   if (__atomic_sub_fetch(&chunk->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+   if (chunk->release) chunk->release(chunk->owner);
+   slab_free(chunk);
+}
+
+/**
+ * @brief creates an empty blob with room for slices_max slices.
+ * @returns the blob on success, NULL on failure.
+*/
+static blob_t* blob_alloc(size_t slices_max){
+   blob_t* new = slab_alloc(sizeof(blob_t));
+   if (!new){
+      errno = ENOMEM;
+      return NULL;
+   }
+   new->slices = slab_alloc(sizeof(slice_t) * slices_max);
+   if (!new->slices){
+      slab_free(new);
+      errno = ENOMEM;
+      return NULL;
+   }
+   new->refs = 1;
+   new->size = 0;
+   new->slices_num = 0;
+   new->slices_max = slices_max;
+   return new;
+}
+
+/**
+ * @brief adds a slice at the end of a blob, growing its array if needed.
+ * @returns 0 on success, -1 on failure.
+*/
+static int blob_push(blob_t* blob, chunk_t* chunk, size_t len){
+   if (blob->slices_num == blob->slices_max){
+      slice_t* new = slab_realloc(blob->slices, sizeof(slice_t) * blob->slices_max * 2);
+      if (!new){
+         errno = ENOMEM;
+         return -1;
+      }
+      blob->slices = new;
+      blob->slices_max *= 2;
+   }
+   blob->slices[blob->slices_num].chunk = chunk;
+   blob->slices[blob->slices_num].len = len;
+   blob->slices_num++;
+   blob->size += len;
+   return 0;
+}
+
+blob_t* blob_create(const void* data, size_t size){
+   if (!data && size != 0){
+      errno = EINVAL;
+      return NULL;
+   }
+   chunk_t* chunk;
+   blob_t* new = blob_alloc(CHUNKS_MIN);
+   if (!new) return NULL;
+   if (size == 0) return new;
+   //written files are not expected to grow, their chunk has no spare room
+   chunk = chunk_create(data, size, size);
+   if (!chunk){
+      blob_unref(new);
+      return NULL;
+   }
+   blob_push(new, chunk, size);
+   return new;
+}
+
+blob_t* blob_reserve(size_t size, void** data){
+   if (!data || size == 0){
+      errno = EINVAL;
+      return NULL;
+   }
+   chunk_t* chunk;
+   blob_t* new = blob_alloc(CHUNKS_MIN);
+   if (!new) return NULL;
+   chunk = slab_alloc(sizeof(chunk_t) + size);
+   if (!chunk){
+      blob_unref(new);
+      errno = ENOMEM;
+      return NULL;
+   }
+   chunk->refs = 1;
+   chunk->capacity = size;
+   chunk->used = size;
+   chunk->bytes = chunk->data;
+   chunk->release = NULL;
+   chunk->owner = NULL;
+   blob_push(new, chunk, size);
+   *data = chunk->data;
+   return new;
+}
+
+blob_t* blob_wrap(const void* data, size_t size, void (*release)(void*), void* owner){
+   if (!data || size == 0 || !release){
+      errno = EINVAL;
+      return NULL;
+   }
+   chunk_t* chunk;
+   blob_t* new = blob_alloc(CHUNKS_MIN);
+   if (!new) return NULL;
+   chunk = slab_alloc(sizeof(chunk_t));
+   if (!chunk){
+      blob_unref(new);
+      errno = ENOMEM;
+      return NULL;
+   }
+   //the chunk is full, appends go to a chunk of their own
+   chunk->refs = 1;
+   chunk->capacity = size;
+   chunk->used = size;
+   chunk->bytes = (char*) data;
+   chunk->release = release;
+   chunk->owner = owner;
+   blob_push(new, chunk, size);
+   return new;
+}
+
+int blob_append(blob_t** blob, const void* data, size_t size){
+   if (!blob || (!data && size != 0)){
+      errno = EINVAL;
+      return -1;
+   }
+   blob_t* old = *blob;
+   blob_t* new = old;
+   slice_t* tail;
+   chunk_t* chunk;
+   size_t room, len, used;
+
+   if (!old) return (*blob = blob_create(data, size)) ? 0 : -1;
+   if (size == 0) return 0;
+   //other references see the old contents, the new blob shares its chunks
+   if (__atomic_load_n(&old->refs, __ATOMIC_ACQUIRE) > 1){
+      new = blob_alloc(MAX(old->slices_max, CHUNKS_MIN));
+      if (!new) return -1;
+      memcpy(new->slices, old->slices, sizeof(slice_t) * old->slices_num);
+      new->slices_num = old->slices_num;
+      new->size = old->size;
+      for (size_t i = 0; i < new->slices_num; i++)
+         __atomic_add_fetch(&new->slices[i].chunk->refs, 1, __ATOMIC_RELAXED);
+   }
+   //fill the room left in the last chunk, past the bytes seen by the other blobs,
+   //only if no other blob has already claimed it
+   if (new->slices_num != 0){
+      tail = &new->slices[new->slices_num - 1];
+      room = tail->chunk->capacity - tail->len;
+      len = MIN(room, size);
+      used = tail->len;
+      if (len != 0 && __atomic_compare_exchange_n(&tail->chunk->used, &used, used + len, false,
+                                                   __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)){
+         memcpy(tail->chunk->bytes + tail->len, data, len);
+         tail->len += len;
+         new->size += len;
+         data = (const char*) data + len;
+         size -= len;
+      }
+   }
+   //the rest goes to a new chunk with room for the next appends
+   if (size != 0){
+      chunk = chunk_create(data, size, MAX(size, CHUNK_SIZE - sizeof(chunk_t) - slab_overhead()));
+      if (!chunk || blob_push(new, chunk, size) != 0){
+         if (chunk) chunk_unref(chunk);
+         if (new != old) blob_unref(new);
+         return -1;
+      }
+   }
+   if (new != old){
+      blob_unref(old);
+      *blob = new;
+   }
+   return 0;
+}
+
+blob_t* blob_ref(blob_t* blob){
+   //references are taken and released by threads holding different locks
+   if (blob) __atomic_add_fetch(&blob->refs, 1, __ATOMIC_RELAXED);
+   return blob;
+}
+
+void blob_unref(blob_t* blob){
+   if (!blob) return;
+   //the last reference frees the blob, after every other release is visible
+   if (__atomic_sub_fetch(&blob->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+   for (size_t i = 0; i < blob->slices_num; i++) chunk_unref(blob->slices[i].chunk);
+   slab_free(blob->slices);
+   slab_free(blob);
+}
+
+size_t blob_get_size(const blob_t* blob){
+   if (!blob){
+      errno = EINVAL;
+      return 0;
+   }
+   return blob->size;
+}
+
+size_t blob_get_chunks(const blob_t* blob, struct iovec* iov, size_t first, size_t max){
+   if (!blob || !iov){
+      errno = EINVAL;
+      return 0;
+   }
+   size_t i;
+   for (i = 0; i < max && first + i < blob->slices_num; i++){
+      iov[i].iov_base = blob->slices[first + i].chunk->bytes;
+      iov[i].iov_len = blob->slices[first + i].len;
+   }
+   return i;
+}
+
+size_t blob_copy(const blob_t* blob, void* dst){
+   if (!blob || !dst){
+      errno = EINVAL;
+      return 0;
+   }
+   char* out = dst;
+   for (size_t i = 0; i < blob->slices_num; i++){
+      memcpy(out, blob->slices[i].chunk->bytes, blob->slices[i].len);
+      out += blob->slices[i].len;
+   }
+   return blob->size;
+}
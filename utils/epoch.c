@@ -0,0 +1,193 @@
+/**
+ * @brief implementation of the epoch based reclamation of the memory read without locks.
+ *
+*/
+
+#define _POSIX_C_SOURCE 200112L
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "epoch.h"
+
+#define CACHE_LINE 64 // records of different threads never share a line, they are written by every section
+#define BAGS 3 // an object retired in epoch e is freed when the epoch goes from e + 2 to e + 3
+
+//record of a thread that entered a section at least once
+typedef struct _epoch_thread{
+   //(epoch << 1) | 1 while the thread is inside a section, 0 outside
+   uint64_t state;
+   unsigned int depth;
+   //false once the thread is gone, the record is then taken by the next thread registering
+   bool used;
+   struct _epoch_thread* next;
+} epoch_thread_t;
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+//records are never freed, so they can be scanned with no lock
+static epoch_thread_t* threads = NULL;
+
+static uint64_t epoch = 0;
+//objects retired in every epoch still not over, they are pushed and taken under the mutex
+static pthread_mutex_t limbo_mutex = PTHREAD_MUTEX_INITIALIZER;
+static epoch_entry_t* bags[BAGS] = { NULL };
+static size_t retired = 0;
+static size_t freed = 0;
+
+/**
+ * @brief gives the record of a thread gone to the next thread registering.
+*/
+static void thread_release(void* arg){
+   epoch_thread_t* record = arg;
+   record->depth = 0;
+   __atomic_store_n(&record->state, 0, __ATOMIC_RELEASE);
+   __atomic_store_n(&record->used, false, __ATOMIC_RELEASE);
+}
+
+static void key_init(void){
+   pthread_key_create(&key, thread_release);
+}
+
+/**
+ * @brief gets the record of the calling thread, registering it the first time.
+ * @returns the record on success, NULL on failure.
+ * @exception errno is set to ENOMEM if malloc fails.
+*/
+static epoch_thread_t* thread_get(void){
+   epoch_thread_t* record;
+   bool unused;
+   void* mem;
+   pthread_once(&key_once, key_init);
+   if ((record = pthread_getspecific(key))) return record;
+   //takes the record of a thread gone, if any
+   for (record = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); record; record = record->next){
+      unused = false;
+      if (__atomic_compare_exchange_n(&record->used, &unused, true, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) break;
+   }
+   if (!record){
+      if (posix_memalign(&mem, CACHE_LINE, CACHE_LINE) != 0){
+         errno = ENOMEM;
+         return NULL;
+      }
+      record = mem;
+      record->state = 0;
+      record->depth = 0;
+      record->used = true;
+      record->next = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+      while (!__atomic_compare_exchange_n(&threads, &record->next, record, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+   }
+   if (pthread_setspecific(key, record) != 0){
+      thread_release(record);
+      errno = ENOMEM;
+      return NULL;
+   }
+   return record;
+}
+
+/**
+ * @brief moves to the next epoch if every thread inside a section entered it in the current
+ * one, the limbo mutex must be held.
+ * @returns the objects that can be freed, NULL if there are none or the epoch did not change.
+*/
+static epoch_entry_t* epoch_try_advance(void){
+   uint64_t current = __atomic_load_n(&epoch, __ATOMIC_RELAXED);
+   uint64_t state;
+   epoch_entry_t* ready;
+   //pairs with the fence of epoch_enter: a thread missed here reads the tables as they are now
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   for (epoch_thread_t* record = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); record; record = record->next){
+      state = __atomic_load_n(&record->state, __ATOMIC_ACQUIRE);
+      if ((state & 1) && (state >> 1) != current) return NULL;
+   }
+   __atomic_store_n(&epoch, current + 1, __ATOMIC_RELEASE);
+   //the bag of the new epoch holds the objects retired three epochs ago
+   ready = bags[(current + 1) % BAGS];
+   bags[(current + 1) % BAGS] = NULL;
+   return ready;
+}
+
+/**
+ * @brief frees a list of retired objects.
+*/
+static void epoch_free_bag(epoch_entry_t* entry){
+   epoch_entry_t* next;
+   size_t count = 0;
+   while (entry){
+      next = entry->next;
+      entry->free_fun(entry->ptr);
+      entry = next;
+      count++;
+   }
+   if (count) __atomic_add_fetch(&freed, count, __ATOMIC_RELAXED);
+}
+
+int epoch_enter(void){
+   epoch_thread_t* record = thread_get();
+   if (!record) return -1;
+   if (record->depth++ == 0){
+      __atomic_store_n(&record->state, (__atomic_load_n(&epoch, __ATOMIC_ACQUIRE) << 1) | 1, __ATOMIC_RELAXED);
+      //the state is visible before anything is read inside the section
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   }
+   return 0;
+}
+
+void epoch_exit(void){
+   epoch_thread_t* record = pthread_getspecific(key);
+   if (!record || record->depth == 0) return;
+   if (--record->depth == 0) __atomic_store_n(&record->state, 0, __ATOMIC_RELEASE);
+}
+
+void epoch_retire(epoch_entry_t* entry, void* ptr, void (*free_fun)(void*)){
+   if (!entry || !free_fun) return;
+   epoch_entry_t* ready;
+   size_t bag;
+   entry->ptr = ptr;
+   entry->free_fun = free_fun;
+   pthread_mutex_lock(&limbo_mutex);
+   //the epoch only changes under the mutex
+   bag = __atomic_load_n(&epoch, __ATOMIC_RELAXED) % BAGS;
+   entry->next = bags[bag];
+   bags[bag] = entry;
+   retired++;
+   ready = epoch_try_advance();
+   pthread_mutex_unlock(&limbo_mutex);
+   //freed out of the mutex, free_fun may be slow or retire other objects
+   epoch_free_bag(ready);
+}
+
+void epoch_poll(void){
+   epoch_entry_t* ready;
+   //the thread holding the mutex advances the epoch itself
+   if (pthread_mutex_trylock(&limbo_mutex) != 0) return;
+   ready = !bags[0] && !bags[1] && !bags[2] ? NULL : epoch_try_advance();
+   pthread_mutex_unlock(&limbo_mutex);
+   epoch_free_bag(ready);
+}
+
+void epoch_barrier(void){
+   epoch_entry_t* ready;
+   bool empty;
+   for (;;){
+      pthread_mutex_lock(&limbo_mutex);
+      empty = !bags[0] && !bags[1] && !bags[2];
+      ready = empty ? NULL : epoch_try_advance();
+      pthread_mutex_unlock(&limbo_mutex);
+      if (empty) return;
+      if (ready) epoch_free_bag(ready);
+      else sched_yield();
+   }
+}
+
+void epoch_print(FILE* stream){
+   if (!stream) return;
+   pthread_mutex_lock(&limbo_mutex);
+   fprintf(stream, "Epoch reclamation: %lu object(s) retired, %lu freed, %lu waiting, %lu epoch(s) gone by.\n",
+           retired, __atomic_load_n(&freed, __ATOMIC_RELAXED), retired - __atomic_load_n(&freed, __ATOMIC_RELAXED),
+           (unsigned long) __atomic_load_n(&epoch, __ATOMIC_RELAXED));
+   pthread_mutex_unlock(&limbo_mutex);
+}
@@ -4,20 +4,21 @@
 */
 
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <time.h>
 #include "hash_table.h"
-#include "linked_list.h"
 
 /**
  * @file icl_hash.c
  * Dependency free hash table implementation.
  * @author Jakub Kurzak
  *
- * $Id: icl_hash.c 2838 2011-11-22 04:25:02Z mfaverge $ 
- * $UTK_Copyright: $ 
+ * $Id: icl_hash.c 2838 2011-11-22 04:25:02Z mfaverge $
+ * $UTK_Copyright: $
  *
  * A simple string hash.
  *
@@ -34,7 +35,7 @@
 #define THREE_QUARTERS  ((int) ((BITS_IN_int * 3) / 4))
 #define ONE_EIGHTH      ((int) (BITS_IN_int / 8))
 #define HIGH_BITS       ( ~((unsigned int)(~0) >> ONE_EIGHTH ))
-static size_t table_hash_fun(const void* key){
+size_t table_hash_pjw(const void* key){
    char* datum = (char*)key;
    size_t hash_value, i;
 
@@ -48,14 +49,137 @@ static size_t table_hash_fun(const void* key){
    return (hash_value);
 }
 
+/**
+ * A seeded string hash, following wyhash by Wang Yi (released into the public domain).
+ * The string is read 8 bytes at a time once its length is known, and every block is mixed
+ * into the state by a 64x64 -> 128 bit multiplication folded back to 64 bits.
+*/
+static const uint64_t WY_SECRET[4] = { 0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+                                       0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull };
+
+/**
+ * @brief multiplies a by b, setting a to the low 64 bits of the product and b to the high ones.
+*/
+static void wy_mum(uint64_t* a, uint64_t* b){
+#ifdef __SIZEOF_INT128__
+   __uint128_t r = (__uint128_t) *a * *b;
+   *a = (uint64_t) r;
+   *b = (uint64_t) (r >> 64);
+#else
+   //portable fallback, from four 32x32 bit products
+   uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t) *a, lb = (uint32_t) *b;
+   uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+   uint64_t t = rl + (rm0 << 32), c = t < rl, lo;
+   lo = t + (rm1 << 32);
+   c += lo < t;
+   *a = lo;
+   *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static uint64_t wy_mix(uint64_t a, uint64_t b){
+   wy_mum(&a, &b);
+   return a ^ b;
+}
+
+//the reads are in the byte order of the host, the hashes are never saved
+static uint64_t wy_read8(const unsigned char* p){
+   uint64_t v;
+   memcpy(&v, p, sizeof(v));
+   return v;
+}
+
+static uint64_t wy_read4(const unsigned char* p){
+   uint32_t v;
+   memcpy(&v, p, sizeof(v));
+   return v;
+}
+
+size_t table_hash_seeded(const void* key, uint64_t seed){
+   if (!key) return 0;
+   const unsigned char* p = (const unsigned char*) key;
+   //strlen of the C library already scans the string a vector at a time
+   size_t len = strlen((const char*) key), i = len;
+   uint64_t a, b, see1, see2;
+   seed ^= wy_mix(seed ^ WY_SECRET[0], WY_SECRET[1]);
+   if (len <= 16){
+      if (len >= 4){
+         a = (wy_read4(p) << 32) | wy_read4(p + ((len >> 3) << 2));
+         b = (wy_read4(p + len - 4) << 32) | wy_read4(p + len - 4 - ((len >> 3) << 2));
+      }else if (len > 0){
+         a = ((uint64_t) p[0] << 16) | ((uint64_t) p[len >> 1] << 8) | p[len - 1];
+         b = 0;
+      }else a = b = 0;
+   }else{
+      //three independent lanes of 16 bytes, so that the multiplications overlap
+      if (i > 48){
+         see1 = seed;
+         see2 = seed;
+         do{
+            seed = wy_mix(wy_read8(p) ^ WY_SECRET[1], wy_read8(p + 8) ^ seed);
+            see1 = wy_mix(wy_read8(p + 16) ^ WY_SECRET[2], wy_read8(p + 24) ^ see1);
+            see2 = wy_mix(wy_read8(p + 32) ^ WY_SECRET[3], wy_read8(p + 40) ^ see2);
+            p += 48;
+            i -= 48;
+         }while (i > 48);
+         seed ^= see1 ^ see2;
+      }
+      while (i > 16){
+         seed = wy_mix(wy_read8(p) ^ WY_SECRET[1], wy_read8(p + 8) ^ seed);
+         i -= 16;
+         p += 16;
+      }
+      //the last 16 bytes, overlapping the ones mixed already
+      a = wy_read8(p + i - 16);
+      b = wy_read8(p + i - 8);
+   }
+   a ^= WY_SECRET[1];
+   b ^= seed;
+   wy_mum(&a, &b);
+   return (size_t) wy_mix(a ^ WY_SECRET[0] ^ len, b ^ WY_SECRET[1]);
+}
+
 
 /**
  * ------------------------------------------------------------
 */
+#define SLOTS_MIN 8 // smallest number of slots of a table
+#define LOAD_NUM 7 // the table grows once more than LOAD_NUM / LOAD_DEN of its slots are used
+#define LOAD_DEN 8
+#define SHRINK_DEN 8 // the table shrinks once fewer than 1 / SHRINK_DEN of its slots are used
+#define MOVE_SLOTS 8 // slots of the old array visited by each insertion or removal while resizing
+#define FIBONACCI 11400714819323198485ull // 2^64 divided by the golden ratio, spreads the hashes over the slots
+
+static uint64_t tables_created = 0; // mixed into the seeds of the tables
+
+//slot of the table, empty if its key is NULL. The data is allocated with the key after it,
+//so that the function deallocating the data releases the key too
+typedef struct _slot{
+   //full hash of the key, compared before the keys are
+   size_t hash;
+   char* key;
+   void* data;
+} slot_t;
+
+//array of slots, a power of 2: shift takes the top bits of the spread hash as the home slot
+typedef struct _slots{
+   slot_t* slot;
+   size_t num;
+   unsigned int shift;
+   size_t used;
+} slots_t;
+
 struct _hash_table{
-	size_t bucket_num;
-	linked_list_t** buckets;
+   //the keys are inserted into curr. While the table is resized, old holds the keys not moved
+   //yet, and every slot of old before moved is empty
+   slots_t curr;
+   slots_t old;
+   size_t moved;
+   //the table never shrinks below the slots it was created with
+   size_t slot_min;
+   //NULL for the seeded hash, with the seed picked when the table is created
 	size_t (*hash_fun) (const void*);
+   uint64_t seed;
 	int (*hash_cmp) (const void*, const void*);
    //pointer to function for deallocating resources
 	void (*free_data) (void*);
@@ -68,104 +192,324 @@ static int table_cmp(const void* a, const void* b){
 	return strcmp((char*) a, (char*) b);
 }
 
+/**
+ * @brief hashes a key with the function chosen when the table was created.
+*/
+static size_t table_hash(const hash_table_t* table, const void* key){
+   return table->hash_fun ? table->hash_fun(key) : table_hash_seeded(key, table->seed);
+}
+
+/**
+ * @brief gets the slot a key with the given hash is stored at when no other key is in the way.
+*/
+static size_t slots_home(const slots_t* slots, size_t hash){
+   return (size_t) (((uint64_t) hash * FIBONACCI) >> slots->shift);
+}
+
+/**
+ * @brief gets how far the key inside a used slot is from its home slot.
+*/
+static size_t slots_distance(const slots_t* slots, size_t pos){
+   return (pos - slots_home(slots, slots->slot[pos].hash)) & (slots->num - 1);
+}
+
+/**
+ * @brief allocates an array of slots, all empty.
+ * @returns 0 on success, -1 on failure.
+ * @param num must be a power of 2.
+ * @exception errno is set to ENOMEM if malloc fails.
+*/
+static int slots_alloc(slots_t* slots, size_t num){
+   unsigned int bits = 0;
+   slots->slot = calloc(num, sizeof(slot_t));
+   if (!slots->slot){
+      errno = ENOMEM;
+      return -1;
+   }
+   while (((size_t) 1 << bits) < num) bits++;
+   slots->num = num;
+   slots->shift = 64 - bits;
+   slots->used = 0;
+   return 0;
+}
+
+/**
+ * @brief places a key inside an array, moving the keys closer to their home slot further
+ * away from it (Robin Hood hashing).
+ * @note the key must not be inside the array, which must have an empty slot.
+*/
+static void slots_place(slots_t* slots, slot_t slot){
+   size_t mask = slots->num - 1;
+   size_t pos = slots_home(slots, slot.hash);
+   size_t dist = 0;
+   size_t other;
+   slot_t tmp;
+   while (slots->slot[pos].key){
+      other = slots_distance(slots, pos);
+      if (other < dist){
+         tmp = slots->slot[pos];
+         slots->slot[pos] = slot;
+         slot = tmp;
+         dist = other;
+      }
+      pos = (pos + 1) & mask;
+      dist++;
+   }
+   slots->slot[pos] = slot;
+   slots->used++;
+}
+
+/**
+ * @brief empties a used slot of an array, without releasing its key. The keys after it are
+ * shifted back by one slot, until one is at its home slot.
+*/
+static void slots_delete(slots_t* slots, size_t pos){
+   size_t mask = slots->num - 1;
+   size_t next;
+   for (next = (pos + 1) & mask; slots->slot[next].key && slots_distance(slots, next) != 0; next = (next + 1) & mask){
+      slots->slot[pos] = slots->slot[next];
+      pos = next;
+   }
+   slots->slot[pos].key = NULL;
+   slots->slot[pos].data = NULL;
+   slots->used--;
+}
+
+/**
+ * @brief looks a key up inside an array, without allocating anything.
+ * @returns the position of its slot if found, the number of slots otherwise.
+*/
+static size_t slots_find(const hash_table_t* table, const slots_t* slots, const void* key, size_t hash){
+   if (slots->used == 0) return slots->num;
+   size_t mask = slots->num - 1;
+   size_t pos = slots_home(slots, hash);
+   for (size_t dist = 0; slots->slot[pos].key; dist++){
+      //the key would have taken the slot of a key further from its home
+      if (slots_distance(slots, pos) < dist) break;
+      //interned keys are found by their address, without comparing them
+      if (slots->slot[pos].key == key) return pos;
+      if (slots->slot[pos].hash == hash && table->hash_cmp(key, slots->slot[pos].key) == 0) return pos;
+      pos = (pos + 1) & mask;
+   }
+   return slots->num;
+}
+
+/**
+ * @brief looks a key up inside the table, among the keys not moved yet too.
+ * @returns the slot of the key if found, NULL otherwise.
+ * @param slots if != NULL, set to the array holding the key.
+ * @param pos if != NULL, set to the position of the key inside its array.
+*/
+static slot_t* table_find_slot(const hash_table_t* table, const void* key, size_t hash,
+                               const slots_t** slots, size_t* pos){
+   const slots_t* where = &table->curr;
+   size_t found = slots_find(table, where, key, hash);
+   //the slots of old before moved are empty, so the keys moved already are not found there
+   if (found == where->num && table->old.slot){
+      where = &table->old;
+      found = slots_find(table, where, key, hash);
+   }
+   if (found == where->num) return NULL;
+   if (slots) *slots = where;
+   if (pos) *pos = found;
+   return &where->slot[found];
+}
+
+/**
+ * @brief moves the keys of the old array into the current one, visiting at most steps slots.
+ * The old array is released once it is empty.
+ * @note the key at moved is deleted from the old array before being placed, so the keys after
+ * it shift back onto moved and the keys left in old are still found from their home slot.
+*/
+static void table_move(hash_table_t* table, size_t steps){
+   slot_t slot;
+   for (size_t i = 0; i < steps && table->old.slot; i++){
+      if (table->old.used == 0){
+         free(table->old.slot);
+         table->old.slot = NULL;
+         table->old.num = 0;
+         break;
+      }
+      if (!table->old.slot[table->moved].key){
+         table->moved++;
+         continue;
+      }
+      slot = table->old.slot[table->moved];
+      slots_delete(&table->old, table->moved);
+      slots_place(&table->curr, slot);
+   }
+}
+
+/**
+ * @brief starts resizing the table to the given number of slots. The keys are moved into
+ * the new array a few at a time by the insertions and removals that follow.
+ * @returns 0 on success, -1 on failure.
+ * @param num must be a power of 2, large enough to hold every key of the table.
+ * @exception errno is set to ENOMEM if malloc fails.
+*/
+static int table_resize(hash_table_t* table, size_t num){
+   slots_t prev = table->curr;
+   if (slots_alloc(&table->curr, num) != 0){
+      table->curr = prev;
+      return -1;
+   }
+   table->old = prev;
+   table->moved = 0;
+   return 0;
+}
+
 hash_table_t* table_create(size_t bucket_num, size_t (*hash_fun) (const void*),
 		int (*hash_cmp) (const void*, const void*), void (*free_data) (void*)){
-	//allocating space for the whole table and for the buckets
+   size_t slot_num = SLOTS_MIN;
+	//allocating space for the whole table and for the slots
    hash_table_t* table =  malloc(sizeof(hash_table_t));
 	if (!table){
 		errno = ENOMEM;
 		return NULL;
 	}
-	table->bucket_num = bucket_num;
-	table->buckets =  malloc(sizeof(linked_list_t*) * bucket_num);
-	if (!(table->buckets)){
-		errno = ENOMEM;
-		free(table);
-		return NULL;
-	}
-
-	size_t i;
-
-   //create empty buckets (doubly linked lists)
-	for (i = 0; i < bucket_num; i++){
-      //check if there is a custom function for
-      //deallocating resources inside the table,
-      //otherwise use the normal free function
-		if (!free_data)
-			(table->buckets)[i] = list_create(free);
-		else
-			(table->buckets)[i] = list_create(free_data);
-      //creation of bucket failed, deallocate resources
-		if (!((table->buckets)[i])){
-			size_t j = 0;
-			while (j != i){
-				list_free((table->buckets)[j]);
-				j++;
-			}
-			free(table->buckets);
-			free(table);
-			errno = ENOMEM;
-			return NULL;
-		}
-	}
-   //successful creation of a hash table structure
-	table->hash_fun = ((!hash_fun) ? (table_hash_fun) : (hash_fun));
+   //bucket_num keys fit without growing the table
+   while (slot_num / LOAD_DEN * LOAD_NUM < bucket_num) slot_num *= 2;
+   if (slots_alloc(&table->curr, slot_num) != 0){
+      free(table);
+      return NULL;
+   }
+   table->old.slot = NULL;
+   table->old.num = 0;
+   table->old.used = 0;
+   table->moved = 0;
+   table->slot_min = slot_num;
+	table->hash_fun = hash_fun;
+   //every table gets its own seed, so that the keys colliding inside one do not inside another
+   table->seed = wy_mix((uint64_t) time(NULL) ^ (uint64_t) (uintptr_t) table ^ WY_SECRET[2],
+                        __atomic_add_fetch(&tables_created, 1, __ATOMIC_RELAXED) * FIBONACCI);
 	table->hash_cmp = ((!hash_cmp) ? (table_cmp) : (hash_cmp));
 	table->free_data = ((!free_data) ? (free) : (free_data));
 	return table;
 }
 
+/**
+ * @brief makes room for one more key, moving a few keys of the old array and starting a new
+ * resize once the last one is over.
+ * @returns 0 on success, -1 on failure.
+ * @exception errno is set to ENOMEM if malloc fails.
+*/
+static int table_reserve(hash_table_t* table){
+   table_move(table, MOVE_SLOTS);
+   if (!table->old.slot && (table->curr.used + 1) * LOAD_DEN > table->curr.num * LOAD_NUM)
+      return table_resize(table, table->curr.num * 2);
+   return 0;
+}
+
+/**
+ * @brief stores a key not inside the table, with room for its data before it.
+ * @returns the room for the data (the key alone if data_size is 0) on success, NULL on failure.
+ * @param hash of the key.
+ * @exception errno is set to ENOMEM if malloc fails.
+*/
+static char* table_add(hash_table_t* table, const void* key, size_t key_size, size_t hash, size_t data_size){
+   slot_t new;
+   char* block;
+   if (table_reserve(table) != 0) return NULL;
+   //one allocation holds the data followed by the key, the key alone if there is no data
+   block = malloc(data_size + key_size + 1);
+   if (!block){
+      errno = ENOMEM;
+      return NULL;
+   }
+   memcpy(block + data_size, key, key_size);
+   block[data_size + key_size] = '\0';
+   new.hash = hash;
+   new.data = (data_size != 0) ? block : NULL;
+   new.key = block + data_size;
+   slots_place(&table->curr, new);
+   return block;
+}
+
 int table_insert(hash_table_t* table, const void* key,
 		size_t key_size, const void* data, size_t data_size){
 	if (!table || !key || key_size == 0){
 		errno = EINVAL;
 		return -1;
 	}
-	int err;
-	const node_t* curr;
-	char* curr_key = NULL;
-   size_t hash = (*table->hash_fun)(key) % table->bucket_num;
-
-   for (curr = list_get_first((table->buckets)[hash]); curr; curr = node_get_next(curr)){
-		err = node_save_key(curr, &curr_key);
-      //anerror has occurred
-		if (err != 0) return -1;
-      //the key is already present
-		if (table->hash_cmp(key, curr_key) == 0){
-			free(curr_key);
-			return 0;
-		}
-		free(curr_key);
+   size_t hash = table_hash(table, key);
+   char* block;
+   //the key is already present
+   if (table_find_slot(table, key, hash, NULL, NULL)) return 0;
+   if (!(block = table_add(table, key, key_size, hash, data_size))) return -1;
+   if (data_size != 0) memcpy(block, data, data_size);
+	return 1;
+}
+
+int table_emplace(hash_table_t* table, const void* key, size_t key_size, size_t data_size, void** data){
+	if (!table || !key || key_size == 0 || data_size == 0 || !data){
+		errno = EINVAL;
+		return -1;
 	}
-   // add the new node at the end of the bucket
-	err = list_push_to_back((table->buckets)[hash], key, key_size, data, data_size);
-	if (err != 0) return -1;
+   size_t hash = table_hash(table, key);
+   slot_t* found;
+   //the key is already present, its data is given back
+   if ((found = table_find_slot(table, key, hash, NULL, NULL))){
+      *data = found->data;
+      return 0;
+   }
+   if (!(*data = table_add(table, key, key_size, hash, data_size))) return -1;
+   //the data is zeroed for the caller to build it where it is stored
+   memset(*data, 0, data_size);
 	return 1;
 }
 
-int table_is_in(const hash_table_t* table, const void* key){
-	if (!table || !key){
+int table_emplace_borrowed(hash_table_t* table, const char* key, size_t hash, size_t data_size, void** data){
+	if (!table || !key || data_size == 0 || !data){
 		errno = EINVAL;
 		return -1;
 	}
-   size_t hash = (*table->hash_fun)(key) % table->bucket_num;
-
-	const node_t* curr;
-	char* curr_key;
-	int err;
-	for (curr = list_get_first((table->buckets)[hash]); curr; curr = node_get_next(curr)){
-		err = node_save_key(curr, &curr_key);
-		//error
-      if (err != 0) return -1;
-      //found
-		if (table->hash_cmp(key, curr_key) == 0){
-			free(curr_key);
-			return 1;
-		}
-		free(curr_key);
+   slot_t* found;
+   slot_t new;
+   if ((found = table_find_slot(table, key, hash, NULL, NULL))){
+      *data = found->data;
+      return 0;
+   }
+   if (table_reserve(table) != 0) return -1;
+   //only the data is allocated, the key belongs to it
+   if (!(*data = calloc(1, data_size))){
+      errno = ENOMEM;
+      return -1;
+   }
+   new.hash = hash;
+   new.key = (char*) key;
+   new.data = *data;
+   slots_place(&table->curr, new);
+	return 1;
+}
+
+void* table_find(const hash_table_t* table, const void* key){
+	if (!table || !key){
+		errno = EINVAL;
+		return NULL;
 	}
+   return table_find_hashed(table, key, table_hash(table, key));
+}
+
+void* table_find_hashed(const hash_table_t* table, const void* key, size_t hash){
+	if (!table || !key){
+		errno = EINVAL;
+		return NULL;
+	}
+   slot_t* slot = table_find_slot(table, key, hash, NULL, NULL);
    //not found
-	return 0;
+   if (!slot){
+      errno = ENOENT;
+      return NULL;
+   }
+   return slot->data;
+}
+
+int table_is_in(const hash_table_t* table, const void* key){
+	if (!table || !key){
+		errno = EINVAL;
+		return -1;
+	}
+   return table_find_slot(table, key, table_hash(table, key), NULL, NULL) != NULL;
 }
 
 const void* table_get_value(const hash_table_t* table, const void* key){
@@ -173,26 +517,13 @@ const void* table_get_value(const hash_table_t* table, const void* key){
 		errno = EINVAL;
 		return NULL;
 	}
-	size_t hash = table->hash_fun((void*) key) % table->bucket_num;
-	const node_t* curr;
-	char* curr_key;
-	int err;
-	const void*  val;
-	for (curr = list_get_first((table->buckets)[hash]); curr; curr = node_get_next(curr)){
-		err = node_save_key(curr, &curr_key);
-      //an error has occurred
-		if (err != 0) return NULL;
-      //found, return it
-		if (table->hash_cmp(key, curr_key) == 0){
-			 val = node_get_value(curr);
-			free(curr_key);
-			return  val;
-		}
-		free(curr_key);
-	}
+   const slot_t* slot = table_find_slot(table, key, table_hash(table, key), NULL, NULL);
    //not found
-	errno = ENOENT;
-	return NULL;
+   if (!slot){
+      errno = ENOENT;
+      return NULL;
+   }
+   return slot->data;
 }
 
 int table_remove(hash_table_t* table, const void* key){
@@ -200,17 +531,49 @@ int table_remove(hash_table_t* table, const void* key){
 		errno = EINVAL;
 		return -1;
 	}
-   size_t hash = (*table->hash_fun)(key) % table->bucket_num;
-	return list_remove((table->buckets)[hash], key);
+   return table_remove_hashed(table, key, table_hash(table, key));
+}
+
+int table_remove_hashed(hash_table_t* table, const void* key, size_t hash){
+	if (!table || !key){
+		errno = EINVAL;
+		return -1;
+	}
+   const slots_t* where;
+   size_t pos;
+   int err;
+   slot_t* slot = table_find_slot(table, key, hash, &where, &pos);
+   //not found
+   if (!slot) return 1;
+   if (slot->data) table->free_data(slot->data);
+   else free(slot->key);
+   slots_delete((slots_t*) where, pos);
+   table_move(table, MOVE_SLOTS);
+   //shrinking is not needed for the removal to succeed, a failure leaves the table as it is
+   if (!table->old.slot && table->curr.num > table->slot_min && table->curr.used * SHRINK_DEN < table->curr.num){
+      err = errno;
+      table_resize(table, table->curr.num / 2);
+      errno = err;
+   }
+	return 0;
+}
+
+/**
+ * @brief releases the keys and data inside an array of slots, then the array.
+*/
+static void slots_free(hash_table_t* table, slots_t* slots){
+   for (size_t i = 0; i < slots->num; i++){
+      if (!slots->slot[i].key) continue;
+      if (slots->slot[i].data) table->free_data(slots->slot[i].data);
+      else free(slots->slot[i].key);
+   }
+   free(slots->slot);
 }
 
 void table_free(hash_table_t* table){
 	if (table){
-		for (size_t i = 0; i < table->bucket_num; i++){
-			list_free((table->buckets)[i]);
-		}
-		free(table->buckets);
+      slots_free(table, &table->curr);
+      if (table->old.slot) slots_free(table, &table->old);
 		free(table);
 	}
 }
-
@@ -0,0 +1,275 @@
+/**
+ * @brief implementation of the pool of interned paths, shared by the tables, the policy lists
+ * and the sessions of the cache.
+ *
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "intern.h"
+#include "hash_table.h"
+#include "slab.h"
+
+#define STRIPES 16 // independently locked parts of a pool, a string belongs to the one its hash picks
+#define SET_MIN 16 // initial slots of the set of a stripe
+#define SET_NUM 3 // a set grows when more than SET_NUM / SET_DEN of its slots are used
+#define SET_DEN 4
+#define FIBONACCI 11400714819323198485ull // 2^64 divided by the golden ratio, spreads the hashes over the slots
+
+typedef struct _stripe stripe_t;
+
+//header placed before every interned string
+typedef struct _interned{
+   stripe_t* stripe;
+   size_t hash;
+   //held by the files, the ghosts and the sessions naming the string
+   uint32_t refs;
+   uint32_t len;
+   char str[];
+} interned_t;
+
+//open addressing set of the strings of a stripe, an empty slot is NULL
+struct _stripe{
+   pthread_mutex_t mtx;
+   interned_t** slot;
+   size_t num;
+   unsigned int shift;
+   size_t used;
+   size_t bytes;
+};
+
+struct _intern_pool{
+   stripe_t stripes[STRIPES];
+};
+
+static pthread_once_t seed_once = PTHREAD_ONCE_INIT;
+static uint64_t seed; // seed of the hashes of every pool, so a hash is computed once for every table
+
+static void seed_init(void){
+   seed = ((uint64_t) time(NULL) * FIBONACCI) ^ (uint64_t) (uintptr_t) &seed_once;
+}
+
+/**
+ * @brief gets the header of an interned string.
+*/
+static interned_t* interned_of(const char* str){
+   return (interned_t*) (str - offsetof(interned_t, str));
+}
+
+/**
+ * @brief gets the slot a string with the given hash is stored at when no other string is in the way.
+*/
+static size_t stripe_home(const stripe_t* stripe, size_t hash){
+   return (size_t) (((uint64_t) hash * FIBONACCI) >> stripe->shift);
+}
+
+/**
+ * @brief allocates the slots of a set, all empty.
+ * @returns 0 on success, -1 on failure.
+ * @param num must be a power of 2.
+ * @exception errno is set to ENOMEM if malloc fails.
+*/
+static int stripe_alloc(stripe_t* stripe, size_t num){
+   unsigned int bits = 0;
+   stripe->slot = calloc(num, sizeof(interned_t*));
+   if (!stripe->slot){
+      errno = ENOMEM;
+      return -1;
+   }
+   while (((size_t) 1 << bits) < num) bits++;
+   stripe->num = num;
+   stripe->shift = 64 - bits;
+   return 0;
+}
+
+/**
+ * @brief places a string inside a set with an empty slot (linear probing).
+*/
+static void stripe_place(stripe_t* stripe, interned_t* entry){
+   size_t mask = stripe->num - 1;
+   size_t pos = stripe_home(stripe, entry->hash);
+   while (stripe->slot[pos]) pos = (pos + 1) & mask;
+   stripe->slot[pos] = entry;
+}
+
+/**
+ * @brief doubles the slots of a set.
+ * @returns 0 on success, -1 on failure.
+ * @exception errno is set to ENOMEM if malloc fails.
+*/
+static int stripe_grow(stripe_t* stripe){
+   stripe_t prev = *stripe;
+   if (stripe_alloc(stripe, prev.num * 2) != 0){
+      *stripe = prev;
+      return -1;
+   }
+   for (size_t i = 0; i < prev.num; i++)
+      if (prev.slot[i]) stripe_place(stripe, prev.slot[i]);
+   free(prev.slot);
+   return 0;
+}
+
+/**
+ * @brief empties a used slot of a set, the strings after it are moved back when their home
+ * slot allows it, so that no string is left behind an empty slot.
+*/
+static void stripe_delete(stripe_t* stripe, size_t pos){
+   size_t mask = stripe->num - 1;
+   size_t next = pos, home;
+   stripe->slot[pos] = NULL;
+   for (next = (next + 1) & mask; stripe->slot[next]; next = (next + 1) & mask){
+      home = stripe_home(stripe, stripe->slot[next]->hash);
+      //the string stays if its home slot is cyclically inside (pos, next]
+      if (((next - home) & mask) < ((next - pos) & mask)) continue;
+      stripe->slot[pos] = stripe->slot[next];
+      stripe->slot[next] = NULL;
+      pos = next;
+   }
+}
+
+intern_pool_t* intern_create(void){
+   int err;
+   size_t i;
+   intern_pool_t* new = malloc(sizeof(intern_pool_t));
+   if (!new){
+      errno = ENOMEM;
+      return NULL;
+   }
+   pthread_once(&seed_once, seed_init);
+   for (i = 0; i < STRIPES; i++){
+      if (stripe_alloc(&new->stripes[i], SET_MIN) != 0) goto failure;
+      if ((err = pthread_mutex_init(&new->stripes[i].mtx, NULL)) != 0){
+         free(new->stripes[i].slot);
+         errno = err;
+         goto failure;
+      }
+      new->stripes[i].used = 0;
+      new->stripes[i].bytes = 0;
+   }
+   return new;
+
+   failure:
+   err = errno;
+   while (i-- > 0){
+      pthread_mutex_destroy(&new->stripes[i].mtx);
+      free(new->stripes[i].slot);
+   }
+   free(new);
+   errno = err;
+   return NULL;
+}
+
+size_t intern_hash_str(const void* str){
+   if (!str) return 0;
+   pthread_once(&seed_once, seed_init);
+   return table_hash_seeded(str, seed);
+}
+
+const char* intern_get(intern_pool_t* pool, const char* str, size_t hash){
+   if (!pool || !str){
+      errno = EINVAL;
+      return NULL;
+   }
+   //the low bits of the hash pick the shard of the cache, the stripe is picked by other ones
+   stripe_t* stripe = &pool->stripes[(hash >> 16) % STRIPES];
+   size_t len = strlen(str);
+   size_t mask, pos;
+   interned_t* entry;
+
+   pthread_mutex_lock(&stripe->mtx);
+   mask = stripe->num - 1;
+   for (pos = stripe_home(stripe, hash); (entry = stripe->slot[pos]); pos = (pos + 1) & mask){
+      if (entry->hash == hash && entry->len == len && memcmp(entry->str, str, len) == 0){
+         //taken under the lock, so the string cannot be leaving the pool
+         __atomic_add_fetch(&entry->refs, 1, __ATOMIC_RELAXED);
+         pthread_mutex_unlock(&stripe->mtx);
+         return entry->str;
+      }
+   }
+   if ((stripe->used + 1) * SET_DEN > stripe->num * SET_NUM && stripe_grow(stripe) != 0){
+      pthread_mutex_unlock(&stripe->mtx);
+      return NULL;
+   }
+   entry = slab_alloc(sizeof(interned_t) + len + 1);
+   if (!entry){
+      pthread_mutex_unlock(&stripe->mtx);
+      errno = ENOMEM;
+      return NULL;
+   }
+   entry->stripe = stripe;
+   entry->hash = hash;
+   entry->refs = 1;
+   entry->len = (uint32_t) len;
+   memcpy(entry->str, str, len + 1);
+   stripe_place(stripe, entry);
+   stripe->used++;
+   stripe->bytes += sizeof(interned_t) + len + 1;
+   pthread_mutex_unlock(&stripe->mtx);
+   return entry->str;
+}
+
+const char* intern_ref(const char* str){
+   __atomic_add_fetch(&interned_of(str)->refs, 1, __ATOMIC_RELAXED);
+   return str;
+}
+
+void intern_put(const char* str){
+   if (!str) return;
+   interned_t* entry = interned_of(str);
+   stripe_t* stripe = entry->stripe;
+   size_t mask, pos;
+   uint32_t refs = __atomic_load_n(&entry->refs, __ATOMIC_RELAXED);
+   //references other than the last one are released without locking the stripe
+   while (refs > 1)
+      if (__atomic_compare_exchange_n(&entry->refs, &refs, refs - 1, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) return;
+   //the last reference is released under the lock, so that intern_get cannot find the string meanwhile
+   pthread_mutex_lock(&stripe->mtx);
+   if (__atomic_sub_fetch(&entry->refs, 1, __ATOMIC_ACQ_REL) != 0){
+      pthread_mutex_unlock(&stripe->mtx);
+      return;
+   }
+   mask = stripe->num - 1;
+   for (pos = stripe_home(stripe, entry->hash); stripe->slot[pos] != entry; pos = (pos + 1) & mask);
+   stripe_delete(stripe, pos);
+   stripe->used--;
+   stripe->bytes -= sizeof(interned_t) + entry->len + 1;
+   pthread_mutex_unlock(&stripe->mtx);
+   slab_free(entry);
+}
+
+size_t intern_hash(const char* str){
+   return interned_of(str)->hash;
+}
+
+size_t intern_len(const char* str){
+   return interned_of(str)->len;
+}
+
+void intern_stats(intern_pool_t* pool, size_t* strings, size_t* bytes){
+   size_t s = 0, b = 0;
+   for (size_t i = 0; i < STRIPES; i++){
+      pthread_mutex_lock(&pool->stripes[i].mtx);
+      s += pool->stripes[i].used;
+      b += pool->stripes[i].bytes;
+      pthread_mutex_unlock(&pool->stripes[i].mtx);
+   }
+   if (strings) *strings = s;
+   if (bytes) *bytes = b;
+}
+
+void intern_free(intern_pool_t* pool){
+   if (!pool) return;
+   for (size_t i = 0; i < STRIPES; i++){
+      for (size_t j = 0; j < pool->stripes[i].num; j++)
+         if (pool->stripes[i].slot[j]) slab_free(pool->stripes[i].slot[j]);
+      free(pool->stripes[i].slot);
+      pthread_mutex_destroy(&pool->stripes[i].mtx);
+   }
+   free(pool);
+}
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include "error_handlers.h"
 #include "linked_list.h"
+#include "slab.h"
 
 
 struct _node{
@@ -30,10 +31,10 @@ node_t* node_create(const char* key, size_t key_size, const void* val,
    node_t* new = NULL;
    char* new_key = NULL;
    void* new_val = NULL;
-   new = malloc(sizeof(node_t));
+   new = slab_alloc(sizeof(node_t));
    GOTO_NULL(new, err, cleanup);
    if (key_size != 0){
-      new_key = malloc(key_size + 1);
+      new_key = slab_alloc(key_size + 1);
       GOTO_NULL(new_key, err, cleanup);
       memset(new_key, 0, key_size + 1);
       memcpy(new_key, key, key_size);
@@ -54,9 +55,9 @@ node_t* node_create(const char* key, size_t key_size, const void* val,
 
    cleanup:
    err = errno;
-   free(new_key);
+   slab_free(new_key);
    free(new_val);
-   free(new);
+   slab_free(new);
    errno = err;
    return NULL;
 }
@@ -147,9 +148,9 @@ void node_free(node_t* node){
    if (node){
       if (node->prev) node->prev->next = node->next;
       if (node->next) node->next->prev = node->prev;
-      free(node->key);
+      slab_free(node->key);
       node->free_data(node->val);
-      free(node);
+      slab_free(node);
    }
 }
 
@@ -0,0 +1,162 @@
+/**
+ * @brief implementation of the LZ77 codec used for compressing the contents of cold files.
+ *
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lz.h"
+
+#define HASH_BITS 12 // positions remembered by the compressor, as a power of 2
+#define MATCH_MIN 4 // shortest copy worth encoding
+#define WINDOW_MAX 65535 // farthest copy, its offset is encoded with 2 bytes
+#define RUN_MASK 15 // lengths of a token, longer lengths continue in the next bytes
+
+/**
+ * @brief reads 4 bytes without alignment requirements.
+*/
+static uint32_t lz_read32(const unsigned char* p){
+   uint32_t v;
+   memcpy(&v, p, sizeof(v));
+   return v;
+}
+
+/**
+ * @brief hashes the 4 bytes starting a possible match (Fibonacci hashing).
+*/
+static size_t lz_hash(uint32_t v){
+   return (size_t) ((v * 2654435761U) >> (32 - HASH_BITS));
+}
+
+/**
+ * @brief writes the part of a length not fitting in its token.
+ * @returns the position after the length, NULL if it does not fit before end.
+*/
+static unsigned char* lz_put_length(unsigned char* op, const unsigned char* end, size_t len){
+   for (; len >= 255; len -= 255){
+      if (op == end) return NULL;
+      *op++ = 255;
+   }
+   if (op == end) return NULL;
+   *op++ = (unsigned char) len;
+   return op;
+}
+
+/**
+ * @brief writes a sequence: a token, the literals and, if match_len != 0, the copy.
+ * @returns the position after the sequence, NULL if it does not fit before end.
+*/
+static unsigned char* lz_put_sequence(unsigned char* op, const unsigned char* end, const unsigned char* lit,
+                                      size_t lit_len, size_t offset, size_t match_len){
+   size_t extra = match_len ? match_len - MATCH_MIN : 0;
+   if (op == end) return NULL;
+   *op++ = (unsigned char) ((lit_len < RUN_MASK ? lit_len : RUN_MASK) << 4 |
+                            (extra < RUN_MASK ? extra : RUN_MASK));
+   if (lit_len >= RUN_MASK && !(op = lz_put_length(op, end, lit_len - RUN_MASK))) return NULL;
+   if ((size_t) (end - op) < lit_len) return NULL;
+   memcpy(op, lit, lit_len);
+   op += lit_len;
+   //the last sequence has no copy
+   if (!match_len) return op;
+   if (end - op < 2) return NULL;
+   *op++ = (unsigned char) (offset & 0xff);
+   *op++ = (unsigned char) (offset >> 8);
+   if (extra >= RUN_MASK && !(op = lz_put_length(op, end, extra - RUN_MASK))) return NULL;
+   return op;
+}
+
+size_t lz_compress(const void* src, size_t size, void* dst, size_t capacity){
+   if (!src || !dst){
+      errno = EINVAL;
+      return 0;
+   }
+   const unsigned char* in = src;
+   unsigned char* op = dst;
+   const unsigned char* end = op + capacity;
+   //last position + 1 of each hash, 0 if none
+   size_t table[1 << HASH_BITS];
+   size_t pos = 0, anchor = 0, ref, len, h;
+   uint32_t v;
+
+   memset(table, 0, sizeof(table));
+   while (size >= MATCH_MIN && pos <= size - MATCH_MIN){
+      v = lz_read32(in + pos);
+      h = lz_hash(v);
+      ref = table[h];
+      table[h] = pos + 1;
+      if (ref == 0 || pos - (ref - 1) > WINDOW_MAX || lz_read32(in + ref - 1) != v){
+         pos++;
+         continue;
+      }
+      //extend the match as far as it goes, it may overlap the bytes being encoded
+      ref--;
+      for (len = MATCH_MIN; pos + len < size && in[ref + len] == in[pos + len]; len++);
+      op = lz_put_sequence(op, end, in + anchor, pos - anchor, pos - ref, len);
+      if (!op) return 0;
+      pos += len;
+      anchor = pos;
+   }
+   op = lz_put_sequence(op, end, in + anchor, size - anchor, 0, 0);
+   if (!op) return 0;
+   return (size_t) (op - (unsigned char*) dst);
+}
+
+/**
+ * @brief reads the part of a length not fitting in its token.
+ * @returns the position after the length, NULL if the input ends before it.
+*/
+static const unsigned char* lz_get_length(const unsigned char* ip, const unsigned char* end, size_t* len){
+   unsigned char b;
+   do{
+      if (ip == end) return NULL;
+      b = *ip++;
+      *len += b;
+   }while (b == 255);
+   return ip;
+}
+
+int lz_decompress(const void* src, size_t size, void* dst, size_t raw_size){
+   if (!src || !dst){
+      errno = EINVAL;
+      return -1;
+   }
+   const unsigned char* ip = src;
+   const unsigned char* in_end = ip + size;
+   unsigned char* out = dst;
+   unsigned char* op = out;
+   unsigned char* out_end = out + raw_size;
+   unsigned char token;
+   size_t len, offset;
+
+   while (ip < in_end){
+      token = *ip++;
+      //literals
+      len = token >> 4;
+      if (len == RUN_MASK && !(ip = lz_get_length(ip, in_end, &len))) goto corrupted;
+      if ((size_t) (in_end - ip) < len || (size_t) (out_end - op) < len) goto corrupted;
+      memcpy(op, ip, len);
+      ip += len;
+      op += len;
+      //the last sequence has no copy
+      if (ip == in_end) break;
+      //copy from the bytes already decompressed
+      if (in_end - ip < 2) goto corrupted;
+      offset = (size_t) ip[0] | (size_t) ip[1] << 8;
+      ip += 2;
+      if (offset == 0 || offset > (size_t) (op - out)) goto corrupted;
+      len = token & RUN_MASK;
+      if (len == RUN_MASK && !(ip = lz_get_length(ip, in_end, &len))) goto corrupted;
+      len += MATCH_MIN;
+      if ((size_t) (out_end - op) < len) goto corrupted;
+      //byte by byte, the copy may overlap the bytes it writes
+      for (; len > 0; len--, op++) *op = *(op - offset);
+   }
+   if (op != out_end) goto corrupted;
+   return 0;
+
+   corrupted:
+   errno = EINVAL;
+   return -1;
+}
@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <errno.h>
 #include "rw_lock.h"
+#include "slab.h"
 #include "error_handlers.h"
 
 struct _rw_lock{
@@ -31,7 +32,7 @@ rw_lock_t* lock_create(){
 	err = pthread_cond_init(&cond, NULL);
 	GOTO_NZ(err, errno_cpy, cleanup);
 	cond_set = true;
-	new = malloc(sizeof(rw_lock_t));
+	new = slab_alloc(sizeof(rw_lock_t));
 	GOTO_NULL(new, errno_cpy, cleanup);
 
 	new->cond = cond;
@@ -43,7 +44,7 @@ rw_lock_t* lock_create(){
 	cleanup:
 		if (mutex_set) pthread_mutex_destroy(&peek);
 		if (cond_set) pthread_cond_destroy(&cond);
-		free(new);
+		slab_free(new);
 		errno = errno_cpy;
 		return NULL;
 }
@@ -117,6 +118,25 @@ int lock_for_writing(rw_lock_t* lock){
 	else return 0;
 }
 
+int try_lock_for_writing(rw_lock_t* lock){
+	if (!lock){
+		errno = EINVAL;
+		return -1;
+	}
+	int err;
+	int busy = 0;
+   //acquire lock over the structure
+	err = pthread_mutex_lock(&(lock->mutex));
+	if (err != 0) return -1;
+   //the lock is taken only if nobody holds it, no waiting
+	if (lock->writer || lock->readers) busy = 1;
+	else lock->writer = true;
+   //release the lock over the structure
+	err = pthread_mutex_unlock(&(lock->mutex));
+	if (err != 0) return -1;
+	return busy;
+}
+
 int unlock_for_writing(rw_lock_t* lock){
 	if (!lock){
 		errno = EINVAL;
@@ -140,5 +160,5 @@ void lock_free(rw_lock_t* lock){
 	if (!lock) return;
 	pthread_mutex_destroy(&(lock->mutex));
 	pthread_cond_destroy(&(lock->cond));
-	free(lock);
+	slab_free(lock);
 }
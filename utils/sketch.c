@@ -0,0 +1,112 @@
+/**
+ * @brief implementation for the count-min sketch used by the admission filter of the cache.
+ *
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sketch.h"
+
+#define SKETCH_DEPTH 4 // number of rows, each one indexed by a different hash
+#define COUNTER_MAX 15 // counters saturate like 4 bit counters
+
+struct _sketch{
+   //SKETCH_DEPTH rows of width counters each
+   unsigned char* counters;
+   size_t width;
+   //increments done since the last aging and increments triggering the aging
+   size_t additions;
+   size_t sample;
+};
+
+/**
+ * @brief FNV-1a hash of a string.
+*/
+static uint64_t sketch_hash(const char* key){
+   uint64_t hash = 14695981039346656037ULL;
+   for (; *key; key++){
+      hash ^= (unsigned char) *key;
+      hash *= 1099511628211ULL;
+   }
+   return hash;
+}
+
+/**
+ * @brief gets the index of the counter of a key in a row, derived from the two
+ * halves of the hash of the key (double hashing).
+*/
+static size_t sketch_index(const sketch_t* sketch, uint64_t hash, size_t row){
+   uint32_t low = (uint32_t) hash;
+   uint32_t high = (uint32_t) (hash >> 32);
+   return row * sketch->width + ((low + row * (high | 1)) & (sketch->width - 1));
+}
+
+/**
+ * @brief halves all the counters, so that old occurrences weigh less than recent ones.
+*/
+static void sketch_age(sketch_t* sketch){
+   for (size_t i = 0; i < SKETCH_DEPTH * sketch->width; i++)
+      sketch->counters[i] >>= 1;
+   sketch->additions /= 2;
+}
+
+sketch_t* sketch_create(size_t width, size_t sample){
+   if (width == 0 || sample == 0){
+      errno = EINVAL;
+      return NULL;
+   }
+   sketch_t* sketch = malloc(sizeof(sketch_t));
+   if (!sketch){
+      errno = ENOMEM;
+      return NULL;
+   }
+   //a power of 2 lets the index be computed with a mask
+   sketch->width = 1;
+   while (sketch->width < width) sketch->width <<= 1;
+   sketch->counters = calloc(SKETCH_DEPTH * sketch->width, sizeof(unsigned char));
+   if (!sketch->counters){
+      free(sketch);
+      errno = ENOMEM;
+      return NULL;
+   }
+   sketch->additions = 0;
+   sketch->sample = sample;
+   return sketch;
+}
+
+int sketch_increment(sketch_t* sketch, const char* key){
+   if (!sketch || !key){
+      errno = EINVAL;
+      return -1;
+   }
+   uint64_t hash = sketch_hash(key);
+   for (size_t row = 0; row < SKETCH_DEPTH; row++){
+      unsigned char* counter = &sketch->counters[sketch_index(sketch, hash, row)];
+      if (*counter < COUNTER_MAX) (*counter)++;
+   }
+   if (++sketch->additions >= sketch->sample) sketch_age(sketch);
+   return 0;
+}
+
+unsigned int sketch_estimate(const sketch_t* sketch, const char* key){
+   if (!sketch || !key){
+      errno = EINVAL;
+      return 0;
+   }
+   uint64_t hash = sketch_hash(key);
+   unsigned int estimate = COUNTER_MAX;
+   //the estimate is the smallest counter, the one with the fewest collisions
+   for (size_t row = 0; row < SKETCH_DEPTH; row++){
+      unsigned char counter = sketch->counters[sketch_index(sketch, hash, row)];
+      if (counter < estimate) estimate = counter;
+   }
+   return estimate;
+}
+
+void sketch_free(sketch_t* sketch){
+   if (!sketch) return;
+   free(sketch->counters);
+   free(sketch);
+}
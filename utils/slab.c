@@ -0,0 +1,274 @@
+/**
+ * @brief implementation of the slab allocator used for file contents, metadata and list nodes.
+ *
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "slab.h"
+
+#define SLAB_SIZE 65536 // size of the objects of a slab, a slab holds at least one object
+#define EMPTY_MAX 1 // empty slabs kept by a size class, the others are released
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+struct _slab_class;
+
+//contiguous block of memory split into objects of the same size
+typedef struct _slab{
+   struct _slab_class* class;
+   //slabs of the class with free objects
+   struct _slab* prev;
+   struct _slab* next;
+   //objects given back and objects never used yet
+   void* free;
+   char* fresh;
+   char* end;
+   size_t used;
+} slab_t;
+
+//header placed before every object, keeps objects aligned as malloc does
+typedef union _header{
+   struct{
+      //slab of the object, NULL if it was allocated with malloc
+      slab_t* slab;
+      //size requested for the object
+      size_t size;
+   } info;
+   long double align;
+   long long align_int;
+   void* align_ptr;
+} header_t;
+
+//objects of the same size, including their header
+typedef struct _slab_class{
+   pthread_mutex_t mutex;
+   size_t size;
+   slab_t* partial;
+   size_t slabs;
+   size_t empty;
+   size_t slab_size;
+   //objects in use and bytes requested for them
+   size_t used;
+   size_t requested;
+} slab_class_t;
+
+#define CLASS(s) { PTHREAD_MUTEX_INITIALIZER, (s), NULL, 0, 0, 0, 0, 0 }
+
+//size classes grow by 1.5x, so at most a third of an object is lost to rounding. Larger
+//objects, the contents of files, go to malloc: rounding them up to a class would waste more
+//than the slabs save, and the classes holding one object per slab keep an empty slab each
+static slab_class_t classes[] = {
+   CLASS(32), CLASS(48), CLASS(64), CLASS(96), CLASS(128), CLASS(192), CLASS(256),
+   CLASS(384), CLASS(512), CLASS(768), CLASS(1024), CLASS(1536), CLASS(2048),
+   CLASS(3072), CLASS(4096)
+};
+#define CLASS_NUM (sizeof(classes) / sizeof(classes[0]))
+
+//allocations larger than every class
+static pthread_mutex_t large_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t large_used = 0;
+static size_t large_requested = 0;
+
+/**
+ * @brief gets the smallest size class fitting size bytes, header included.
+ * @returns the size class, NULL if size is larger than every class.
+*/
+static slab_class_t* slab_get_class(size_t size){
+   size_t low = 0;
+   size_t high = CLASS_NUM;
+   size_t mid;
+   if (size > SIZE_MAX - sizeof(header_t)) return NULL;
+   size += sizeof(header_t);
+   //binary search of the first class at least as large as size
+   while (low < high){
+      mid = (low + high) / 2;
+      if (classes[mid].size < size) low = mid + 1;
+      else high = mid;
+   }
+   return low < CLASS_NUM ? &classes[low] : NULL;
+}
+
+/**
+ * @brief unlinks a slab from the slabs of its class with free objects.
+*/
+static void slab_unlink(slab_t* slab){
+   if (slab->prev) slab->prev->next = slab->next;
+   else slab->class->partial = slab->next;
+   if (slab->next) slab->next->prev = slab->prev;
+   slab->prev = NULL;
+   slab->next = NULL;
+}
+
+/**
+ * @brief links a slab to the slabs of its class with free objects.
+*/
+static void slab_link(slab_t* slab){
+   slab->prev = NULL;
+   slab->next = slab->class->partial;
+   if (slab->next) slab->next->prev = slab;
+   slab->class->partial = slab;
+}
+
+/**
+ * @brief creates a new slab for a size class, the class mutex must be held.
+ * @returns the slab on success, NULL on failure.
+*/
+static slab_t* slab_create(slab_class_t* class){
+   //the objects start right after the slab, rounded up to keep them aligned,
+   //and fill it with no space left at the end
+   size_t offset = (sizeof(slab_t) + sizeof(header_t) - 1) / sizeof(header_t) * sizeof(header_t);
+   size_t size = offset + MAX(SLAB_SIZE / class->size, 1) * class->size;
+   slab_t* new = malloc(size);
+   if (!new) return NULL;
+   new->class = class;
+   new->free = NULL;
+   new->fresh = (char*) new + offset;
+   new->end = (char*) new + size;
+   new->used = 0;
+   class->slabs++;
+   class->slab_size = size;
+   slab_link(new);
+   return new;
+}
+
+void* slab_alloc(size_t size){
+   header_t* header;
+   slab_t* slab;
+   slab_class_t* class = slab_get_class(size);
+
+   //too large for the size classes
+   if (!class){
+      if (size > SIZE_MAX - sizeof(header_t) || !(header = malloc(sizeof(header_t) + size))){
+         errno = ENOMEM;
+         return NULL;
+      }
+      header->info.slab = NULL;
+      header->info.size = size;
+      pthread_mutex_lock(&large_mutex);
+      large_used++;
+      large_requested += size;
+      pthread_mutex_unlock(&large_mutex);
+      return header + 1;
+   }
+
+   pthread_mutex_lock(&class->mutex);
+   slab = class->partial;
+   if (!slab && !(slab = slab_create(class))){
+      pthread_mutex_unlock(&class->mutex);
+      errno = ENOMEM;
+      return NULL;
+   }
+   //an empty slab is being used again
+   if (slab->used == 0 && slab->free) class->empty--;
+   //reuse a freed object first, then carve a new one
+   if (slab->free){
+      header = slab->free;
+      slab->free = *(void**) slab->free;
+   }else{
+      header = (header_t*) slab->fresh;
+      slab->fresh += class->size;
+   }
+   slab->used++;
+   //the slab is full
+   if (!slab->free && slab->fresh + class->size > slab->end) slab_unlink(slab);
+   class->used++;
+   class->requested += size;
+   pthread_mutex_unlock(&class->mutex);
+
+   header->info.slab = slab;
+   header->info.size = size;
+   return header + 1;
+}
+
+void* slab_realloc(void* ptr, size_t size){
+   if (!ptr) return slab_alloc(size);
+   header_t* header = (header_t*) ptr - 1;
+   void* new;
+   //the object already fits its size class
+   if (header->info.slab && slab_get_class(size) == header->info.slab->class){
+      pthread_mutex_lock(&header->info.slab->class->mutex);
+      header->info.slab->class->requested += size;
+      header->info.slab->class->requested -= header->info.size;
+      pthread_mutex_unlock(&header->info.slab->class->mutex);
+      header->info.size = size;
+      return ptr;
+   }
+   if (!(new = slab_alloc(size))) return NULL;
+   memcpy(new, ptr, header->info.size < size ? header->info.size : size);
+   slab_free(ptr);
+   return new;
+}
+
+void slab_free(void* ptr){
+   if (!ptr) return;
+   header_t* header = (header_t*) ptr - 1;
+   slab_t* slab = header->info.slab;
+   slab_class_t* class;
+
+   if (!slab){
+      pthread_mutex_lock(&large_mutex);
+      large_used--;
+      large_requested -= header->info.size;
+      pthread_mutex_unlock(&large_mutex);
+      free(header);
+      return;
+   }
+
+   class = slab->class;
+   pthread_mutex_lock(&class->mutex);
+   class->used--;
+   class->requested -= header->info.size;
+   //the slab was full, it has a free object again
+   if (!slab->free && slab->fresh + class->size > slab->end) slab_link(slab);
+   *(void**) header = slab->free;
+   slab->free = header;
+   slab->used--;
+   //the slab is empty, it is released if the class already keeps enough empty slabs
+   if (slab->used == 0){
+      if (class->empty == EMPTY_MAX){
+         slab_unlink(slab);
+         class->slabs--;
+         free(slab);
+      }else{
+         class->empty++;
+      }
+   }
+   pthread_mutex_unlock(&class->mutex);
+}
+
+size_t slab_overhead(void){
+   return sizeof(header_t);
+}
+
+void slab_print(FILE* stream){
+   if (!stream) return;
+   size_t reserved, in_use, wasted;
+   size_t tot_reserved = 0, tot_requested = 0;
+   slab_class_t* class;
+   fprintf(stream, "Slab allocator (class size: slabs, bytes reserved, objects in use, bytes requested,"
+           " bytes wasted by rounding, bytes free in slabs):\n");
+   for (size_t i = 0; i < CLASS_NUM; i++){
+      class = &classes[i];
+      pthread_mutex_lock(&class->mutex);
+      if (class->slabs != 0){
+         reserved = class->slabs * class->slab_size;
+         in_use = class->used * class->size;
+         wasted = in_use - class->requested;
+         fprintf(stream, "\t%lu: %lu, %lu, %lu, %lu, %lu, %lu\n", class->size, class->slabs,
+                 reserved, class->used, class->requested, wasted, reserved - in_use);
+         tot_reserved += reserved;
+         tot_requested += class->requested;
+      }
+      pthread_mutex_unlock(&class->mutex);
+   }
+   pthread_mutex_lock(&large_mutex);
+   fprintf(stream, "\tlarge: %lu objects in use, %lu bytes requested\n", large_used, large_requested);
+   tot_reserved += large_requested + large_used * sizeof(header_t);
+   tot_requested += large_requested;
+   pthread_mutex_unlock(&large_mutex);
+   fprintf(stream, "\ttotal: %lu bytes reserved for %lu bytes requested\n", tot_reserved, tot_requested);
+}
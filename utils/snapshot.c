@@ -0,0 +1,278 @@
+/**
+ * @brief implementation of the snapshots of the files stored inside the cache, saved at shutdown
+ * and loaded back at startup.
+ *
+*/
+#define _POSIX_C_SOURCE 200112L
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "snapshot.h"
+
+#define SNAPSHOT_MAGIC "SOLSNAP2" // first bytes of a snapshot, with the version of its format
+#define SNAPSHOT_TMP ".tmp" // suffix of the file a snapshot is written to before being renamed
+#define ALIGN(x) (((x) + 7) & ~(size_t) 7) // entries of the index are aligned to 8 bytes
+
+//the integers are written in the byte order of the host, snapshots are not meant to be moved
+typedef struct _header{
+   char magic[8];
+   uint64_t files;
+   //first segment of the write-ahead log with changes made after the snapshot, 0 if none
+   uint64_t log;
+} header_t;
+
+//entry of the index, followed by the name of the file with its terminator
+typedef struct _disk_entry{
+   //position of the contents from the start of the snapshot
+   uint64_t offset;
+   uint64_t size;
+   uint64_t raw_size;
+   int64_t last_used;
+   int64_t freq;
+   double priority;
+   uint32_t frequent;
+   uint32_t name_len;
+} disk_entry_t;
+
+struct _snapshot{
+   char* data;
+   size_t size;
+   //entries of the index, pointing inside the mapping
+   const disk_entry_t** entries;
+   size_t files;
+   unsigned long log;
+   //held by the opener and by the blobs over the contents
+   size_t refs;
+};
+
+int snapshot_write(const char* path, const snapshot_entry_t* entries, size_t num, unsigned long log){
+   if (!path || (!entries && num != 0)){
+      errno = EINVAL;
+      return -1;
+   }
+   int err;
+   FILE* file;
+   char* tmp;
+   header_t header;
+   disk_entry_t entry;
+   struct iovec iov[16];
+   size_t offset, first, chunks;
+   const char pad[8] = { 0 };
+
+   tmp = malloc(strlen(path) + strlen(SNAPSHOT_TMP) + 1);
+   if (!tmp){
+      errno = ENOMEM;
+      return -1;
+   }
+   sprintf(tmp, "%s%s", path, SNAPSHOT_TMP);
+   file = fopen(tmp, "w");
+   if (!file){
+      free(tmp);
+      return -1;
+   }
+   memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+   header.files = num;
+   header.log = log;
+   if (fwrite(&header, sizeof(header), 1, file) != 1) goto failure;
+   //the contents follow the index
+   offset = sizeof(header);
+   for (size_t i = 0; i < num; i++) offset += sizeof(disk_entry_t) + ALIGN(strlen(entries[i].name) + 1);
+   for (size_t i = 0; i < num; i++){
+      memset(&entry, 0, sizeof(entry));
+      entry.offset = offset;
+      entry.size = entries[i].contents ? blob_get_size(entries[i].contents) : 0;
+      entry.raw_size = entries[i].raw_size;
+      entry.last_used = (int64_t) entries[i].last_used;
+      entry.freq = entries[i].freq;
+      entry.priority = entries[i].priority;
+      entry.frequent = entries[i].frequent;
+      entry.name_len = (uint32_t) strlen(entries[i].name) + 1;
+      if (fwrite(&entry, sizeof(entry), 1, file) != 1 ||
+          fwrite(entries[i].name, 1, entry.name_len, file) != entry.name_len ||
+          fwrite(pad, 1, ALIGN(entry.name_len) - entry.name_len, file) != ALIGN(entry.name_len) - entry.name_len)
+         goto failure;
+      offset += entry.size;
+   }
+   for (size_t i = 0; i < num; i++){
+      if (!entries[i].contents) continue;
+      first = 0;
+      while ((chunks = blob_get_chunks(entries[i].contents, iov, first, 16)) != 0){
+         for (size_t j = 0; j < chunks; j++)
+            if (fwrite(iov[j].iov_base, 1, iov[j].iov_len, file) != iov[j].iov_len) goto failure;
+         first += chunks;
+      }
+   }
+   //the snapshot replaces the old one only once it is on disk
+   if (fflush(file) != 0 || fsync(fileno(file)) != 0) goto failure;
+   if (fclose(file) != 0){
+      file = NULL;
+      goto failure;
+   }
+   file = NULL;
+   if (rename(tmp, path) != 0) goto failure;
+   free(tmp);
+   return 0;
+
+   failure:
+   err = errno;
+   if (file) fclose(file);
+   unlink(tmp);
+   free(tmp);
+   errno = err;
+   return -1;
+}
+
+/**
+ * @brief releases a reference to a snapshot, unmapping it with the last one.
+ * @param data to be converted to a snapshot.
+*/
+static void snapshot_unref(void* data){
+   snapshot_t* snapshot = (snapshot_t*) data;
+   if (__atomic_sub_fetch(&snapshot->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+   if (snapshot->data) munmap(snapshot->data, snapshot->size);
+   free(snapshot->entries);
+   free(snapshot);
+}
+
+snapshot_t* snapshot_open(const char* path){
+   if (!path){
+      errno = EINVAL;
+      return NULL;
+   }
+   int fd, err;
+   struct stat st;
+   size_t pos;
+   const header_t* header;
+   const disk_entry_t* entry;
+   snapshot_t* new = malloc(sizeof(snapshot_t));
+   if (!new){
+      errno = ENOMEM;
+      return NULL;
+   }
+   new->data = NULL;
+   new->entries = NULL;
+   new->files = 0;
+   new->log = 0;
+   new->refs = 1;
+
+   fd = open(path, O_RDONLY);
+   if (fd == -1){
+      free(new);
+      return NULL;
+   }
+   if (fstat(fd, &st) == -1) goto failure;
+   new->size = (size_t) st.st_size;
+   if (new->size < sizeof(header_t)){
+      errno = EINVAL;
+      goto failure;
+   }
+   //the contents are paged in by the first access to each of them
+   new->data = mmap(NULL, new->size, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (new->data == MAP_FAILED){
+      new->data = NULL;
+      goto failure;
+   }
+   close(fd);
+   fd = -1;
+
+   header = (const header_t*) new->data;
+   if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+       header->files > (new->size - sizeof(header_t)) / sizeof(disk_entry_t)){
+      errno = EINVAL;
+      goto failure;
+   }
+   new->entries = malloc(sizeof(disk_entry_t*) * (header->files ? header->files : 1));
+   if (!new->entries){
+      errno = ENOMEM;
+      goto failure;
+   }
+   //every entry, name and contents must lie inside the file
+   pos = sizeof(header_t);
+   for (new->files = 0; new->files < header->files; new->files++){
+      if (new->size - pos < sizeof(disk_entry_t)){
+         errno = EINVAL;
+         goto failure;
+      }
+      entry = (const disk_entry_t*) (new->data + pos);
+      pos += sizeof(disk_entry_t);
+      if (entry->name_len == 0 || new->size - pos < ALIGN(entry->name_len) ||
+          new->data[pos + entry->name_len - 1] != '\0' ||
+          entry->offset > new->size || entry->size > new->size - entry->offset){
+         errno = EINVAL;
+         goto failure;
+      }
+      pos += ALIGN(entry->name_len);
+      new->entries[new->files] = entry;
+   }
+   new->log = (unsigned long) header->log;
+   return new;
+
+   failure:
+   err = errno;
+   if (fd != -1) close(fd);
+   snapshot_unref(new);
+   errno = err;
+   return NULL;
+}
+
+size_t snapshot_get_files(const snapshot_t* snapshot){
+   if (!snapshot){
+      errno = EINVAL;
+      return 0;
+   }
+   return snapshot->files;
+}
+
+unsigned long snapshot_get_log(const snapshot_t* snapshot){
+   if (!snapshot){
+      errno = EINVAL;
+      return 0;
+   }
+   return snapshot->log;
+}
+
+int snapshot_get_entry(const snapshot_t* snapshot, size_t i, snapshot_entry_t* entry){
+   if (!snapshot || i >= snapshot->files || !entry){
+      errno = EINVAL;
+      return -1;
+   }
+   const disk_entry_t* disk = snapshot->entries[i];
+   entry->name = (const char*) (disk + 1);
+   entry->contents = NULL;
+   entry->size = disk->size;
+   entry->raw_size = disk->raw_size;
+   entry->last_used = (time_t) disk->last_used;
+   entry->freq = (int) disk->freq;
+   entry->priority = disk->priority;
+   entry->frequent = disk->frequent != 0;
+   return 0;
+}
+
+int snapshot_get_contents(snapshot_t* snapshot, size_t i, blob_t** contents){
+   if (!snapshot || i >= snapshot->files || !contents){
+      errno = EINVAL;
+      return -1;
+   }
+   const disk_entry_t* disk = snapshot->entries[i];
+   *contents = NULL;
+   if (disk->size == 0) return 0;
+   //the blob holds the mapping until it is released
+   __atomic_add_fetch(&snapshot->refs, 1, __ATOMIC_RELAXED);
+   *contents = blob_wrap(snapshot->data + disk->offset, disk->size, snapshot_unref, snapshot);
+   if (!*contents){
+      snapshot_unref(snapshot);
+      return -1;
+   }
+   return 0;
+}
+
+void snapshot_close(snapshot_t* snapshot){
+   if (!snapshot) return;
+   snapshot_unref(snapshot);
+}
@@ -0,0 +1,337 @@
+/**
+ * @brief implementation of the second tier of the cache, holding the evicted files on local storage.
+ *
+*/
+#define _POSIX_C_SOURCE 200112L
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "spill.h"
+#include "hash_table.h"
+#include "linked_list.h"
+
+#define SEGMENT_SIZE 1048576 // size of the segment files, larger files get a segment of their own
+#define SEGMENTS_MIN 8 // min number of segments inside a full tier, so that a drop frees a small part of it
+#define INDEX_BUCKETS 1024 // buckets of the table indexing the files spilled
+#define SEGMENT_PATH_MAX 4096 // length of the path of a segment file
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+
+//memory mapped file the spilled files are appended to
+typedef struct _segment{
+   unsigned long id;
+   char* data;
+   size_t size;
+   size_t used;
+   //files spilled to the segment still inside the tier
+   size_t files;
+   //names of the files spilled to the segment, some of them may have left it
+   linked_list_t* names;
+   struct _segment* next;
+} segment_t;
+
+//position of a spilled file inside its segment
+typedef struct _spilled{
+   segment_t* segment;
+   size_t offset;
+   size_t size;
+   size_t raw_size;
+} spilled_t;
+
+struct _spill{
+   char* dir;
+   size_t size_max;
+   //total size of the segment files
+   size_t size;
+   //segments in order of creation, files are appended to the newest
+   segment_t* oldest;
+   segment_t* newest;
+   unsigned long next_id;
+   //spilled files by name
+   hash_table_t* index;
+   pthread_mutex_t mutex;
+
+   //files spilled, files dropped with their segment, files taken back and files not found
+   size_t spills;
+   size_t drops;
+   size_t hits;
+   size_t misses;
+};
+
+/**
+ * @brief creates an empty segment file and maps it in memory.
+ * @returns the segment on success, NULL on failure.
+*/
+static segment_t* segment_create(spill_t* spill, size_t size){
+   int fd;
+   int err;
+   char path[SEGMENT_PATH_MAX];
+   segment_t* new = malloc(sizeof(segment_t));
+   if (!new){
+      errno = ENOMEM;
+      return NULL;
+   }
+   new->names = list_create(NULL);
+   if (!new->names){
+      free(new);
+      errno = ENOMEM;
+      return NULL;
+   }
+   new->id = spill->next_id++;
+   snprintf(path, SEGMENT_PATH_MAX, "%s/segment%lu", spill->dir, new->id);
+   fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+   if (fd == -1) goto cleanup;
+   if (ftruncate(fd, (off_t) size) == -1) goto cleanup;
+   new->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if (new->data == MAP_FAILED) goto cleanup;
+   //the mapping stays valid after the file is closed
+   close(fd);
+   new->size = size;
+   new->used = 0;
+   new->files = 0;
+   new->next = NULL;
+   return new;
+
+   cleanup:
+   err = errno;
+   if (fd != -1){
+      close(fd);
+      unlink(path);
+   }
+   list_free(new->names);
+   free(new);
+   errno = err;
+   return NULL;
+}
+
+/**
+ * @brief unlinks a segment from the list of segments, unmaps it and removes its file.
+*/
+static void segment_release(spill_t* spill, segment_t* segment){
+   char path[SEGMENT_PATH_MAX];
+   segment_t* prev = NULL;
+   for (segment_t* curr = spill->oldest; curr != segment; curr = curr->next) prev = curr;
+   if (prev) prev->next = segment->next;
+   else spill->oldest = segment->next;
+   if (spill->newest == segment) spill->newest = prev;
+   spill->size -= segment->size;
+   munmap(segment->data, segment->size);
+   snprintf(path, SEGMENT_PATH_MAX, "%s/segment%lu", spill->dir, segment->id);
+   unlink(path);
+   list_free(segment->names);
+   free(segment);
+}
+
+/**
+ * @brief removes a spilled file from the index, releasing its segment if no other
+ * file is inside it and no file is going to be appended to it.
+ * @returns 0 on success, -1 on failure.
+*/
+static int spilled_remove(spill_t* spill, const char* name, spilled_t* spilled){
+   segment_t* segment = spilled->segment;
+   if (table_remove(spill->index, name) != 0) return -1;
+   segment->files--;
+   if (segment->files == 0 && segment != spill->newest) segment_release(spill, segment);
+   return 0;
+}
+
+/**
+ * @brief drops the oldest segment with all the files still inside it.
+ * @returns 0 on success, -1 on failure.
+*/
+static int segment_drop(spill_t* spill){
+   segment_t* segment = spill->oldest;
+   spilled_t* spilled;
+   char* name;
+   //a name whose file has been spilled again or taken back points to another segment or to none
+   while (list_get_size(segment->names) != 0){
+      name = NULL;
+      list_pop_from_front(segment->names, &name, NULL);
+      if (!name) return -1;
+      spilled = (spilled_t*) table_get_value(spill->index, name);
+      if (spilled && spilled->segment == segment){
+         if (table_remove(spill->index, name) != 0){
+            free(name);
+            return -1;
+         }
+         spill->drops++;
+      }
+      free(name);
+   }
+   segment_release(spill, segment);
+   return 0;
+}
+
+spill_t* spill_create(const char* dir, size_t size_max){
+   if (!dir || size_max == 0){
+      errno = EINVAL;
+      return NULL;
+   }
+   int err;
+   spill_t* new = malloc(sizeof(spill_t));
+   if (!new){
+      errno = ENOMEM;
+      return NULL;
+   }
+   new->dir = malloc(strlen(dir) + 1);
+   new->index = table_create(INDEX_BUCKETS, NULL, NULL, free);
+   if (!new->dir || !new->index){
+      free(new->dir);
+      table_free(new->index);
+      free(new);
+      errno = ENOMEM;
+      return NULL;
+   }
+   if ((err = pthread_mutex_init(&new->mutex, NULL)) != 0){
+      free(new->dir);
+      table_free(new->index);
+      free(new);
+      errno = err;
+      return NULL;
+   }
+   strcpy(new->dir, dir);
+   new->size_max = size_max;
+   new->size = 0;
+   new->oldest = NULL;
+   new->newest = NULL;
+   new->next_id = 0;
+   new->spills = 0;
+   new->drops = 0;
+   new->hits = 0;
+   new->misses = 0;
+   return new;
+}
+
+int spill_put(spill_t* spill, const char* name, const blob_t* contents, size_t raw_size){
+   if (!spill || !name){
+      errno = EINVAL;
+      return -1;
+   }
+   size_t size = contents ? blob_get_size(contents) : 0;
+   size_t segment_size, first = 0, num;
+   struct iovec iov[16];
+   segment_t* old;
+   segment_t* segment;
+   spilled_t new;
+   spilled_t* spilled;
+
+   if (size > spill->size_max) return 1;
+   if (pthread_mutex_lock(&spill->mutex) != 0) return -1;
+   //the copy spilled before is replaced
+   spilled = (spilled_t*) table_get_value(spill->index, name);
+   if (spilled && spilled_remove(spill, name, spilled) != 0) goto failure;
+   //the contents go to a new segment if they do not fit inside the newest one,
+   //the oldest segments are dropped to make room for it
+   if (!spill->newest || spill->newest->size - spill->newest->used < size){
+      segment_size = MAX(MAX(MIN(SEGMENT_SIZE, spill->size_max / SEGMENTS_MIN), 1), size);
+      while (spill->oldest && spill->size + segment_size > spill->size_max){
+         if (segment_drop(spill) != 0) goto failure;
+      }
+      segment = segment_create(spill, segment_size);
+      if (!segment) goto failure;
+      old = spill->newest;
+      if (old) old->next = segment;
+      else spill->oldest = segment;
+      spill->newest = segment;
+      spill->size += segment_size;
+      //the segment no longer appended to is released if no file is left inside it
+      if (old && old->files == 0) segment_release(spill, old);
+   }
+   segment = spill->newest;
+   //copy the chunks of the contents after the files spilled before
+   new.segment = segment;
+   new.offset = segment->used;
+   new.size = size;
+   new.raw_size = raw_size;
+   while (contents && (num = blob_get_chunks(contents, iov, first, 16)) != 0){
+      for (size_t i = 0; i < num; i++){
+         memcpy(segment->data + segment->used, iov[i].iov_base, iov[i].iov_len);
+         segment->used += iov[i].iov_len;
+      }
+      first += num;
+   }
+   if (table_insert(spill->index, name, strlen(name) + 1, &new, sizeof(spilled_t)) != 1 ||
+       list_push_to_back(segment->names, name, strlen(name) + 1, NULL, 0) != 0) goto failure;
+   segment->files++;
+   spill->spills++;
+   if (pthread_mutex_unlock(&spill->mutex) != 0) return -1;
+   return 0;
+
+   failure:
+   pthread_mutex_unlock(&spill->mutex);
+   return -1;
+}
+
+int spill_take(spill_t* spill, const char* name, blob_t** contents, size_t* raw_size){
+   if (!spill || !name || !contents || !raw_size){
+      errno = EINVAL;
+      return -1;
+   }
+   spilled_t* spilled;
+   *contents = NULL;
+   if (pthread_mutex_lock(&spill->mutex) != 0) return -1;
+   spilled = (spilled_t*) table_get_value(spill->index, name);
+   if (!spilled){
+      spill->misses++;
+      if (pthread_mutex_unlock(&spill->mutex) != 0) return -1;
+      return 1;
+   }
+   //the contents are copied out of the segment, which may be released
+   if (spilled->size != 0){
+      *contents = blob_create(spilled->segment->data + spilled->offset, spilled->size);
+      if (!*contents){
+         pthread_mutex_unlock(&spill->mutex);
+         return -1;
+      }
+   }
+   *raw_size = spilled->raw_size;
+   if (spilled_remove(spill, name, spilled) != 0){
+      blob_unref(*contents);
+      *contents = NULL;
+      pthread_mutex_unlock(&spill->mutex);
+      return -1;
+   }
+   spill->hits++;
+   if (pthread_mutex_unlock(&spill->mutex) != 0) return -1;
+   return 0;
+}
+
+int spill_drop(spill_t* spill, const char* name){
+   if (!spill || !name){
+      errno = EINVAL;
+      return -1;
+   }
+   int err = 0;
+   spilled_t* spilled;
+   if (pthread_mutex_lock(&spill->mutex) != 0) return -1;
+   spilled = (spilled_t*) table_get_value(spill->index, name);
+   if (spilled) err = spilled_remove(spill, name, spilled);
+   if (pthread_mutex_unlock(&spill->mutex) != 0) return -1;
+   return err;
+}
+
+void spill_print(spill_t* spill, FILE* out){
+   if (!spill || !out) return;
+   if (pthread_mutex_lock(&spill->mutex) != 0) return;
+   fprintf(out, "Files spilled to the second tier: %lu, dropped from it: %lu.\n", spill->spills, spill->drops);
+   fprintf(out, "Second tier hit ratio: %5f (%lu hit(s), %lu miss(es)).\n",
+           (spill->hits + spill->misses != 0) ? (double) spill->hits / (double) (spill->hits + spill->misses) : 0,
+           spill->hits, spill->misses);
+   fprintf(out, "Size of the second tier: %5f / %5fMB.\n", spill->size / 1e6, spill->size_max / 1e6);
+   pthread_mutex_unlock(&spill->mutex);
+}
+
+void spill_free(spill_t* spill){
+   if (!spill) return;
+   while (spill->oldest) segment_release(spill, spill->oldest);
+   table_free(spill->index);
+   pthread_mutex_destroy(&spill->mutex);
+   free(spill->dir);
+   free(spill);
+}
@@ -0,0 +1,562 @@
+/**
+ * @brief implementation of the write-ahead log recording the changes to the files of the cache.
+ *
+*/
+#define _POSIX_C_SOURCE 200112L
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "wal.h"
+
+#define WAL_PATH_MAX 4096 // length of the path of a segment
+#define BATCH_MAX 1048576 // size of a batch committed without waiting for the delay to pass
+#define BUF_MIN 4096 // initial size of the buffer holding the records of a batch
+
+//header of a record, followed by the name of the file with its terminator and by the data
+typedef struct _record{
+   //FNV-1a hash of the rest of the record, a torn record does not match it
+   uint32_t checksum;
+   uint32_t type;
+   uint32_t name_len;
+   uint32_t unused;
+   uint64_t size;
+} record_t;
+
+struct _wal{
+   char* path;
+   //number of the segment the records are appended to, and its file
+   unsigned long id;
+   int fd;
+   unsigned long delay;
+   //the thread committing the batches
+   pthread_t committer;
+   bool committer_set;
+   bool stop;
+   pthread_mutex_t mutex;
+   //signaled when a record is logged and when a batch is committed
+   pthread_cond_t logged_cond;
+   pthread_cond_t committed_cond;
+   //records of the next batch
+   char* buf;
+   size_t len;
+   size_t cap;
+   //records logged and committed, the last ones may be waiting inside buf
+   uint64_t logged;
+   uint64_t committed;
+   //records logged before the last rotation, committed to the segment left by it and followed
+   //by its closing, -1 once the committer has closed it
+   int old_fd;
+   char* old_buf;
+   size_t old_len;
+   uint64_t old_logged;
+   //a batch is being written without holding the mutex
+   bool committing;
+   //errno of the commit that has failed, 0 if none
+   int error;
+
+   //records replayed, batches committed with their records, time spent committing
+   //and time spent by the callers of wal_sync waiting for their records
+   size_t replayed;
+   size_t commits;
+   size_t commit_records;
+   double commit_time;
+   size_t waits;
+   double wait_time;
+};
+
+/**
+ * @brief FNV-1a hash of a buffer, continuing from hash.
+*/
+static uint32_t wal_hash(uint32_t hash, const void* data, size_t size){
+   const unsigned char* p = data;
+   for (size_t i = 0; i < size; i++){
+      hash ^= p[i];
+      hash *= 16777619U;
+   }
+   return hash;
+}
+
+/**
+ * @brief computes the checksum of a record, from its header after the checksum itself.
+*/
+static uint32_t record_checksum(const record_t* record, const char* name, const void* data){
+   uint32_t hash = 2166136261U;
+   hash = wal_hash(hash, (const char*) record + sizeof(uint32_t), sizeof(record_t) - sizeof(uint32_t));
+   hash = wal_hash(hash, name, record->name_len);
+   return wal_hash(hash, data, (size_t) record->size);
+}
+
+static double wal_elapsed(const struct timespec* start, const struct timespec* end){
+   return (double) (end->tv_sec - start->tv_sec) + (double) (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * @brief writes a whole buffer to a file.
+ * @returns 0 on success, -1 on failure.
+*/
+static int write_all(int fd, const char* buf, size_t len){
+   ssize_t done;
+   while (len > 0){
+      done = write(fd, buf, len);
+      if (done == -1){
+         if (errno == EINTR) continue;
+         return -1;
+      }
+      buf += done;
+      len -= (size_t) done;
+   }
+   return 0;
+}
+
+/**
+ * @brief gets the numbers of the segments of the log inside its directory, in increasing order.
+ * @returns 0 on success, -1 on failure.
+ * @param ids set to a new array, to be freed by the caller.
+*/
+static int wal_segments(const wal_t* wal, unsigned long** ids, size_t* num){
+   char dir[WAL_PATH_MAX];
+   const char* base = strrchr(wal->path, '/');
+   size_t base_len, max = 16;
+   unsigned long id;
+   char* end;
+   struct dirent* entry;
+   DIR* stream;
+   if (base){
+      snprintf(dir, WAL_PATH_MAX, "%.*s", (int) (base - wal->path), wal->path);
+      if (dir[0] == '\0') strcpy(dir, "/");
+      base++;
+   }else{
+      strcpy(dir, ".");
+      base = wal->path;
+   }
+   base_len = strlen(base);
+   *num = 0;
+   *ids = malloc(sizeof(unsigned long) * max);
+   if (!*ids){
+      errno = ENOMEM;
+      return -1;
+   }
+   stream = opendir(dir);
+   if (!stream){
+      free(*ids);
+      return -1;
+   }
+   while ((entry = readdir(stream))){
+      //segments are named after the path of the log, a dot and their number
+      if (strncmp(entry->d_name, base, base_len) != 0 || entry->d_name[base_len] != '.') continue;
+      errno = 0;
+      id = strtoul(entry->d_name + base_len + 1, &end, 10);
+      if (errno != 0 || *end != '\0' || end == entry->d_name + base_len + 1 || id == 0) continue;
+      if (*num == max){
+         unsigned long* new = realloc(*ids, sizeof(unsigned long) * max * 2);
+         if (!new){
+            closedir(stream);
+            free(*ids);
+            errno = ENOMEM;
+            return -1;
+         }
+         *ids = new;
+         max *= 2;
+      }
+      //insertion sort, a log has a few segments
+      size_t i = (*num)++;
+      for (; i > 0 && (*ids)[i - 1] > id; i--) (*ids)[i] = (*ids)[i - 1];
+      (*ids)[i] = id;
+   }
+   closedir(stream);
+   return 0;
+}
+
+/**
+ * @brief creates the segment the new records are appended to.
+ * @returns the file descriptor of the segment on success, -1 on failure.
+*/
+static int segment_open(const wal_t* wal, unsigned long id){
+   char path[WAL_PATH_MAX];
+   snprintf(path, WAL_PATH_MAX, "%s.%lu", wal->path, id);
+   return open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600);
+}
+
+/**
+ * @brief commits the batches of records logged, waiting for more records after the first one of
+ * a batch as long as the delay allows.
+*/
+static void* wal_commit(void* arg){
+   wal_t* wal = (wal_t*) arg;
+   char* batch;
+   size_t len;
+   uint64_t logged;
+   int fd, err;
+   bool closing;
+   struct timespec deadline, start, end;
+   pthread_mutex_lock(&wal->mutex);
+   while (true){
+      while (wal->len == 0 && wal->old_fd == -1 && !wal->stop) pthread_cond_wait(&wal->logged_cond, &wal->mutex);
+      if (wal->len == 0 && wal->old_fd == -1) break;
+      //the records logged before a rotation are committed before the ones after it
+      closing = wal->old_fd != -1;
+      if (closing){
+         batch = wal->old_buf;
+         len = wal->old_len;
+         logged = wal->old_logged;
+         fd = wal->old_fd;
+         wal->old_buf = NULL;
+         wal->old_len = 0;
+         wal->committing = true;
+         pthread_mutex_unlock(&wal->mutex);
+         clock_gettime(CLOCK_MONOTONIC, &start);
+         err = 0;
+         if (len != 0 && (write_all(fd, batch, len) != 0 || fdatasync(fd) != 0)) err = errno;
+         clock_gettime(CLOCK_MONOTONIC, &end);
+         close(fd);
+         free(batch);
+         pthread_mutex_lock(&wal->mutex);
+         wal->committing = false;
+         wal->old_fd = -1;
+         if (err != 0){
+            wal->error = err;
+         }else if (len != 0){
+            wal->commits++;
+            wal->commit_records += (size_t) (logged - wal->committed);
+            wal->commit_time += wal_elapsed(&start, &end);
+            wal->committed = logged;
+         }
+         pthread_cond_broadcast(&wal->committed_cond);
+         continue;
+      }
+      //group commit: the records logged until the deadline join the batch
+      if (wal->delay != 0 && !wal->stop){
+         clock_gettime(CLOCK_REALTIME, &deadline);
+         deadline.tv_sec += (time_t) (wal->delay / 1000000);
+         deadline.tv_nsec += (long) (wal->delay % 1000000) * 1000;
+         if (deadline.tv_nsec >= 1000000000L){
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+         }
+         while (!wal->stop && wal->len != 0 && wal->len < BATCH_MAX &&
+                pthread_cond_timedwait(&wal->logged_cond, &wal->mutex, &deadline) != ETIMEDOUT);
+         //a rotation may have committed the batch in the meantime
+         if (wal->len == 0) continue;
+      }
+      //the batch is written without holding the mutex, the next one starts empty, to the
+      //segment it was logged to even if a rotation happens in the meantime
+      batch = wal->buf;
+      len = wal->len;
+      logged = wal->logged;
+      fd = wal->fd;
+      wal->buf = NULL;
+      wal->len = 0;
+      wal->cap = 0;
+      wal->committing = true;
+      pthread_mutex_unlock(&wal->mutex);
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      err = 0;
+      if (write_all(fd, batch, len) != 0 || fdatasync(fd) != 0) err = errno;
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      free(batch);
+      pthread_mutex_lock(&wal->mutex);
+      wal->committing = false;
+      if (err != 0){
+         wal->error = err;
+      }else{
+         wal->commits++;
+         wal->commit_records += (size_t) (logged - wal->committed);
+         wal->commit_time += wal_elapsed(&start, &end);
+         wal->committed = logged;
+      }
+      pthread_cond_broadcast(&wal->committed_cond);
+   }
+   pthread_mutex_unlock(&wal->mutex);
+   return NULL;
+}
+
+wal_t* wal_open(const char* path, unsigned long delay){
+   if (!path){
+      errno = EINVAL;
+      return NULL;
+   }
+   int err;
+   size_t num;
+   unsigned long* ids = NULL;
+   wal_t* new = malloc(sizeof(wal_t));
+   if (!new){
+      errno = ENOMEM;
+      return NULL;
+   }
+   memset(new, 0, sizeof(wal_t));
+   new->fd = -1;
+   new->old_fd = -1;
+   new->delay = delay;
+   new->path = malloc(strlen(path) + 1);
+   if (!new->path){
+      free(new);
+      errno = ENOMEM;
+      return NULL;
+   }
+   strcpy(new->path, path);
+   //the records logged from now on go after the segments found
+   if (wal_segments(new, &ids, &num) != 0) goto failure;
+   new->id = num ? ids[num - 1] + 1 : 1;
+   free(ids);
+   new->fd = segment_open(new, new->id);
+   if (new->fd == -1) goto failure;
+   if ((err = pthread_mutex_init(&new->mutex, NULL)) != 0){
+      errno = err;
+      goto failure;
+   }
+   if ((err = pthread_cond_init(&new->logged_cond, NULL)) != 0){
+      pthread_mutex_destroy(&new->mutex);
+      errno = err;
+      goto failure;
+   }
+   if ((err = pthread_cond_init(&new->committed_cond, NULL)) != 0){
+      pthread_cond_destroy(&new->logged_cond);
+      pthread_mutex_destroy(&new->mutex);
+      errno = err;
+      goto failure;
+   }
+   if ((err = pthread_create(&new->committer, NULL, &wal_commit, (void*) new)) != 0){
+      pthread_cond_destroy(&new->committed_cond);
+      pthread_cond_destroy(&new->logged_cond);
+      pthread_mutex_destroy(&new->mutex);
+      errno = err;
+      goto failure;
+   }
+   new->committer_set = true;
+   return new;
+
+   failure:
+   err = errno;
+   if (new->fd != -1) close(new->fd);
+   free(new->path);
+   free(new);
+   errno = err;
+   return NULL;
+}
+
+/**
+ * @brief replays the records of a segment, up to the first torn one.
+ * @returns 0 on success, -1 on failure.
+*/
+static int segment_replay(wal_t* wal, unsigned long id,
+                          int (*apply)(void*, int, const char*, const void*, size_t), void* arg){
+   char path[WAL_PATH_MAX];
+   char* data;
+   size_t size = 0, cap = BUF_MIN, pos = 0;
+   ssize_t done;
+   record_t record;
+   const char* name;
+   int fd, err = 0;
+   snprintf(path, WAL_PATH_MAX, "%s.%lu", wal->path, id);
+   fd = open(path, O_RDONLY);
+   if (fd == -1) return -1;
+   data = malloc(cap);
+   if (!data){
+      close(fd);
+      errno = ENOMEM;
+      return -1;
+   }
+   //the whole segment is read in memory
+   while ((done = read(fd, data + size, cap - size)) != 0){
+      if (done == -1){
+         if (errno == EINTR) continue;
+         err = -1;
+         break;
+      }
+      size += (size_t) done;
+      if (size == cap){
+         char* new = realloc(data, cap * 2);
+         if (!new){
+            errno = ENOMEM;
+            err = -1;
+            break;
+         }
+         data = new;
+         cap *= 2;
+      }
+   }
+   close(fd);
+   while (err == 0 && size - pos >= sizeof(record_t)){
+      memcpy(&record, data + pos, sizeof(record_t));
+      if (record.name_len == 0 || size - pos - sizeof(record_t) < record.name_len ||
+          size - pos - sizeof(record_t) - record.name_len < record.size) break;
+      name = data + pos + sizeof(record_t);
+      if (name[record.name_len - 1] != '\0' ||
+          record_checksum(&record, name, name + record.name_len) != record.checksum) break;
+      if (apply(arg, (int) record.type, name, name + record.name_len, (size_t) record.size) != 0){
+         err = -1;
+         break;
+      }
+      wal->replayed++;
+      pos += sizeof(record_t) + record.name_len + (size_t) record.size;
+   }
+   free(data);
+   return err;
+}
+
+int wal_replay(wal_t* wal, unsigned long first,
+               int (*apply)(void* arg, int type, const char* name, const void* data, size_t size), void* arg){
+   if (!wal || !apply){
+      errno = EINVAL;
+      return -1;
+   }
+   int err = 0;
+   size_t num;
+   unsigned long* ids;
+   if (wal_segments(wal, &ids, &num) != 0) return -1;
+   for (size_t i = 0; i < num && err == 0; i++){
+      //the segment being written holds no record yet
+      if (ids[i] < first || ids[i] >= wal->id) continue;
+      err = segment_replay(wal, ids[i], apply, arg);
+   }
+   free(ids);
+   return err;
+}
+
+int wal_log(wal_t* wal, int type, const char* name, const void* data, size_t size){
+   if (!wal || !name || (!data && size != 0)){
+      errno = EINVAL;
+      return -1;
+   }
+   record_t record;
+   size_t len;
+   char* new;
+   memset(&record, 0, sizeof(record));
+   record.type = (uint32_t) type;
+   record.name_len = (uint32_t) strlen(name) + 1;
+   record.size = size;
+   record.checksum = record_checksum(&record, name, data);
+   len = sizeof(record) + record.name_len + size;
+   if (pthread_mutex_lock(&wal->mutex) != 0) return -1;
+   if (wal->len + len > wal->cap){
+      new = realloc(wal->buf, wal->len + len > 2 * wal->cap ? wal->len + len + BUF_MIN : 2 * wal->cap + BUF_MIN);
+      if (!new){
+         pthread_mutex_unlock(&wal->mutex);
+         errno = ENOMEM;
+         return -1;
+      }
+      wal->buf = new;
+      wal->cap = wal->len + len > 2 * wal->cap ? wal->len + len + BUF_MIN : 2 * wal->cap + BUF_MIN;
+   }
+   memcpy(wal->buf + wal->len, &record, sizeof(record));
+   memcpy(wal->buf + wal->len + sizeof(record), name, record.name_len);
+   if (size != 0) memcpy(wal->buf + wal->len + sizeof(record) + record.name_len, data, size);
+   wal->len += len;
+   wal->logged++;
+   pthread_cond_signal(&wal->logged_cond);
+   if (pthread_mutex_unlock(&wal->mutex) != 0) return -1;
+   return 0;
+}
+
+int wal_sync(wal_t* wal){
+   if (!wal){
+      errno = EINVAL;
+      return -1;
+   }
+   int err = 0;
+   uint64_t target;
+   struct timespec start, end;
+   if (pthread_mutex_lock(&wal->mutex) != 0) return -1;
+   target = wal->logged;
+   if (wal->committed < target && !wal->error){
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      while (wal->committed < target && !wal->error) pthread_cond_wait(&wal->committed_cond, &wal->mutex);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      wal->waits++;
+      wal->wait_time += wal_elapsed(&start, &end);
+   }
+   if (wal->committed < target){
+      errno = wal->error;
+      err = -1;
+   }
+   if (pthread_mutex_unlock(&wal->mutex) != 0) return -1;
+   return err;
+}
+
+unsigned long wal_rotate(wal_t* wal){
+   if (!wal){
+      errno = EINVAL;
+      return 0;
+   }
+   int fd, err = 0;
+   unsigned long id = 0;
+   if (pthread_mutex_lock(&wal->mutex) != 0) return 0;
+   //the segment left by the previous rotation is closed by the committer first
+   while (wal->old_fd != -1) pthread_cond_wait(&wal->committed_cond, &wal->mutex);
+   //only the segment the records go to is switched, the committer commits the records
+   //logged so far to the current one and closes it
+   if ((fd = segment_open(wal, wal->id + 1)) != -1){
+      wal->old_fd = wal->fd;
+      wal->old_buf = wal->buf;
+      wal->old_len = wal->len;
+      wal->old_logged = wal->logged;
+      wal->buf = NULL;
+      wal->len = 0;
+      wal->cap = 0;
+      wal->fd = fd;
+      id = ++wal->id;
+      pthread_cond_signal(&wal->logged_cond);
+   }else{
+      err = errno;
+   }
+   pthread_mutex_unlock(&wal->mutex);
+   if (err != 0) errno = err;
+   return id;
+}
+
+int wal_compact(wal_t* wal, unsigned long first){
+   if (!wal){
+      errno = EINVAL;
+      return -1;
+   }
+   int err = 0;
+   size_t num;
+   unsigned long* ids;
+   char path[WAL_PATH_MAX];
+   if (wal_segments(wal, &ids, &num) != 0) return -1;
+   for (size_t i = 0; i < num && ids[i] < first; i++){
+      snprintf(path, WAL_PATH_MAX, "%s.%lu", wal->path, ids[i]);
+      if (unlink(path) != 0) err = -1;
+   }
+   free(ids);
+   return err;
+}
+
+void wal_print(wal_t* wal, FILE* out){
+   if (!wal || !out) return;
+   if (pthread_mutex_lock(&wal->mutex) != 0) return;
+   fprintf(out, "Write-ahead log: %lu record(s) logged, %lu replayed at startup.\n",
+           (unsigned long) wal->logged, wal->replayed);
+   fprintf(out, "Batches committed: %lu, mean records per batch: %5f, mean commit time: %5f ms.\n",
+           wal->commits, wal->commits ? (double) wal->commit_records / (double) wal->commits : 0,
+           wal->commits ? wal->commit_time * 1000 / (double) wal->commits : 0);
+   fprintf(out, "Mean latency added to the requests waiting for the log: %5f ms (%lu request(s)).\n",
+           wal->waits ? wal->wait_time * 1000 / (double) wal->waits : 0, wal->waits);
+   pthread_mutex_unlock(&wal->mutex);
+}
+
+void wal_close(wal_t* wal){
+   if (!wal) return;
+   //the committer commits the records left before stopping
+   pthread_mutex_lock(&wal->mutex);
+   wal->stop = true;
+   pthread_cond_signal(&wal->logged_cond);
+   pthread_mutex_unlock(&wal->mutex);
+   if (wal->committer_set) pthread_join(wal->committer, NULL);
+   pthread_cond_destroy(&wal->committed_cond);
+   pthread_cond_destroy(&wal->logged_cond);
+   pthread_mutex_destroy(&wal->mutex);
+   if (wal->fd != -1) close(wal->fd);
+   free(wal->buf);
+   free(wal->old_buf);
+   free(wal->path);
+   free(wal);
+}